@@ -13,6 +13,8 @@
 // for .ini file reading
 #include <boost/property_tree/ptree.hpp>  
 #include <boost/property_tree/ini_parser.hpp>
+#include <sstream>
+#include <math.h> // NAN
 
 /* Configuration data */
 static WR_Config_t settings;
@@ -37,38 +39,115 @@ void WR_Config_restore(void)
         boost::property_tree::ptree pt;
         boost::property_tree::ini_parser::read_ini("settings.cfg", pt);
         /* restore configs */
-        // arena
-        settings.arena.w = pt.get<float>("Arena.width");
-        settings.arena.l = pt.get<float>("Arena.length");
-        settings.arena.h = pt.get<float>("Arena.height");
+        // arena, those of WR_Config_init() if the file has none
+        settings.arena.w = pt.get<float>("Arena.width", settings.arena.w);
+        settings.arena.l = pt.get<float>("Arena.length", settings.arena.l);
+        settings.arena.h = pt.get<float>("Arena.height", settings.arena.h);
         // Anemometers
-        settings.anemo.num_of_anemometers = pt.get<int>("Anemometers.num_of_anemometers");
+        WR_Config_set_num_of_anemometers(pt.get<int>("Anemometers.num_of_anemometers",
+                    settings.anemo.num_of_anemometers));
+        settings.anemo.raw_capture = pt.get<bool>("Anemometers.raw_capture", false);
+        settings.anemo.replay_file = pt.get<std::string>("Anemometers.replay_file", "");
+        settings.anemo.replay_speed = pt.get<float>("Anemometers.replay_speed", 1.);
+        settings.anemo.compress_history = pt.get<bool>("Anemometers.compress_history", false);
+        settings.anemo.despike = pt.get<int>("Anemometers.despike", 1);
+        settings.anemo.despike_window = pt.get<int>("Anemometers.despike_window", 63);
+        settings.anemo.despike_threshold = pt.get<float>("Anemometers.despike_threshold", 6.);
+        std::istringstream windows(pt.get<std::string>("Anemometers.stats_windows_s", "60 600"));
+        settings.anemo.stats_windows.clear();
+        for (float seconds; windows >> seconds; )
+            settings.anemo.stats_windows.push_back(seconds);
+        settings.anemo.spectrum_segment = pt.get<int>("Anemometers.spectrum_segment", 1024);
+        settings.anemo.spectrum_minutes = pt.get<float>("Anemometers.spectrum_minutes", 10.);
+        settings.anemo.correlation_period_s = pt.get<float>("Anemometers.correlation_period_s", 5.);
+        settings.anemo.correlation_threads = pt.get<int>("Anemometers.correlation_threads", 1);
+        // Recording
+        settings.record.segment_minutes = pt.get<int>("Record.segment_minutes", 0);
+        settings.record.segment_size_mb = pt.get<int>("Record.segment_size_mb", 0);
+        settings.record.compression_level = pt.get<int>("Record.compression_level", 1);
+        settings.record.round_to_sensor_precision = pt.get<bool>("Record.round_to_sensor_precision", false);
+        for (int i = 0; i < settings.anemo.num_of_anemometers; i++) {
+            snprintf(name, sizeof(name), "Anemometers.serial_port_path_anemometer_%d", i+1);
+            settings.anemo.anemometer_serial_port_path[i] = pt.get<std::string>(name,
+                    settings.anemo.anemometer_serial_port_path[i]);
+            snprintf(name, sizeof(name), "Anemometers.type_anemometer_%d", i+1);
+            settings.anemo.anemometer_type[i] = pt.get<std::string>(name,
+                    settings.anemo.anemometer_type[i]);
+            snprintf(name, sizeof(name), "Anemometers.position_anemometer_%d", i+1);
+            WR_Config_Position_t* p = &settings.anemo.anemometer_position[i];
+            if (sscanf(pt.get<std::string>(name, "").c_str(), "%f %f %f", &p->x, &p->y, &p->z) != 3)
+                p->x = p->y = p->z = NAN; // not surveyed
+        }
     }
 }
 
-/* Save settings to configuration file */
-void WR_Config_save(void)
+/* settings as written to the configuration file */
+static void WR_Config_to_ptree(boost::property_tree::ptree& pt)
 {
-    /* prepare to write configuration files */
-    boost::property_tree::ptree pt;
     // arena size
     pt.put("Arena.width", settings.arena.w);
     pt.put("Arena.length", settings.arena.l);
     pt.put("Arena.height", settings.arena.h);
     // anemometers
     char name[256];
-    for (int idx = 0; idx < SERIAL_MAX_ANEMOMETERS; idx++) {
+    for (int idx = 0; idx < settings.anemo.num_of_anemometers; idx++) {
         snprintf(name, sizeof(name), "Anemometers.serial_port_path_anemometer_%d", idx+1);
         pt.put(name, settings.anemo.anemometer_serial_port_path[idx]);
         snprintf(name, sizeof(name), "Anemometers.type_anemometer_%d", idx+1);
         pt.put(name, settings.anemo.anemometer_type[idx]);
+        // x y z, left out if not surveyed
+        const WR_Config_Position_t* p = &settings.anemo.anemometer_position[idx];
+        if (isnan(p->x) or isnan(p->y) or isnan(p->z))
+            continue;
+        char position[64];
+        snprintf(position, sizeof(position), "%g %g %g", p->x, p->y, p->z);
+        snprintf(name, sizeof(name), "Anemometers.position_anemometer_%d", idx+1);
+        pt.put(name, position);
     }
     pt.put("Anemometers.num_of_anemometers", settings.anemo.num_of_anemometers);
+    pt.put("Anemometers.raw_capture", settings.anemo.raw_capture);
+    pt.put("Anemometers.replay_file", settings.anemo.replay_file);
+    pt.put("Anemometers.replay_speed", settings.anemo.replay_speed);
+    pt.put("Anemometers.compress_history", settings.anemo.compress_history);
+    pt.put("Anemometers.despike", settings.anemo.despike);
+    pt.put("Anemometers.despike_window", settings.anemo.despike_window);
+    pt.put("Anemometers.despike_threshold", settings.anemo.despike_threshold);
+    std::ostringstream windows;
+    for (size_t w = 0; w < settings.anemo.stats_windows.size(); w++)
+        windows << (w ? " " : "") << settings.anemo.stats_windows[w];
+    pt.put("Anemometers.stats_windows_s", windows.str());
+    pt.put("Anemometers.spectrum_segment", settings.anemo.spectrum_segment);
+    pt.put("Anemometers.spectrum_minutes", settings.anemo.spectrum_minutes);
+    pt.put("Anemometers.correlation_period_s", settings.anemo.correlation_period_s);
+    pt.put("Anemometers.correlation_threads", settings.anemo.correlation_threads);
+    // recording
+    pt.put("Record.segment_minutes", settings.record.segment_minutes);
+    pt.put("Record.segment_size_mb", settings.record.segment_size_mb);
+    pt.put("Record.compression_level", settings.record.compression_level);
+    pt.put("Record.round_to_sensor_precision", settings.record.round_to_sensor_precision);
+}
+
+/* Save settings to configuration file */
+void WR_Config_save(void)
+{
+    /* prepare to write configuration files */
+    boost::property_tree::ptree pt;
+    WR_Config_to_ptree(pt);
     /* write */
     boost::property_tree::ini_parser::write_ini("settings.cfg", pt);
 }
 
-/* init settings (obsolete) */
+/* settings as the configuration file would hold them, for records */
+std::string WR_Config_to_string(void)
+{
+    boost::property_tree::ptree pt;
+    WR_Config_to_ptree(pt);
+    std::ostringstream ini;
+    boost::property_tree::ini_parser::write_ini(ini, pt);
+    return ini.str();
+}
+
+/* init settings, the defaults of those not in the configuration file */
 void WR_Config_init(void)
 {
     /* init arena settings */
@@ -77,14 +156,47 @@ void WR_Config_init(void)
     settings.arena.l = 10; // y
     settings.arena.h = 10; // z
     // anemometers
+    settings.anemo.anemometer_serial_port_path.clear();
+    settings.anemo.anemometer_type.clear();
+    settings.anemo.anemometer_position.clear();
+    WR_Config_set_num_of_anemometers(3);
+    settings.anemo.raw_capture = false;
+    settings.anemo.replay_file.clear();
+    settings.anemo.replay_speed = 1.;
+    settings.anemo.compress_history = false;
+    settings.anemo.despike = 1;
+    settings.anemo.despike_window = 63; // 2 s at 32 Hz
+    settings.anemo.despike_threshold = 6.;
+    settings.anemo.stats_windows.assign(1, 60.); // 1 min
+    settings.anemo.stats_windows.push_back(600.); // 10 min
+    settings.anemo.spectrum_segment = 1024;
+    settings.anemo.spectrum_minutes = 10.;
+    settings.anemo.correlation_period_s = 5.;
+    settings.anemo.correlation_threads = 1;
+    // recording
+    settings.record.segment_minutes = 0;
+    settings.record.segment_size_mb = 0;
+    settings.record.compression_level = 1;
+    settings.record.round_to_sensor_precision = false;
+}
+
+/* change number of anemometers, keeps settings of the remaining ones */
+void WR_Config_set_num_of_anemometers(int n)
+{
     char name[256];
-    for (int i = 0; i < SERIAL_MAX_ANEMOMETERS; i++) {
+
+    if (n < 0) n = 0;
+    int old = settings.anemo.anemometer_serial_port_path.size();
+    settings.anemo.anemometer_serial_port_path.resize(n);
+    settings.anemo.anemometer_type.resize(n);
+    WR_Config_Position_t unknown = {NAN, NAN, NAN};
+    settings.anemo.anemometer_position.resize(n, unknown);
+    for (int i = old; i < n; i++) {
         snprintf(name, sizeof(name), "/dev/ttyUSB_WR_ANEMOMETER_%d", i+1);
         settings.anemo.anemometer_serial_port_path[i] = name;
-        snprintf(name, sizeof(name), "Gill WindSonic");
-        settings.anemo.anemometer_type[i] = name;
+        settings.anemo.anemometer_type[i] = "Gill WindSonic";
     }
-    settings.anemo.num_of_anemometers = 3;
+    settings.anemo.num_of_anemometers = n;
 }
 
 /* get pointer of config data */
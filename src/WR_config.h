@@ -14,10 +14,7 @@
 #define WR_CONFIG_H
 
 #include <string>
-
-#ifndef SERIAL_MAX_ANEMOMETERS
-#define SERIAL_MAX_ANEMOMETERS  20
-#endif
+#include <vector>
 
 typedef struct {
     /* width, length and height */
@@ -26,23 +23,65 @@ typedef struct {
     float h;
 } WR_Config_Arena_t;
 
+typedef struct {
+    float x, y, z; // m, in the arena
+} WR_Config_Position_t;
+
 typedef struct {
     int num_of_anemometers;
-    std::string anemometer_serial_port_path[SERIAL_MAX_ANEMOMETERS];
-    std::string anemometer_type[SERIAL_MAX_ANEMOMETERS];
+    // one entry per anemometer, kept num_of_anemometers long
+    std::vector<std::string> anemometer_serial_port_path;
+    std::vector<std::string> anemometer_type;
+    std::vector<WR_Config_Position_t> anemometer_position; // NAN if not surveyed
+    // also save the raw serial bytes, next to the record
+    bool raw_capture;
+    // replay this capture instead of reading the ports, if not empty
+    std::string replay_file;
+    float replay_speed; // 1 real time, 0 as fast as possible
+    // keep older history compressed in memory
+    bool compress_history;
+    // spikes: 0 left alone, 1 marked in the status, 2 replaced by the median
+    int despike;
+    int despike_window; // samples before each one, 3 to 4095
+    float despike_threshold; // robust sigmas from the median
+    // s, sliding windows of the statistics shown, next to those since the start
+    std::vector<float> stats_windows;
+    // Welch spectra: samples per segment (a power of two from 64, 0 for
+    // none) and minutes averaged into each spectrum
+    int spectrum_segment;
+    float spectrum_minutes;
+    // cross-correlation of all pairs: seconds between windows (0 for none)
+    // and worker threads (0 for all cores but one)
+    float correlation_period_s;
+    int correlation_threads;
 } WR_Config_Anemometers_t;
 
+typedef struct {
+    // split long sessions into segments, 0 for no limit
+    int segment_minutes;
+    int segment_size_mb; // MiB
+    // HDF5 filters, see WR_Record_set_compression()
+    int compression_level; // deflate, 0 uncompressed
+    bool round_to_sensor_precision; // wind & temperature kept to 2 decimals
+} WR_Config_Record_t;
+
 /* configuration struct */
 typedef struct {
     /* Arena */
     WR_Config_Arena_t arena;
     /* Anemometers */
     WR_Config_Anemometers_t anemo;
+    /* Recording */
+    WR_Config_Record_t record;
 } WR_Config_t;
 
 void WR_Config_restore(void);
 void WR_Config_save(void);
+// contents of the configuration file, kept in every record
+std::string WR_Config_to_string(void);
 void WR_Config_init(void);
+// change number of anemometers, new ones get default port and type
+void WR_Config_set_num_of_anemometers(int);
 // get pointer of configuration data
 WR_Config_t* WR_Config_get_configs(void);
 
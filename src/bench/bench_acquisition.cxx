@@ -0,0 +1,177 @@
+/*
+ * Benchmark of serial acquisition models
+ *
+ * Simulated Gill WindMaster ports (pipes) are fed at a fixed frame rate,
+ * and the reading CPU cost of the thread-per-port model is compared
+ * against the epoll model at 32, 64, 128 and 256 ports.
+ *
+ * Usage: bench_acquisition [seconds] [rate_hz] [poller_threads]
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/resource.h>
+#include "io/serial_anemometers.h"
+#include "io/serial_gill.h"
+#include "io/serial_epoll.h"
+
+static char frame_windmaster[GILL_MAX_FRAME_LENGTH];
+static int frame_length = 0;
+
+typedef struct {
+    int n_ports;
+    int* fds;
+    double rate;
+    volatile bool stop;
+    double cpu; // cpu time used by the writer thread, s
+} Bench_Writer_t;
+
+static double timespec_to_sec(const struct timespec* ts)
+{
+    return ts->tv_sec + ts->tv_nsec/1e9;
+}
+
+static double clock_sec(clockid_t clk)
+{
+    struct timespec ts;
+    clock_gettime(clk, &ts);
+    return timespec_to_sec(&ts);
+}
+
+static void* bench_writer_loop(void* args)
+{
+    Bench_Writer_t* writer = (Bench_Writer_t*)args;
+    struct timespec next;
+    long period_ns = (long)(1e9/writer->rate);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!writer->stop) {
+        for (int i = 0; i < writer->n_ports; i++)
+            if (write(writer->fds[i], frame_windmaster, frame_length) < 0)
+                perror("write");
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+    writer->cpu = clock_sec(CLOCK_THREAD_CPUTIME_ID);
+    return 0;
+}
+
+static void bench_run(int n_ports, int mode, double seconds, double rate, int n_threads)
+{
+    int* rfd = new int[n_ports];
+    int* wfd = new int[n_ports];
+    for (int i = 0; i < n_ports; i++) {
+        int p[2];
+        if (pipe(p) < 0) {
+            perror("pipe");
+            exit(EXIT_FAILURE);
+        }
+        rfd[i] = p[0];
+        wfd[i] = p[1];
+    }
+
+    // start readers
+    if (!sonic_anemometer_reserve(n_ports)) {
+        fprintf(stderr, "ERROR: could not allocate %d sensors\n", n_ports);
+        exit(EXIT_FAILURE);
+    }
+    for (int i = 0; i < n_ports; i++)
+        gill_set_baud(i, 115200);
+    bool exit_thread = false;
+    pthread_t* readers = new pthread_t[n_ports];
+    Anemometer_Thread_Arguments_t* args = new Anemometer_Thread_Arguments_t[n_ports];
+    if (mode == ANEMOMETER_ACQ_EPOLL) {
+        Serial_Epoll_Handler_t* handlers = new Serial_Epoll_Handler_t[n_ports];
+        for (int i = 0; i < n_ports; i++)
+            handlers[i] = &gillProcessFrame_WindMaster;
+        if (!serial_epoll_start(n_ports, rfd, handlers, n_threads)) {
+            fprintf(stderr, "ERROR: could not start epoll acquisition\n");
+            exit(EXIT_FAILURE);
+        }
+        delete [] handlers;
+    }
+    else {
+        for (int i = 0; i < n_ports; i++) {
+            args[i].index = i;
+            args[i].arg = &exit_thread;
+            args[i].fd = rfd[i];
+            args[i].process = &gillProcessFrame_WindMaster;
+            pthread_create(&readers[i], NULL, &sonic_anemometer_read_loop, (void*)&args[i]);
+        }
+    }
+
+    // feed and measure
+    struct rusage ru_start, ru_end;
+    getrusage(RUSAGE_SELF, &ru_start);
+    double cpu_start = clock_sec(CLOCK_PROCESS_CPUTIME_ID);
+
+    Bench_Writer_t writer;
+    writer.n_ports = n_ports;
+    writer.fds = wfd;
+    writer.rate = rate;
+    writer.stop = false;
+    pthread_t writer_handle;
+    pthread_create(&writer_handle, NULL, &bench_writer_loop, (void*)&writer);
+    struct timespec duration;
+    duration.tv_sec = (time_t)seconds;
+    duration.tv_nsec = (long)((seconds - duration.tv_sec)*1e9);
+    nanosleep(&duration, NULL);
+    writer.stop = true;
+    pthread_join(writer_handle, NULL);
+
+    double cpu = clock_sec(CLOCK_PROCESS_CPUTIME_ID) - cpu_start - writer.cpu;
+    getrusage(RUSAGE_SELF, &ru_end);
+    long ctx = (ru_end.ru_nvcsw - ru_start.ru_nvcsw) + (ru_end.ru_nivcsw - ru_start.ru_nivcsw);
+
+    // stop readers, EOF on the pipes wakes up blocked threads
+    if (mode == ANEMOMETER_ACQ_EPOLL)
+        serial_epoll_stop();
+    else
+        exit_thread = true;
+    for (int i = 0; i < n_ports; i++)
+        close(wfd[i]);
+    if (mode != ANEMOMETER_ACQ_EPOLL)
+        for (int i = 0; i < n_ports; i++)
+            pthread_join(readers[i], NULL);
+    for (int i = 0; i < n_ports; i++)
+        close(rfd[i]);
+
+    printf("%6d  %-16s %8.2f %%  %10.1f us  %10.0f\n", n_ports,
+            mode == ANEMOMETER_ACQ_EPOLL ? "epoll" : "thread-per-port",
+            100.*cpu/seconds, 1e6*cpu/seconds/n_ports, ctx/seconds);
+
+    delete [] args;
+    delete [] readers;
+    delete [] wfd;
+    delete [] rfd;
+}
+
+int main(int argc, char **argv)
+{
+    double seconds = argc > 1 ? atof(argv[1]) : 5.;
+    double rate = argc > 2 ? atof(argv[2]) : 32.;
+    int n_threads = argc > 3 ? atoi(argv[3]) : 1;
+    const int n_ports[] = {32, 64, 128, 256};
+
+    frame_length = gill_make_frame_windmaster(frame_windmaster, 1.23, -0.45, 0.1, 20.5, 0);
+
+    printf("%.1f s per run, %.0f Hz per port, %d poller thread(s)\n", seconds, rate, n_threads);
+    printf("%6s  %-16s %10s  %13s  %10s\n", "ports", "model", "CPU", "CPU/sensor/s", "ctxsw/s");
+    for (unsigned int i = 0; i < sizeof(n_ports)/sizeof(n_ports[0]); i++) {
+        bench_run(n_ports[i], ANEMOMETER_ACQ_THREAD_PER_PORT, seconds, rate, n_threads);
+        bench_run(n_ports[i], ANEMOMETER_ACQ_EPOLL, seconds, rate, n_threads);
+    }
+
+    return 0;
+}
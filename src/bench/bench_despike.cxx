@@ -0,0 +1,117 @@
+/*
+ * Benchmark of the despiking windows
+ *
+ * Runs a turbulent-like series with spikes through the sliding median &
+ * MAD of the despiking stage (see io/sample_despike.h) and through a naive
+ * window sorted for every sample, checks both agree, and reports the time
+ * per value and how many 32 Hz sensors (4 values a sample) one core keeps
+ * up with.
+ *
+ * Usage: bench_despike [window ...]
+ *          windows of 15, 63, 255 and 1023 samples by default
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <algorithm>
+#include <vector>
+#include "io/serial.h"
+#include "io/sample_despike.h"
+
+#define BENCH_VALUES        200000
+#define BENCH_MIN_SECONDS   1.
+#define BENCH_RATE          32. // Hz
+#define BENCH_CHANNELS      4
+
+static void make_series(std::vector<float>& x)
+{
+    srand(1);
+    double s = 0.;
+    for (size_t i = 0; i < x.size(); i++) {
+        s = 0.99*s + ((rand()%2001) - 1000)*0.0005;
+        x[i] = (float)(3. + s + ((rand()%201) - 100)*0.002);
+        if (rand()%500 == 0) // a bird
+            x[i] += (rand()%2 ? 1 : -1)*(2. + (rand()%100)*0.05);
+    }
+}
+
+/* median & MAD of every value's window, sorted from scratch */
+static double run_naive(const std::vector<float>& x, int window, std::vector<float>& med, std::vector<float>& mad)
+{
+    std::vector<float> ring(window), sorted(window), dist(window);
+    int count = 0, head = 0;
+    int64_t start = serial_clock_ns();
+    for (size_t i = 0; i < x.size(); i++) {
+        ring[head] = x[i];
+        head = (head+1) % window;
+        if (count < window)
+            count++;
+        std::copy(ring.begin(), ring.begin()+count, sorted.begin());
+        std::sort(sorted.begin(), sorted.begin()+count);
+        float m = sorted[(count-1)/2];
+        for (int k = 0; k < count; k++)
+            dist[k] = fabsf(sorted[k] - m);
+        std::sort(dist.begin(), dist.begin()+count);
+        med[i] = m;
+        mad[i] = dist[(count-1)/2];
+    }
+    return (serial_clock_ns() - start)/1e9;
+}
+
+static double run_treap(const std::vector<float>& x, int window, std::vector<float>& med, std::vector<float>& mad)
+{
+    Despike_Window_t w;
+    despike_window_init(&w, window);
+    int64_t start = serial_clock_ns();
+    for (size_t i = 0; i < x.size(); i++) {
+        despike_window_push(&w, x[i]);
+        med[i] = despike_window_median(&w);
+        mad[i] = despike_window_mad(&w, med[i]);
+    }
+    return (serial_clock_ns() - start)/1e9;
+}
+
+int main(int argc, char **argv)
+{
+    std::vector<int> windows;
+    for (int i = 1; i < argc; i++)
+        windows.push_back(atoi(argv[i]));
+    if (windows.empty()) {
+        int defaults[] = {15, SAMPLE_DESPIKE_DEFAULT_WINDOW, 255, 1023};
+        windows.assign(defaults, defaults+4);
+    }
+
+    std::vector<float> x(BENCH_VALUES);
+    make_series(x);
+    std::vector<float> med_naive(x.size()), mad_naive(x.size()), med(x.size()), mad(x.size());
+    printf("window   naive ns/value   treap ns/value   speedup   sensors at %.0f Hz per core   mismatches\n", BENCH_RATE);
+    for (size_t k = 0; k < windows.size(); k++) {
+        int window = windows[k];
+        if (window < 3 or window > SAMPLE_DESPIKE_MAX_WINDOW) {
+            fprintf(stderr, "window %d out of 3 to %d\n", window, SAMPLE_DESPIKE_MAX_WINDOW);
+            return EXIT_FAILURE;
+        }
+        double naive = 0., treap = 0.;
+        int rounds = 0;
+        do {
+            naive += run_naive(x, window, med_naive, mad_naive);
+            treap += run_treap(x, window, med, mad);
+            rounds++;
+        } while (naive + treap < BENCH_MIN_SECONDS);
+        long mismatches = 0;
+        for (size_t i = 0; i < x.size(); i++)
+            if (med[i] != med_naive[i] or mad[i] != mad_naive[i])
+                mismatches++;
+        double ns_naive = naive*1e9/(rounds*x.size()), ns_treap = treap*1e9/(rounds*x.size());
+        printf("%6d %16.1f %16.1f %9.1f %28.0f %12ld\n", window, ns_naive, ns_treap, ns_naive/ns_treap,
+                1e9/(ns_treap*BENCH_CHANNELS*BENCH_RATE), mismatches);
+    }
+
+    return 0;
+}
+
+/* End of bench_despike.cxx */
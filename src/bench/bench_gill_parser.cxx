@@ -0,0 +1,135 @@
+/*
+ * Benchmark of the Gill frame parsers
+ *
+ * Parses a byte stream, either recorded from a sensor (raw serial bytes) or
+ * generated, chunk by chunk as serial reads would deliver it, and reports
+ * frames per second on one core. First checks that a backlog delivered by
+ * several full reads in quick succession, as after a reader stall, still
+ * gets sample times that never decrease.
+ *
+ * Usage: bench_gill_parser [windsonic|windmaster] [stream_file]
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <vector>
+#include "io/serial.h"
+#include "io/serial_anemometers.h"
+#include "io/serial_gill.h"
+
+#define BENCH_FRAMES        100000 // frames of a generated stream
+#define BENCH_CHUNK         64 // bytes per simulated read
+#define BENCH_MIN_SECONDS   2.
+#define BENCH_BACKLOG       40 // WindMaster frames queued by a stalled reader
+#define BENCH_BACKLOG_READ  512 // bytes, as the reader's buffer
+#define BENCH_BACKLOG_GAP   20000 // ns between its reads
+
+static void make_stream(std::vector<char>& stream, bool windsonic)
+{
+    char frame[GILL_MAX_FRAME_LENGTH];
+    srand(1);
+    for (int i = 0; i < BENCH_FRAMES; i++) {
+        float u = 5.*sin(i*0.01) + (rand()%100)*0.01;
+        float v = 3.*cos(i*0.013) - (rand()%100)*0.01;
+        float w = (rand()%200 - 100)*0.005;
+        float T = 20. + (rand()%100)*0.01;
+        int len = windsonic ? gill_make_frame_windsonic(frame, u, v, 0)
+            : gill_make_frame_windmaster(frame, u, v, w, T, 0);
+        if (i % 100 == 99) // line noise
+            frame[rand() % len] ^= 0x10;
+        stream.insert(stream.end(), frame, frame+len);
+    }
+}
+
+/* a backlog split over reads close together, each read stamps its bytes
+ * back from its own time, so the reads' estimates overlap */
+static bool check_backlog(void)
+{
+    char frame[GILL_MAX_FRAME_LENGTH];
+    std::vector<char> stream;
+    for (int i = 0; i < BENCH_BACKLOG; i++) {
+        int len = gill_make_frame_windmaster(frame, 1.f, 2.f, 0.1f, 20.f, 0);
+        stream.insert(stream.end(), frame, frame+len);
+    }
+
+    sonic_anemometer_reserve(1);
+    gill_set_baud(0, 115200);
+    int64_t t = 1000000000LL;
+    for (size_t pos = 0; pos < stream.size(); pos += BENCH_BACKLOG_READ, t += BENCH_BACKLOG_GAP) {
+        int len = stream.size() - pos < BENCH_BACKLOG_READ ? stream.size() - pos : BENCH_BACKLOG_READ;
+        gillProcessFrame_WindMaster(&stream[pos], len, 0, t);
+    }
+    Anemometer_Data_t samples[BENCH_BACKLOG];
+    int n = sonic_anemometer_drain(0, samples, BENCH_BACKLOG);
+    if (n != BENCH_BACKLOG) {
+        fprintf(stderr, "backlog: %d of %d frames parsed\n", n, BENCH_BACKLOG);
+        return false;
+    }
+    for (int i = 1; i < n; i++)
+        if (samples[i].t <= samples[i-1].t) {
+            fprintf(stderr, "backlog: sample %d at %.3f ms, not after the one before at %.3f ms\n",
+                    i, (samples[i].t - 1000000000LL)/1e6, (samples[i-1].t - 1000000000LL)/1e6);
+            return false;
+        }
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bool windsonic = argc > 1 and strcmp(argv[1], "windsonic") == 0;
+    std::vector<char> stream;
+
+    if (argc > 2) {
+        FILE* fp = fopen(argv[2], "rb");
+        if (fp == NULL) {
+            perror(argv[2]);
+            return EXIT_FAILURE;
+        }
+        char buf[65536];
+        size_t n;
+        while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+            stream.insert(stream.end(), buf, buf+n);
+        fclose(fp);
+    }
+    else
+        make_stream(stream, windsonic);
+
+    if (!check_backlog())
+        return EXIT_FAILURE;
+    printf("backlog of %d frames over %d-byte reads: sample times never decrease\n",
+            BENCH_BACKLOG, BENCH_BACKLOG_READ);
+
+    sonic_anemometer_reserve(1);
+    gill_set_baud(0, windsonic ? 9600 : 115200);
+    Anemometer_Data_t samples[SERIAL_ANEMOMETER_RING_SIZE];
+    long frames = 0, bytes = 0;
+    int64_t start = serial_clock_ns(), elapsed;
+    do {
+        for (size_t pos = 0; pos < stream.size(); pos += BENCH_CHUNK) {
+            int len = stream.size() - pos < BENCH_CHUNK ? stream.size() - pos : BENCH_CHUNK;
+            if (windsonic)
+                gillProcessFrame_WindSonic(&stream[pos], len, 0, 0);
+            else
+                gillProcessFrame_WindMaster(&stream[pos], len, 0, 0);
+            if (pos % (BENCH_CHUNK*256) == 0)
+                frames += sonic_anemometer_drain(0, samples, SERIAL_ANEMOMETER_RING_SIZE);
+        }
+        frames += sonic_anemometer_drain(0, samples, SERIAL_ANEMOMETER_RING_SIZE);
+        bytes += stream.size();
+        elapsed = serial_clock_ns() - start;
+    } while (elapsed < BENCH_MIN_SECONDS*1e9);
+
+    double seconds = elapsed/1e9;
+    printf("%s parser, %lu bytes stream, %d-byte reads\n", windsonic ? "WindSonic" : "WindMaster",
+            (unsigned long)stream.size(), BENCH_CHUNK);
+    printf("%.0f frames/s, %.1f MB/s, %.0f sensors at 32 Hz per core\n",
+            frames/seconds, bytes/seconds/1e6, frames/seconds/32.);
+
+    return 0;
+}
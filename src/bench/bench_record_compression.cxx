@@ -0,0 +1,183 @@
+/*
+ * Benchmark of the recorder's HDF5 filter chains
+ *
+ * Records the same samples, replayed from a raw serial capture or
+ * generated, once per filter chain and reports the writer's throughput
+ * (MB/s of sample data) and the compression ratio against the
+ * uncompressed record, to choose the settings of a deployment.
+ *
+ * Usage: bench_record_compression [-n sensors] [-s seconds] [capture_file]
+ *          without capture, n sensors (default 32) sampled at 32 Hz for
+ *          s seconds (default 600) are generated
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <vector>
+#include "io/serial.h"
+#include "io/serial_anemometers.h"
+#include "io/sample_pipeline.h"
+#include "io/replay.h"
+#include "io/record.h"
+
+#define BENCH_RATE_HZ       32
+#define BENCH_FILE          "bench_record_compression.h5"
+#define BENCH_BATCH         256 // samples appended at once, as the pipeline would
+// bytes of a sample in the record: time, u, v, w, T, status, latency
+#define BENCH_SAMPLE_BYTES  (8 + 4*4 + 4 + 4)
+
+typedef struct {
+    const char* name;
+    Record_Filter_Chain_t all; // every dataset
+    Record_Filter_Chain_t wind; // u, v, w, T
+} Bench_Setting_t;
+
+#define SO  RECORD_FILTER_SCALEOFFSET
+#define SH  RECORD_FILTER_SHUFFLE
+#define DF  RECORD_FILTER_DEFLATE
+static const Bench_Setting_t settings[] = {
+    {"none",                        {0, 0, 0},      {0, 0, 0}},
+    {"deflate 1",                   {DF, 1, 0},     {DF, 1, 0}},
+    {"shuffle+deflate 1",           {SH|DF, 1, 0},  {SH|DF, 1, 0}},
+    {"shuffle+deflate 4",           {SH|DF, 4, 0},  {SH|DF, 4, 0}},
+    {"shuffle+deflate 9",           {SH|DF, 9, 0},  {SH|DF, 9, 0}},
+    {"scaleoffset",                 {SO, 0, 0},     {SO, 0, 2}},
+    {"scaleoffset+deflate 1",       {SO|DF, 1, 0},  {SO|DF, 1, 2}},
+    {"scaleoffset+deflate 4",       {SO|DF, 4, 0},  {SO|DF, 4, 2}},
+    {"shuffle+deflate 4, wind 2 dp", {SH|DF, 4, 0}, {SO|DF, 4, 2}},
+};
+#undef SO
+#undef SH
+#undef DF
+
+static std::vector< std::vector<Anemometer_Data_t> > samples;
+
+static void collect_stage(int index, Anemometer_Data_t* batch, int n, void* arg)
+{
+    samples[index].insert(samples[index].end(), batch, batch+n);
+}
+
+static bool load_capture(const char* capture_name)
+{
+    int n_sensors = WR_Replay_get_num_sensors(capture_name);
+    if (n_sensors < 1) {
+        fprintf(stderr, "ERROR: %s is not a capture file\n", capture_name);
+        return false;
+    }
+    samples.assign(n_sensors, std::vector<Anemometer_Data_t>());
+    sample_pipeline_add_stage(&collect_stage, NULL);
+    if (!sonic_anemometer_init_replay(capture_name, 0., 1))
+        return false;
+    struct timespec poll = {0, 10000000};
+    while (!sonic_anemometer_replay_done())
+        nanosleep(&poll, NULL);
+    sonic_anemometer_close();
+    sample_pipeline_remove_stage(&collect_stage, NULL);
+    return true;
+}
+
+/* gusty wind with turbulence, values with two decimals as the sensors send */
+static void make_samples(int n_sensors, int seconds)
+{
+    srand(1);
+    samples.assign(n_sensors, std::vector<Anemometer_Data_t>(seconds*BENCH_RATE_HZ));
+    for (int i = 0; i < n_sensors; i++) {
+        double phase = 2.*M_PI*i/n_sensors;
+        int64_t t = 1000000000LL + i*1000000LL;
+        for (int k = 0; k < seconds*BENCH_RATE_HZ; k++) {
+            Anemometer_Data_t* s = &samples[i][k];
+            double time = (double)k/BENCH_RATE_HZ;
+            double gust = 1. + 0.5*sin(0.2*time + phase);
+            s->speed[0] = roundf(100.*(2.*gust + 0.3*(rand()%200 - 100)/100.))/100.f;
+            s->speed[1] = roundf(100.*(1.5*gust + 0.3*(rand()%200 - 100)/100.))/100.f;
+            s->speed[2] = roundf(100.*(0.1*sin(1.3*time + phase) + 0.1*(rand()%200 - 100)/100.))/100.f;
+            s->temperature = roundf(100.*(20. + 0.5*sin(0.05*time) + 0.03*(rand()%200 - 100)/100.))/100.f;
+            s->status = 0;
+            s->latency = 20000 + rand()%5000;
+            s->t = t + rand()%100000;
+            t += 1000000000LL/BENCH_RATE_HZ;
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int n_sensors = 32;
+    int seconds = 600;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:s:h")) != -1) {
+        switch (opt) {
+            case 'n': n_sensors = atoi(optarg); break;
+            case 's': seconds = atoi(optarg); break;
+            default:
+                fprintf(stderr, "Usage: %s [-n sensors] [-s seconds] [capture_file]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (optind < argc) {
+        if (!load_capture(argv[optind]))
+            return EXIT_FAILURE;
+    }
+    else
+        make_samples(n_sensors, seconds);
+
+    uint64_t n_samples = 0;
+    for (size_t i = 0; i < samples.size(); i++)
+        n_samples += samples[i].size();
+    double raw_mb = n_samples*BENCH_SAMPLE_BYTES/1e6;
+    printf("%d sensors, %llu samples, %.1f MB of sample data\n", (int)samples.size(),
+            (unsigned long long)n_samples, raw_mb);
+
+    Anemometer_Time_Anchor_t anchor = {0, 0};
+    WR_Record_set_index(false); // the file is removed after the run
+    const int n_settings = sizeof(settings)/sizeof(settings[0]);
+    double rate[n_settings], size[n_settings];
+    for (int k = 0; k < n_settings; k++) {
+        const Bench_Setting_t* setting = &settings[k];
+        WR_Record_set_filters(NULL, &setting->all);
+        const char* wind[] = {"u", "v", "w", "T"};
+        for (int f = 0; f < 4; f++)
+            WR_Record_set_filters(wind[f], &setting->wind);
+
+        int64_t start = serial_clock_ns();
+        if (!WR_Record_start(samples.size(), BENCH_FILE, false)) {
+            fprintf(stderr, "ERROR: could not create %s\n", BENCH_FILE);
+            return EXIT_FAILURE;
+        }
+        WR_Record_set_time_anchor(&anchor);
+        // sensors interleaved batch by batch, as the pipeline delivers them
+        for (size_t pos = 0; ; pos += BENCH_BATCH) {
+            bool more = false;
+            for (size_t i = 0; i < samples.size(); i++) {
+                if (pos >= samples[i].size())
+                    continue;
+                size_t n = samples[i].size() - pos < BENCH_BATCH ? samples[i].size() - pos : BENCH_BATCH;
+                WR_Record_append(i, &samples[i][pos], n);
+                more = true;
+            }
+            if (!more)
+                break;
+        }
+        WR_Record_stop();
+        rate[k] = raw_mb/((serial_clock_ns() - start)/1e9);
+        struct stat st;
+        stat(BENCH_FILE, &st);
+        size[k] = st.st_size/1e6;
+    }
+    unlink(BENCH_FILE);
+
+    printf("%-30s %10s %10s %8s\n", "filters", "MB/s", "file MB", "ratio");
+    for (int k = 0; k < n_settings; k++)
+        printf("%-30s %10.1f %10.2f %8.2f\n", settings[k].name, rate[k], size[k], size[0]/size[k]);
+
+    return 0;
+}
@@ -0,0 +1,56 @@
+/*
+ * Anemometer protocol drivers
+ *
+ * Registry of the drivers, looked up by type name.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <string.h>
+#include "io/anemometer_driver.h"
+#include "io/serial_gill.h"
+#include "io/serial_young.h"
+
+static const Anemometer_Driver_t* drivers[ANEMOMETER_MAX_DRIVERS] = {
+    &gill_windsonic_driver,
+    &gill_windmaster_driver,
+    &young_81000_driver,
+};
+static int num_drivers = 3;
+
+/* add a driver, not thread safe, do it before acquisition starts */
+bool anemometer_driver_register(const Anemometer_Driver_t* driver)
+{
+    if (driver == NULL or driver->name == NULL or driver->process == NULL
+            or driver->reset == NULL or driver->baud <= 0)
+        return false;
+    if (anemometer_driver_find(driver->name) != NULL or num_drivers >= ANEMOMETER_MAX_DRIVERS)
+        return false;
+    drivers[num_drivers++] = driver;
+    return true;
+}
+
+const Anemometer_Driver_t* anemometer_driver_find(const char* name)
+{
+    if (name == NULL)
+        return NULL;
+    for (int i = 0; i < num_drivers; i++)
+        if (strcmp(drivers[i]->name, name) == 0)
+            return drivers[i];
+    return NULL;
+}
+
+int anemometer_driver_count(void)
+{
+    return num_drivers;
+}
+
+const Anemometer_Driver_t* anemometer_driver_get(int i)
+{
+    if (i < 0 or i >= num_drivers)
+        return NULL;
+    return drivers[i];
+}
+
+/* End of anemometer_driver.cxx */
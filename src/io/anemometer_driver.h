@@ -0,0 +1,44 @@
+/*
+ * Anemometer protocol drivers
+ *
+ * A driver tells how to set up the serial line of one anemometer type and
+ * parses its byte stream into samples handed to sonic_anemometer_publish().
+ * Drivers are looked up by type name once at sonic_anemometer_init(); the
+ * acquisition then calls the driver's process function directly for every
+ * read, the per-byte loop stays inside the driver.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef ANEMOMETER_DRIVER_H
+#define ANEMOMETER_DRIVER_H
+
+#include <stdint.h>
+
+#define ANEMOMETER_MAX_DRIVERS  16
+
+typedef struct {
+    const char* name; // type name used in settings, e.g. "Gill WindMaster"
+    int baud; // serial line, 8N1
+    /* reset parser state of sensor index, bytes are timestamped one byte
+     * transmission time apart at this baud rate */
+    void (*reset)(int index, int baud);
+    /* byte-stream parser, t is the arrival (CLOCK_MONOTONIC, ns) of the last
+     * byte of buf, called from one thread at a time per sensor */
+    void (*process)(char* buf, int len, int index, int64_t t);
+    /* frame builder for simulators and benchmarks, returns frame length,
+     * buf needs ANEMOMETER_MAX_FRAME_LENGTH bytes; NULL if not supported */
+    int (*make_frame)(char* buf, float u, float v, float w, float T, int status);
+    int axes; // 3 if w and sonic temperature are measured, 2 for horizontal wind only
+} Anemometer_Driver_t;
+
+#define ANEMOMETER_MAX_FRAME_LENGTH 64
+
+/* anemometer_driver.cxx, built-in drivers are registered from the start */
+bool anemometer_driver_register(const Anemometer_Driver_t*);
+const Anemometer_Driver_t* anemometer_driver_find(const char* name);
+int anemometer_driver_count(void);
+const Anemometer_Driver_t* anemometer_driver_get(int i);
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * Raw serial capture
+ *
+ * Per-sensor byte rings filled by the serial readers, drained into a
+ * page-aligned buffer by a writer thread. A record that does not fit
+ * before the end of a ring is preceded by a wrap marker (len = all ones)
+ * and starts again at the beginning of the ring, so records are always
+ * contiguous and the reader copies each one exactly once.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE // O_DIRECT
+#endif
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+#include <new>
+#include <string>
+#include "io/capture.h"
+#include "io/serial_anemometers.h"
+#include "io/spsc_ring.h" // CACHE_LINE_SIZE
+
+#define CAPTURE_WRAP    0xFFFFFFFFu
+
+typedef struct {
+    // producer, the serial reader of the sensor
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> head;
+    unsigned int tail_cache;
+    std::atomic<unsigned long> dropped;
+    char* buf;
+    // consumer, the writer thread
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> tail;
+} Capture_Ring_t;
+
+static Capture_Ring_t* rings = NULL;
+static char* ring_data = NULL;
+static int num_rings = 0;
+
+static int fd = -1;
+static std::string file_name;
+static char* buffer = NULL; // page aligned, CAPTURE_BUFFER_SIZE
+static size_t fill = 0; // bytes in buffer
+static uint64_t data_size = 0; // record bytes in file
+static uint32_t header_size = 0;
+static bool write_failing = false; // reported once until a write goes through
+
+static pthread_mutex_t capture_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t capture_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t writer_thread_handle;
+static bool exit_thread = false;
+static std::atomic<bool> capturing(false);
+
+/* write whole pages of the buffer, all of it padded to a page if final */
+static bool capture_write_buffer(bool final)
+{
+    size_t n = final ? (fill + CAPTURE_PAGE_SIZE-1) & ~(size_t)(CAPTURE_PAGE_SIZE-1)
+        : fill & ~(size_t)(CAPTURE_PAGE_SIZE-1);
+    if (n == 0)
+        return true;
+    if (n > fill)
+        memset(buffer + fill, 0, n - fill);
+    size_t done = 0;
+    while (done < n) {
+        ssize_t ret = pwrite(fd, buffer + done, n - done, header_size + data_size + done);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            if (!write_failing)
+                perror(file_name.c_str());
+            write_failing = true;
+            return false;
+        }
+        done += ret;
+    }
+    write_failing = false;
+    size_t kept = fill > n ? fill - n : 0;
+    memmove(buffer, buffer + n, kept);
+    data_size += fill - kept;
+    fill = kept;
+    return true;
+}
+
+/* copy whatever the readers appended since the last pass; records that
+ * find the buffer full and cannot be written out are dropped */
+static void capture_drain(void)
+{
+    bool full = false; // and the write failed, not retried before the next pass
+    for (int i = 0; i < num_rings; i++) {
+        Capture_Ring_t* ring = &rings[i];
+        unsigned int t = ring->tail.load(std::memory_order_relaxed);
+        unsigned int h = ring->head.load(std::memory_order_acquire);
+        while (t != h) {
+            unsigned int pos = t & (CAPTURE_RING_SIZE-1);
+            const Capture_Record_Header_t* rec = (const Capture_Record_Header_t*)(ring->buf + pos);
+            if (rec->len == CAPTURE_WRAP) {
+                t += CAPTURE_RING_SIZE - pos;
+                continue;
+            }
+            size_t size = CAPTURE_RECORD_SIZE(rec->len);
+            if (fill + size > CAPTURE_BUFFER_SIZE and !full)
+                full = !capture_write_buffer(false) or fill + size > CAPTURE_BUFFER_SIZE;
+            if (full) {
+                ring->dropped.fetch_add(1, std::memory_order_relaxed);
+                t += size;
+                continue;
+            }
+            memcpy(buffer + fill, rec, size);
+            fill += size;
+            t += size;
+        }
+        ring->tail.store(t, std::memory_order_release);
+    }
+}
+
+static void capture_write_header(void)
+{
+    char* header = NULL;
+    if (posix_memalign((void**)&header, CAPTURE_PAGE_SIZE, header_size) != 0)
+        return;
+    memset(header, 0, header_size);
+
+    Capture_File_Header_t* fh = (Capture_File_Header_t*)header;
+    memcpy(fh->magic, CAPTURE_MAGIC, sizeof(fh->magic));
+    fh->version = CAPTURE_VERSION;
+    fh->header_size = header_size;
+    fh->n_sensors = num_rings;
+    const Anemometer_Time_Anchor_t* anchor = sonic_anemometer_get_time_anchor();
+    fh->time_anchor_realtime = anchor->realtime;
+    fh->time_anchor_monotonic = anchor->monotonic;
+    Capture_Sensor_Info_t* info = (Capture_Sensor_Info_t*)(header + sizeof(Capture_File_Header_t));
+    for (int i = 0; i < num_rings; i++) {
+        const char* type = sonic_anemometer_get_type(i);
+        const char* port = sonic_anemometer_get_port_path(i);
+        strncpy(info[i].type, type ? type : "", sizeof(info[i].type)-1);
+        strncpy(info[i].port, port ? port : "", sizeof(info[i].port)-1);
+    }
+    if (pwrite(fd, header, header_size, 0) != (ssize_t)header_size)
+        perror(file_name.c_str());
+    free(header);
+}
+
+static void* capture_writer_loop(void* args)
+{
+    struct timespec last_flush;
+    clock_gettime(CLOCK_MONOTONIC, &last_flush);
+
+    pthread_mutex_lock(&capture_mutex);
+    while (!exit_thread) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += CAPTURE_PERIOD_MS*1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&capture_cond, &capture_mutex, &deadline);
+        pthread_mutex_unlock(&capture_mutex);
+
+        capture_drain();
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - last_flush.tv_sec)*1000 + (now.tv_nsec - last_flush.tv_nsec)/1000000
+                >= CAPTURE_FLUSH_PERIOD_MS) {
+            capture_write_buffer(false);
+            last_flush = now;
+        }
+
+        pthread_mutex_lock(&capture_mutex);
+    }
+    pthread_mutex_unlock(&capture_mutex);
+
+    // readers stopped, take the rest
+    capture_drain();
+    capture_write_buffer(true);
+    return 0;
+}
+
+static void capture_release(void)
+{
+    for (int i = 0; i < num_rings; i++)
+        rings[i].~Capture_Ring_t();
+    free(rings);
+    free(ring_data);
+    free(buffer);
+    rings = NULL;
+    ring_data = NULL;
+    buffer = NULL;
+    num_rings = 0;
+}
+
+bool WR_Capture_start(const char* name, int n_sensors)
+{
+    if (capturing.load() or name == NULL or n_sensors < 1)
+        return false;
+
+    // page aligned buffers, O_DIRECT needs them and they suit the page cache too
+    void* block;
+    if (posix_memalign(&block, CACHE_LINE_SIZE, n_sensors*sizeof(Capture_Ring_t)) != 0)
+        return false;
+    rings = (Capture_Ring_t*)block;
+    num_rings = n_sensors;
+    if (posix_memalign((void**)&ring_data, CAPTURE_PAGE_SIZE, (size_t)n_sensors*CAPTURE_RING_SIZE) != 0
+            or posix_memalign((void**)&buffer, CAPTURE_PAGE_SIZE, CAPTURE_BUFFER_SIZE) != 0) {
+        for (int i = 0; i < n_sensors; i++)
+            new (&rings[i]) Capture_Ring_t();
+        capture_release();
+        return false;
+    }
+    for (int i = 0; i < n_sensors; i++) {
+        new (&rings[i]) Capture_Ring_t();
+        rings[i].head.store(0);
+        rings[i].tail_cache = 0;
+        rings[i].dropped.store(0);
+        rings[i].buf = ring_data + (size_t)i*CAPTURE_RING_SIZE;
+        rings[i].tail.store(0);
+    }
+
+    file_name = name;
+    fd = open(name, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd < 0 and errno == EINVAL) // filesystem without O_DIRECT, e.g. tmpfs
+        fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(name);
+        capture_release();
+        return false;
+    }
+    header_size = (sizeof(Capture_File_Header_t) + n_sensors*sizeof(Capture_Sensor_Info_t)
+            + CAPTURE_PAGE_SIZE-1) & ~(CAPTURE_PAGE_SIZE-1);
+    fill = 0;
+    data_size = 0;
+    write_failing = false;
+    capture_write_header();
+
+    exit_thread = false;
+    if (pthread_create(&writer_thread_handle, NULL, &capture_writer_loop, NULL) != 0) {
+        close(fd);
+        fd = -1;
+        capture_release();
+        return false;
+    }
+    capturing.store(true, std::memory_order_release);
+
+    return true;
+}
+
+/* call after the serial readers stopped */
+void WR_Capture_stop(void)
+{
+    if (!capturing.load())
+        return;
+
+    capturing.store(false);
+    pthread_mutex_lock(&capture_mutex);
+    exit_thread = true;
+    pthread_cond_signal(&capture_cond);
+    pthread_mutex_unlock(&capture_mutex);
+    pthread_join(writer_thread_handle, NULL);
+
+    // the last page was padded
+    if (ftruncate(fd, header_size + data_size) < 0)
+        perror(file_name.c_str());
+    close(fd);
+    fd = -1;
+    for (int i = 0; i < num_rings; i++)
+        if (rings[i].dropped.load())
+            fprintf(stderr, "Anemometer %d: %lu raw chunks not captured, disk too slow or failing.\n",
+                    i+1, rings[i].dropped.load());
+    printf("Raw capture saved to %s\n", file_name.c_str());
+    capture_release();
+}
+
+bool WR_Capture_is_capturing(void)
+{
+    return capturing.load(std::memory_order_relaxed);
+}
+
+void WR_Capture_append(int index, const char* data, int len, int64_t t)
+{
+    if (index < 0 or index >= num_rings or len <= 0)
+        return;
+    Capture_Ring_t* ring = &rings[index];
+
+    unsigned int size = CAPTURE_RECORD_SIZE(len);
+    unsigned int h = ring->head.load(std::memory_order_relaxed);
+    unsigned int pos = h & (CAPTURE_RING_SIZE-1);
+    unsigned int skip = CAPTURE_RING_SIZE - pos < size ? CAPTURE_RING_SIZE - pos : 0;
+    if (h + skip + size - ring->tail_cache > CAPTURE_RING_SIZE) {
+        ring->tail_cache = ring->tail.load(std::memory_order_acquire);
+        if (h + skip + size - ring->tail_cache > CAPTURE_RING_SIZE) {
+            ring->dropped.fetch_add(1, std::memory_order_relaxed); // the writer counts its drops here too
+            return;
+        }
+    }
+    if (skip) {
+        // records are multiples of 8 bytes, so the marker always fits
+        *(uint32_t*)(ring->buf + pos) = CAPTURE_WRAP;
+        h += skip;
+        pos = 0;
+    }
+    Capture_Record_Header_t* rec = (Capture_Record_Header_t*)(ring->buf + pos);
+    rec->len = len;
+    rec->index = index;
+    rec->t = t;
+    memcpy(rec + 1, data, len);
+    memset((char*)(rec + 1) + len, 0, size - sizeof(Capture_Record_Header_t) - len);
+    ring->head.store(h + size, std::memory_order_release);
+}
+
+unsigned long WR_Capture_get_dropped(int index)
+{
+    if (index < 0 or index >= num_rings)
+        return 0;
+    return rings[index].dropped.load(std::memory_order_relaxed);
+}
+
+/* End of capture.cxx */
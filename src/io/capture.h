@@ -0,0 +1,73 @@
+/*
+ * Raw serial capture
+ *
+ * Every chunk returned by serial_read() is teed, with its arrival time and
+ * sensor index, into a per-session capture file, so a field campaign can
+ * be debugged (or replayed) from the exact bytes the sensors sent.
+ *
+ * The serial readers only copy the chunk into a per-sensor single-producer
+ * byte ring. A writer thread drains the rings into a large page-aligned
+ * buffer and writes it out in whole pages (O_DIRECT where the filesystem
+ * allows it), so capturing never puts the disk in the way of parsing.
+ *
+ * File layout, little endian:
+ *   Capture_File_Header_t, then n_sensors Capture_Sensor_Info_t, padded
+ *   with zeros to header_size bytes (a multiple of CAPTURE_PAGE_SIZE);
+ *   then records, each a Capture_Record_Header_t followed by len bytes,
+ *   padded with zeros to a multiple of 8 bytes. Records of one sensor are
+ *   in arrival order, records of different sensors are interleaved in
+ *   batches, sort by t if a global order is needed.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <stdint.h>
+
+#define CAPTURE_MAGIC           "WRCAP\0\0\0"
+#define CAPTURE_VERSION         1
+#define CAPTURE_PAGE_SIZE       4096
+#define CAPTURE_RING_SIZE       (64*1024) // bytes buffered per sensor, power of two
+#define CAPTURE_BUFFER_SIZE     (1024*1024) // writer buffer, multiple of CAPTURE_PAGE_SIZE
+#define CAPTURE_PERIOD_MS       50 // rings drained this often
+#define CAPTURE_FLUSH_PERIOD_MS 1000 // data reaches the file at least this often
+
+typedef struct {
+    char magic[8]; // CAPTURE_MAGIC
+    uint32_t version;
+    uint32_t header_size; // bytes before the first record
+    uint32_t n_sensors;
+    uint32_t reserved;
+    int64_t time_anchor_realtime; // ns, see Anemometer_Time_Anchor_t
+    int64_t time_anchor_monotonic;
+} Capture_File_Header_t;
+
+typedef struct {
+    char type[32]; // driver name, nul terminated
+    char port[96]; // serial port path, nul terminated
+} Capture_Sensor_Info_t;
+
+typedef struct {
+    uint32_t len; // bytes of data following
+    uint32_t index; // sensor
+    int64_t t; // ns, CLOCK_MONOTONIC arrival of the last byte, as passed to the parser
+} Capture_Record_Header_t;
+
+#define CAPTURE_RECORD_SIZE(len) ((sizeof(Capture_Record_Header_t) + (len) + 7) & ~(size_t)7)
+
+/* capture.cxx, started and stopped by the acquisition (sonic_anemometer_init
+ * and sonic_anemometer_close) after the ports are opened */
+bool WR_Capture_start(const char* file_name, int n_sensors);
+void WR_Capture_stop(void);
+bool WR_Capture_is_capturing(void);
+/* reader side, one thread per sensor at a time, never blocks */
+void WR_Capture_append(int index, const char* buf, int len, int64_t t);
+/* chunks lost because the disk fell behind or failed */
+unsigned long WR_Capture_get_dropped(int index);
+
+#endif
+
+/* End of capture.h */
@@ -0,0 +1,458 @@
+/*
+ * Cross-correlation between sensors
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h> // sysconf()
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+#include <vector>
+#include "io/cross_corr.h"
+#include "io/fft.h"
+#include "io/serial.h" // serial_clock_ns()
+#include "io/serial_anemometers.h"
+#include "io/sample_history.h"
+
+typedef struct {
+    float x, y, z;
+} Cross_Corr_Position_t;
+
+/* one round of cross_corr_compute(), shared by its workers */
+typedef struct {
+    const Fft_Plan_t* plan; // of 2*points
+    const float* re; // spectra of the signals, bins 0 to points, lanes
+    const float* im;
+    int lanes;
+    std::vector<int> first, second; // the pairs, as lanes of the spectra
+    std::atomic<int> next; // first pair not taken yet
+    int max_lag; // grid steps
+    std::vector<float> lag, peak; // of each pair, in grid steps
+} Cross_Corr_Round_t;
+
+static double grid_rate = CROSS_CORR_DEFAULT_RATE;
+static int grid_points = CROSS_CORR_DEFAULT_POINTS;
+static double max_lag_seconds = CROSS_CORR_DEFAULT_MAX_LAG;
+static double period_seconds = CROSS_CORR_DEFAULT_PERIOD;
+static int num_threads = 0;
+static std::vector<Cross_Corr_Position_t> positions;
+// published
+static pthread_mutex_t matrix_mutex = PTHREAD_MUTEX_INITIALIZER;
+static std::vector<Cross_Corr_Pair_t> matrix;
+static Cross_Corr_Info_t matrix_info;
+// the correlating thread
+static pthread_t corr_thread_handle;
+static pthread_mutex_t corr_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t corr_cond = PTHREAD_COND_INITIALIZER;
+static bool exit_thread = false;
+static bool running = false;
+static int num_sensors = 0;
+static int corr_threads = 1; // of the running thread
+static double corr_period = CROSS_CORR_DEFAULT_PERIOD;
+
+/* peak of a correlation within max_lag of 0, r of m points, lag m-k at k */
+static void cross_corr_peak(const float* r, int stride, int m, int max_lag, float* lag, float* peak)
+{
+    int best = 0;
+    for (int k = -max_lag; k <= max_lag; k++)
+        if (r[(k < 0 ? k+m : k)*stride] > r[(best < 0 ? best+m : best)*stride])
+            best = k;
+    float y0 = r[(best < 0 ? best+m : best)*stride];
+    *lag = best;
+    *peak = y0;
+    // between grid steps, the parabola through the peak and its neighbours
+    if (best > -max_lag and best < max_lag) {
+        float ym = r[(best-1 < 0 ? best-1+m : best-1)*stride];
+        float yp = r[(best+1 < 0 ? best+1+m : best+1)*stride];
+        float d = ym - 2.f*y0 + yp;
+        if (d < 0.f) {
+            float delta = 0.5f*(ym - yp)/d;
+            *lag = best + delta;
+            *peak = y0 - 0.25f*(ym - yp)*delta;
+        }
+    }
+}
+
+/* inverse transforms of cross spectra, CROSS_CORR_LANES signals of two
+ * pairs each: Z = C1 + i C2 of Hermitian C1 & C2 comes back as r1 + i r2 */
+static void* cross_corr_worker(void* args)
+{
+    Cross_Corr_Round_t* round = (Cross_Corr_Round_t*)args;
+    const int m = round->plan->n, half = m/2;
+    const int lanes = round->lanes;
+    const int n_pairs = round->first.size();
+    std::vector<float> zr(m*CROSS_CORR_LANES), zi(m*CROSS_CORR_LANES);
+
+    for (;;) {
+        int p0 = round->next.fetch_add(2*CROSS_CORR_LANES);
+        if (p0 >= n_pairs)
+            break;
+        int n = n_pairs - p0 < 2*CROSS_CORR_LANES ? n_pairs - p0 : 2*CROSS_CORR_LANES;
+        // a missing pair is one of zeros, lanes past the end
+        int a[CROSS_CORR_LANES], b[CROSS_CORR_LANES], c[CROSS_CORR_LANES], d[CROSS_CORR_LANES];
+        for (int l = 0; l < CROSS_CORR_LANES; l++) {
+            int p = p0 + 2*l;
+            a[l] = p < p0+n ? round->first[p] : -1;
+            b[l] = p < p0+n ? round->second[p] : -1;
+            c[l] = p+1 < p0+n ? round->first[p+1] : -1;
+            d[l] = p+1 < p0+n ? round->second[p+1] : -1;
+        }
+        for (int k = 0; k <= half; k++) {
+            const float* re = round->re + k*lanes;
+            const float* im = round->im + k*lanes;
+            float* zrk = &zr[k*CROSS_CORR_LANES];
+            float* zik = &zi[k*CROSS_CORR_LANES];
+            float* zrm = &zr[(m-k)*CROSS_CORR_LANES];
+            float* zim = &zi[(m-k)*CROSS_CORR_LANES];
+            for (int l = 0; l < CROSS_CORR_LANES; l++) {
+                float c1r = 0.f, c1i = 0.f, c2r = 0.f, c2i = 0.f;
+                if (a[l] >= 0) { // conj(X_a) X_b
+                    c1r = re[a[l]]*re[b[l]] + im[a[l]]*im[b[l]];
+                    c1i = re[a[l]]*im[b[l]] - im[a[l]]*re[b[l]];
+                }
+                if (c[l] >= 0) {
+                    c2r = re[c[l]]*re[d[l]] + im[c[l]]*im[d[l]];
+                    c2i = re[c[l]]*im[d[l]] - im[c[l]]*re[d[l]];
+                }
+                zrk[l] = c1r - c2i;
+                zik[l] = c1i + c2r;
+                if (k > 0 and k < half) { // conj(C1) + i conj(C2) at m-k
+                    zrm[l] = c1r + c2i;
+                    zim[l] = c2r - c1i;
+                }
+            }
+        }
+        fft_batch(round->plan, zr.data(), zi.data(), CROSS_CORR_LANES, true);
+        for (int l = 0; l < CROSS_CORR_LANES; l++) {
+            int p = p0 + 2*l;
+            if (p < p0+n)
+                cross_corr_peak(&zr[l], CROSS_CORR_LANES, m, round->max_lag, &round->lag[p], &round->peak[p]);
+            if (p+1 < p0+n)
+                cross_corr_peak(&zi[l], CROSS_CORR_LANES, m, round->max_lag, &round->lag[p+1], &round->peak[p+1]);
+        }
+    }
+    return 0;
+}
+
+bool cross_corr_compute(const float* x, int n, int points, double rate, double max_lag,
+        int n_threads, Cross_Corr_Pair_t* pairs)
+{
+    Fft_Real_Plan_t real_plan;
+    Fft_Plan_t plan;
+    if (n < 1 or rate <= 0. or !fft_real_plan(&real_plan, 2*points) or !fft_plan(&plan, 2*points))
+        return false;
+    const int m = 2*points; // zero padded, no wrapping around within the lags
+
+    // signals with unit variance over sqrt(points), so r at lag 0 is the
+    // correlation coefficient, interleaved for the forward transform
+    std::vector<int> lane_of(n, -1);
+    int lanes = 0;
+    for (int i = 0; i < n; i++)
+        if (!isnan(x[i*points]))
+            lane_of[i] = lanes++;
+    for (int i = 0; i < n*n; i++)
+        pairs[i].lag = pairs[i].peak = pairs[i].velocity = NAN;
+    if (lanes == 0)
+        return true;
+    std::vector<float> signals(m*lanes, 0.f);
+    for (int i = 0; i < n; i++) {
+        int s = lane_of[i];
+        if (s < 0)
+            continue;
+        const float* xi = x + i*points;
+        double mean = 0., var = 0.;
+        for (int k = 0; k < points; k++)
+            mean += xi[k];
+        mean /= points;
+        for (int k = 0; k < points; k++)
+            var += (xi[k] - mean)*(xi[k] - mean);
+        float scale = var > 0. ? (float)(1./sqrt(var)) : 0.f;
+        for (int k = 0; k < points; k++)
+            signals[k*lanes + s] = (float)(xi[k] - mean)*scale;
+    }
+    std::vector<float> re((points+1)*lanes), im((points+1)*lanes);
+    fft_real_batch(&real_plan, signals.data(), re.data(), im.data(), lanes);
+
+    Cross_Corr_Round_t round;
+    round.plan = &plan;
+    round.re = re.data();
+    round.im = im.data();
+    round.lanes = lanes;
+    for (int i = 0; i < n; i++)
+        for (int j = i+1; j < n; j++)
+            if (lane_of[i] >= 0 and lane_of[j] >= 0) {
+                round.first.push_back(lane_of[i]);
+                round.second.push_back(lane_of[j]);
+            }
+    round.next.store(0);
+    round.max_lag = (int)(max_lag*rate);
+    if (round.max_lag > points/2)
+        round.max_lag = points/2;
+    round.lag.assign(round.first.size(), NAN);
+    round.peak.assign(round.first.size(), NAN);
+
+    // no more threads than batches
+    int batches = (round.first.size() + 2*CROSS_CORR_LANES - 1)/(2*CROSS_CORR_LANES);
+    if (n_threads > batches)
+        n_threads = batches;
+    if (n_threads > CROSS_CORR_MAX_THREADS)
+        n_threads = CROSS_CORR_MAX_THREADS;
+    pthread_t handles[CROSS_CORR_MAX_THREADS];
+    int started = 0;
+    for (; started < n_threads-1; started++)
+        if (pthread_create(&handles[started], NULL, &cross_corr_worker, &round) != 0)
+            break;
+    cross_corr_worker(&round); // this thread works too
+    for (int k = 0; k < started; k++)
+        pthread_join(handles[k], NULL);
+
+    // both halves of the matrix, the inverse transforms were not scaled by 1/m
+    int p = 0;
+    for (int i = 0; i < n; i++) {
+        if (lane_of[i] < 0)
+            continue;
+        pairs[i*n+i].lag = 0.f;
+        pairs[i*n+i].peak = 1.f;
+        for (int j = i+1; j < n; j++) {
+            if (lane_of[j] < 0)
+                continue;
+            pairs[i*n+j].lag = (float)(round.lag[p]/rate);
+            pairs[j*n+i].lag = -pairs[i*n+j].lag;
+            pairs[i*n+j].peak = pairs[j*n+i].peak = round.peak[p]/m;
+            p++;
+        }
+    }
+    return true;
+}
+
+/* samples of a window, good ones only */
+static void cross_corr_collect(const Anemometer_Data_t* samples, int n, void* arg)
+{
+    std::vector<Anemometer_Data_t>* window = (std::vector<Anemometer_Data_t>*)arg;
+    for (int k = 0; k < n; k++)
+        if (samples[k].status == 0)
+            window->push_back(samples[k]);
+}
+
+/* horizontal speed of a sensor on the grid t0 + k/rate, linear between
+ * samples; false if too few grid points lie between close samples */
+static bool cross_corr_resample(const std::vector<Anemometer_Data_t>& samples, int64_t t0, int64_t step, float* y)
+{
+    const int64_t max_spacing = (int64_t)(CROSS_CORR_MAX_SPACING*1e9);
+    if (samples.size() < 2)
+        return false;
+    size_t s = 0;
+    int covered = 0;
+    for (int k = 0; k < grid_points; k++) {
+        int64_t t = t0 + k*step;
+        while (s+2 < samples.size() and samples[s+1].t <= t)
+            s++;
+        const Anemometer_Data_t* a = &samples[s];
+        const Anemometer_Data_t* b = &samples[s+1];
+        double ha = hypot(a->speed[0], a->speed[1]), hb = hypot(b->speed[0], b->speed[1]);
+        if (b->t <= a->t)
+            y[k] = (float)hb;
+        else {
+            double f = (double)(t - a->t)/(b->t - a->t);
+            f = f < 0. ? 0. : (f > 1. ? 1. : f);
+            y[k] = (float)(ha + f*(hb - ha));
+        }
+        if (a->t <= t and t <= b->t and b->t - a->t <= max_spacing)
+            covered++;
+    }
+    return covered >= CROSS_CORR_MIN_COVERAGE*grid_points;
+}
+
+/* newest sample in a history, 0 if none */
+static int64_t cross_corr_last_time(Sample_History* history)
+{
+    int64_t t = 0;
+    history->lock();
+    int k = history->num_chunks();
+    if (k > 0) {
+        int n;
+        const Anemometer_Data_t* samples = history->chunk(k-1, &n);
+        if (n > 0)
+            t = samples[n-1].t;
+    }
+    history->unlock();
+    return t;
+}
+
+/* one window of every sensor, the newest all of them have */
+static void cross_corr_round(std::vector<float>* grid, std::vector<Cross_Corr_Pair_t>* pairs)
+{
+    int64_t start = serial_clock_ns();
+    const int64_t step = (int64_t)(1e9/grid_rate);
+    int64_t t1 = 0;
+    for (int i = 0; i < num_sensors; i++) {
+        int64_t t = cross_corr_last_time(sonic_anemometer_get_wind_record(i));
+        if (t != 0 and (t1 == 0 or t < t1))
+            t1 = t;
+    }
+    if (t1 == 0)
+        return;
+    t1 -= t1 % step;
+    int64_t t0 = t1 - grid_points*step;
+
+    int valid = 0;
+    std::vector<Anemometer_Data_t> window;
+    for (int i = 0; i < num_sensors; i++) {
+        window.clear();
+        sonic_anemometer_get_wind_record(i)->scan(t0 - step, t1 + step, &cross_corr_collect, &window);
+        float* y = grid->data() + i*grid_points;
+        if (cross_corr_resample(window, t0, step, y))
+            valid++;
+        else
+            y[0] = NAN;
+    }
+    if (!cross_corr_compute(grid->data(), num_sensors, grid_points, grid_rate, max_lag_seconds,
+                corr_threads, pairs->data()))
+        return;
+
+    // advection velocities from the separations
+    for (int i = 0; i < num_sensors; i++)
+        for (int j = 0; j < num_sensors; j++) {
+            Cross_Corr_Pair_t* pair = &(*pairs)[i*num_sensors+j];
+            if (i == j or (int)positions.size() <= i or (int)positions.size() <= j
+                    or !(fabs(pair->lag) >= 1./grid_rate))
+                continue;
+            const Cross_Corr_Position_t* a = &positions[i];
+            const Cross_Corr_Position_t* b = &positions[j];
+            float d = sqrtf((b->x-a->x)*(b->x-a->x) + (b->y-a->y)*(b->y-a->y) + (b->z-a->z)*(b->z-a->z));
+            if (d > 0.f) // NAN if a position is unknown
+                pair->velocity = d/pair->lag;
+        }
+
+    pthread_mutex_lock(&matrix_mutex);
+    matrix.swap(*pairs);
+    matrix_info.t0 = t0;
+    matrix_info.t1 = t1;
+    matrix_info.valid = valid;
+    matrix_info.round++;
+    matrix_info.seconds = (serial_clock_ns() - start)/1e9f;
+    pthread_mutex_unlock(&matrix_mutex);
+}
+
+static void* cross_corr_loop(void* args)
+{
+    std::vector<float> grid(num_sensors*grid_points);
+    std::vector<Cross_Corr_Pair_t> pairs(num_sensors*num_sensors);
+
+    pthread_mutex_lock(&corr_mutex);
+    while (!exit_thread) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        int64_t ns = deadline.tv_nsec + (int64_t)(corr_period*1e9);
+        deadline.tv_sec += ns/1000000000LL;
+        deadline.tv_nsec = ns%1000000000LL;
+        pthread_cond_timedwait(&corr_cond, &corr_mutex, &deadline);
+        if (exit_thread)
+            break;
+        pthread_mutex_unlock(&corr_mutex);
+        cross_corr_round(&grid, &pairs);
+        pthread_mutex_lock(&corr_mutex);
+    }
+    pthread_mutex_unlock(&corr_mutex);
+    return 0;
+}
+
+bool cross_corr_set_window(double rate, int points)
+{
+    if (!(rate > 0.) or points < 64 or (points & (points-1)) != 0)
+        return false;
+    grid_rate = rate;
+    grid_points = points;
+    return true;
+}
+
+bool cross_corr_set_max_lag(double seconds)
+{
+    if (!(seconds > 0.))
+        return false;
+    max_lag_seconds = seconds;
+    return true;
+}
+
+bool cross_corr_set_period(double seconds)
+{
+    if (!(seconds == 0. or seconds >= 0.1))
+        return false;
+    period_seconds = seconds;
+    return true;
+}
+
+void cross_corr_set_threads(int n)
+{
+    num_threads = n < 0 ? 0 : n;
+}
+
+void cross_corr_set_position(int index, float x, float y, float z)
+{
+    if (index < 0)
+        return;
+    if ((int)positions.size() <= index) {
+        Cross_Corr_Position_t unknown = {NAN, NAN, NAN};
+        positions.resize(index+1, unknown);
+    }
+    Cross_Corr_Position_t position = {x, y, z};
+    positions[index] = position;
+}
+
+bool cross_corr_start(int n_sensors)
+{
+    if (running or n_sensors < 1)
+        return false;
+
+    pthread_mutex_lock(&matrix_mutex);
+    Cross_Corr_Pair_t none = {NAN, NAN, NAN};
+    matrix.assign(n_sensors*n_sensors, none);
+    memset(&matrix_info, 0, sizeof(matrix_info));
+    matrix_info.n_sensors = n_sensors;
+    pthread_mutex_unlock(&matrix_mutex);
+    num_sensors = n_sensors;
+    if (period_seconds == 0.)
+        return true; // disabled, no matrix ever published
+    corr_period = period_seconds;
+    corr_threads = num_threads;
+    if (corr_threads == 0) {
+        long cores = sysconf(_SC_NPROCESSORS_ONLN);
+        corr_threads = cores > 2 ? (int)cores-1 : 1;
+    }
+
+    exit_thread = false;
+    if (pthread_create(&corr_thread_handle, NULL, &cross_corr_loop, NULL) != 0)
+        return false;
+    running = true;
+    return true;
+}
+
+void cross_corr_stop(void)
+{
+    if (!running)
+        return;
+    pthread_mutex_lock(&corr_mutex);
+    exit_thread = true;
+    pthread_cond_signal(&corr_cond);
+    pthread_mutex_unlock(&corr_mutex);
+    pthread_join(corr_thread_handle, NULL);
+    running = false;
+}
+
+bool cross_corr_get(Cross_Corr_Info_t* info, Cross_Corr_Pair_t* pairs)
+{
+    pthread_mutex_lock(&matrix_mutex);
+    *info = matrix_info;
+    if (!matrix.empty())
+        memcpy(pairs, matrix.data(), matrix.size()*sizeof(Cross_Corr_Pair_t));
+    pthread_mutex_unlock(&matrix_mutex);
+    return info->round != 0;
+}
+
+/* End of cross_corr.cxx */
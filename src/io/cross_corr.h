@@ -0,0 +1,69 @@
+/*
+ * Cross-correlation between sensors
+ *
+ * Every few seconds a thread takes the same window of every sensor from
+ * its history, the horizontal wind speed resampled to a common grid, and
+ * correlates all pairs of sensors in the frequency domain: the windows are
+ * transformed together (see fft.h), then the cross spectra of the pairs
+ * are transformed back in batches, two pairs per signal, by worker threads
+ * sharing the pairs. For a pair i, j the lag of the correlation peak is
+ * the time gusts take from i to j, and with the sensors' positions the
+ * separation over the lag is their advection velocity.
+ *
+ * The results are published as a matrix of all pairs, row i column j for
+ * the pair i, j, so column i row j has the opposite lag.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef CROSS_CORR_H
+#define CROSS_CORR_H
+
+#include <stdint.h>
+
+#define CROSS_CORR_DEFAULT_RATE     16. // Hz, of the common grid
+#define CROSS_CORR_DEFAULT_POINTS   2048 // window, 128 s at 16 Hz
+#define CROSS_CORR_DEFAULT_MAX_LAG  10. // s
+#define CROSS_CORR_DEFAULT_PERIOD   5. // s between windows
+#define CROSS_CORR_MAX_THREADS      16
+#define CROSS_CORR_LANES            8 // signals of an inverse batch, two pairs each
+#define CROSS_CORR_MAX_SPACING      1. // s between the samples around a grid point
+#define CROSS_CORR_MIN_COVERAGE     0.9 // of the grid points, for a sensor to count
+
+typedef struct {
+    float lag; // s, x_j(t + lag) is most like x_i(t); NAN if a sensor has no window
+    float peak; // correlation coefficient at the lag
+    float velocity; // m/s, separation over lag, NAN without separation or below a grid step
+} Cross_Corr_Pair_t;
+
+typedef struct {
+    int64_t t0; // ns, CLOCK_MONOTONIC, the window
+    int64_t t1;
+    int n_sensors;
+    int valid; // sensors with a window
+    uint64_t round; // windows computed since the start, 0 before the first
+    float seconds; // taken by the last one
+} Cross_Corr_Info_t;
+
+/* cross_corr.cxx */
+/* lag and peak of all pairs of n signals of points samples, a signal
+ * starting with NAN is left out; pairs of n*n, velocity NAN */
+bool cross_corr_compute(const float* x, int n, int points, double rate, double max_lag,
+        int n_threads, Cross_Corr_Pair_t* pairs);
+/* settings of the next start; points a power of two from 64 */
+bool cross_corr_set_window(double rate, int points);
+bool cross_corr_set_max_lag(double seconds);
+bool cross_corr_set_period(double seconds); // 0 for none, no thread is started
+void cross_corr_set_threads(int n); // 0 for all cores but one
+void cross_corr_set_position(int index, float x, float y, float z); // m
+/* the correlating thread, started and stopped with the acquisition unless
+ * the period is 0 */
+bool cross_corr_start(int n_sensors);
+void cross_corr_stop(void);
+/* newest matrix, pairs of n_sensors*n_sensors; false before the first */
+bool cross_corr_get(Cross_Corr_Info_t* info, Cross_Corr_Pair_t* pairs);
+
+#endif
+
+/* End of cross_corr.h */
@@ -0,0 +1,243 @@
+/*
+ * Eddy-covariance fluxes
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <new>
+#include "io/eddy_flux.h"
+#include "io/anemometer_driver.h"
+#include "io/sample_pipeline.h"
+#include "io/spsc_ring.h" // CACHE_LINE_SIZE
+
+#define EDDY_FLUX_R_DRY_AIR 287.05 // J/(kg K)
+#define EDDY_FLUX_CP        1004.67 // J/(kg K), dry air
+
+typedef struct {
+    // newest closed block
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> seq;
+    Eddy_Flux_t latest;
+    // pipeline thread only
+    alignas(CACHE_LINE_SIZE) Eddy_Flux_Accum_t acc;
+    bool active; // 3-D sensor
+    bool open; // acc holds a block
+} Flux_Sensor_t;
+
+static double block_seconds = EDDY_FLUX_DEFAULT_BLOCK_S;
+static double pressure = EDDY_FLUX_DEFAULT_PRESSURE;
+static Eddy_Flux_Callback_t callback = NULL;
+static void* callback_arg = NULL;
+static int64_t block_width = 0; // ns, of the running stage
+static int64_t block_offset = 0; // wall clock minus CLOCK_MONOTONIC, aligns the blocks
+static Flux_Sensor_t* sensors = NULL;
+static int num_sensors = 0;
+
+void eddy_flux_clear(Eddy_Flux_Accum_t* acc, int64_t t0)
+{
+    memset(acc, 0, sizeof(*acc));
+    acc->t0 = t0;
+}
+
+/* Welford, over the upper triangle */
+void eddy_flux_add(Eddy_Flux_Accum_t* acc, const Anemometer_Data_t* sample)
+{
+    if (sample->status != 0) {
+        acc->flagged++;
+        return;
+    }
+    double x[EDDY_FLUX_VARS] = {sample->speed[0], sample->speed[1], sample->speed[2],
+        sample->temperature, (sample->t - acc->t0)/1e9};
+    double d[EDDY_FLUX_VARS], e[EDDY_FLUX_VARS];
+    acc->count++;
+    for (int i = 0; i < EDDY_FLUX_VARS; i++) {
+        d[i] = x[i] - acc->mean[i];
+        acc->mean[i] += d[i]/acc->count;
+        e[i] = x[i] - acc->mean[i];
+    }
+    for (int i = 0; i < EDDY_FLUX_VARS; i++)
+        for (int j = i; j < EDDY_FLUX_VARS; j++)
+            acc->m2[i][j] += d[i]*e[j];
+}
+
+bool eddy_flux_compute(const Eddy_Flux_Accum_t* acc, double pressure, Eddy_Flux_t* flux)
+{
+    if (acc->count < 3)
+        return false;
+
+    // covariances, u, v, w & T detrended: less what both share with time
+    double c[EDDY_FLUX_VARS][EDDY_FLUX_VARS];
+    for (int i = 0; i < EDDY_FLUX_VARS; i++)
+        for (int j = i; j < EDDY_FLUX_VARS; j++)
+            c[i][j] = c[j][i] = acc->m2[i][j]/acc->count;
+    const int t = EDDY_FLUX_VARS-1;
+    double d[4][4];
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            d[i][j] = c[t][t] > 0. ? c[i][j] - c[i][t]*c[j][t]/c[t][t] : c[i][j];
+
+    // double rotation, yaw into the mean wind, then pitch to no mean w
+    const double* m = acc->mean;
+    double yaw = atan2(m[1], m[0]);
+    double c1 = cos(yaw), s1 = sin(yaw);
+    double pitch = atan2(m[2], c1*m[0] + s1*m[1]);
+    double c2 = cos(pitch), s2 = sin(pitch);
+    const double r[3][3] = {
+        {c2*c1, c2*s1, s2},
+        {-s1, c1, 0.},
+        {-s2*c1, -s2*s1, c2}};
+    double rd[3][4]; // r times d, the T column is the rotated w'T' & co.
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 4; j++)
+            rd[i][j] = r[i][0]*d[0][j] + r[i][1]*d[1][j] + r[i][2]*d[2][j];
+    double s[3][3]; // rotated covariance of the wind
+    for (int i = 0; i < 3; i++)
+        for (int j = 0; j < 3; j++)
+            s[i][j] = rd[i][0]*r[j][0] + rd[i][1]*r[j][1] + rd[i][2]*r[j][2];
+
+    flux->t = acc->t0;
+    flux->width = 0;
+    flux->count = acc->count;
+    flux->flagged = acc->flagged;
+    flux->speed = r[0][0]*m[0] + r[0][1]*m[1] + r[0][2]*m[2];
+    flux->direction = atan2(-m[0], -m[1])*180./M_PI;
+    if (flux->direction < 0.)
+        flux->direction += 360.;
+    flux->yaw = yaw*180./M_PI;
+    flux->pitch = pitch*180./M_PI;
+    flux->T = m[3];
+    for (int i = 0; i < 3; i++)
+        flux->sigma[i] = sqrt(s[i][i] > 0. ? s[i][i] : 0.);
+    flux->sigma[3] = sqrt(d[3][3] > 0. ? d[3][3] : 0.);
+    flux->uw = s[0][2];
+    flux->vw = s[1][2];
+    flux->wT = rd[2][3];
+    flux->u_star = pow(flux->uw*flux->uw + flux->vw*flux->vw, 0.25);
+    double rho = pressure/(EDDY_FLUX_R_DRY_AIR*(m[3] + 273.15));
+    flux->tau = -rho*flux->uw;
+    flux->H = rho*EDDY_FLUX_CP*flux->wT;
+
+    return true;
+}
+
+static int64_t eddy_flux_block_start(int64_t t)
+{
+    int64_t r = (t + block_offset) % block_width;
+    return t - (r < 0 ? r + block_width : r);
+}
+
+static void eddy_flux_close(int index, Flux_Sensor_t* sensor)
+{
+    Eddy_Flux_t flux;
+    if (!eddy_flux_compute(&sensor->acc, pressure, &flux))
+        return;
+    flux.width = block_width;
+
+    // odd sequence while writing
+    unsigned int seq = sensor->seq.load(std::memory_order_relaxed);
+    sensor->seq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    sensor->latest = flux;
+    sensor->seq.store(seq+2, std::memory_order_release);
+
+    if (callback)
+        callback(index, &flux, callback_arg);
+}
+
+/* pipeline stage */
+static void eddy_flux_stage(int index, Anemometer_Data_t* samples, int n, void* arg)
+{
+    if (index < 0 or index >= num_sensors or !sensors[index].active)
+        return;
+    Flux_Sensor_t* sensor = &sensors[index];
+
+    for (int i = 0; i < n; i++) {
+        if (!sensor->open or samples[i].t >= sensor->acc.t0 + block_width) {
+            if (sensor->open)
+                eddy_flux_close(index, sensor);
+            eddy_flux_clear(&sensor->acc, eddy_flux_block_start(samples[i].t));
+            sensor->open = true;
+        }
+        eddy_flux_add(&sensor->acc, &samples[i]);
+    }
+}
+
+bool eddy_flux_set_block(double seconds)
+{
+    if (!(seconds >= 1.))
+        return false;
+    block_seconds = seconds;
+    return true;
+}
+
+double eddy_flux_get_block(void)
+{
+    return block_seconds;
+}
+
+void eddy_flux_set_pressure(double pa)
+{
+    pressure = pa;
+}
+
+void eddy_flux_set_callback(Eddy_Flux_Callback_t func, void* arg)
+{
+    callback = func;
+    callback_arg = arg;
+}
+
+bool eddy_flux_start(int n_sensors)
+{
+    static bool stage_added = false;
+    if (n_sensors < 1)
+        return false;
+
+    free(sensors);
+    sensors = NULL;
+    num_sensors = 0;
+    // operator new does not honour the cache line alignment before C++17
+    void* block;
+    if (posix_memalign(&block, CACHE_LINE_SIZE, n_sensors*sizeof(Flux_Sensor_t)) != 0)
+        return false;
+    sensors = (Flux_Sensor_t*)block;
+    for (int i = 0; i < n_sensors; i++) {
+        Flux_Sensor_t* sensor = new (&sensors[i]) Flux_Sensor_t();
+        sensor->seq.store(0);
+        memset(&sensor->latest, 0, sizeof(sensor->latest));
+        const char* type = sonic_anemometer_get_type(i);
+        const Anemometer_Driver_t* driver = type ? anemometer_driver_find(type) : NULL;
+        sensor->active = driver and driver->axes == 3;
+        sensor->open = false;
+    }
+    block_width = (int64_t)(block_seconds*1e9);
+    const Anemometer_Time_Anchor_t* anchor = sonic_anemometer_get_time_anchor();
+    block_offset = anchor->realtime - anchor->monotonic;
+    num_sensors = n_sensors;
+
+    if (!stage_added)
+        stage_added = sample_pipeline_add_stage(&eddy_flux_stage, NULL);
+    return stage_added;
+}
+
+bool eddy_flux_get_latest(int index, Eddy_Flux_t* flux)
+{
+    if (index < 0 or index >= num_sensors)
+        return false;
+    Flux_Sensor_t* sensor = &sensors[index];
+
+    unsigned int seq0, seq1;
+    do {
+        seq0 = sensor->seq.load(std::memory_order_acquire);
+        *flux = sensor->latest;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq1 = sensor->seq.load(std::memory_order_relaxed);
+    } while ((seq0 & 1) or seq0 != seq1);
+
+    return seq0 != 0; // false if no block closed yet
+}
+
+/* End of eddy_flux.cxx */
@@ -0,0 +1,91 @@
+/*
+ * Eddy-covariance fluxes
+ *
+ * Momentum and sensible heat fluxes of the 3-D sonic anemometers (driver
+ * axes 3: Gill WindMaster, RM Young 81000) over averaging blocks, 30 min
+ * unless set otherwise, aligned to wall clock. Per block:
+ *
+ *   - every variable is detrended linearly over the block,
+ *   - the wind is double rotated, yaw into the mean wind, then pitch so
+ *     the mean w is zero,
+ *   - u'w', v'w' and w'T' are taken in the rotated frame, giving the
+ *     friction velocity, the momentum flux and the sensible heat flux.
+ *
+ * All of it follows from the means and the covariance matrix of u, v, w,
+ * T and time, which are accumulated as the samples come (Welford), so
+ * nothing of the block is stored and its fluxes are known as soon as it
+ * closes: linear detrending takes out of a covariance what both variables
+ * share with time, the rotation turns the detrended matrix. The heat flux
+ * is from sonic temperature, close to the buoyancy flux; air density from
+ * it and a set air pressure. Samples with a non-zero status are left out.
+ *
+ * As a pipeline stage, blocks close when the first sample past them
+ * arrives; the newest result of every sensor is kept behind a sequence
+ * lock for the GUI, and handed to a callback on the pipeline thread, which
+ * the recorder takes while recording (see record.h). The accumulator is
+ * usable on its own too, e.g. on recorded sessions.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef EDDY_FLUX_H
+#define EDDY_FLUX_H
+
+#include <stdint.h>
+#include "io/serial_anemometers.h"
+
+#define EDDY_FLUX_DEFAULT_BLOCK_S   1800. // averaging interval
+#define EDDY_FLUX_DEFAULT_PRESSURE  101325. // Pa
+#define EDDY_FLUX_VARS              5 // u, v, w, T, time
+
+/* running means and covariances of a block */
+typedef struct {
+    uint64_t count;
+    uint64_t flagged;
+    int64_t t0; // ns, times are taken in s from it
+    double mean[EDDY_FLUX_VARS];
+    double m2[EDDY_FLUX_VARS][EDDY_FLUX_VARS]; // sums of products of deviations, upper triangle
+} Eddy_Flux_Accum_t;
+
+/* fluxes of a block */
+typedef struct {
+    int64_t t; // start of the block, ns, CLOCK_MONOTONIC
+    int64_t width; // ns
+    uint64_t count; // samples with status 0
+    uint64_t flagged;
+    double speed; // m/s, mean wind, after rotation
+    double direction; // deg, the mean wind blows from, clockwise from north
+    double yaw, pitch; // deg, double rotation angles
+    double T; // degC, mean sonic temperature
+    double sigma[4]; // standard deviations of u, v, w (rotated) and T, detrended
+    double uw, vw; // m^2/s^2, covariances in the rotated frame, detrended
+    double wT; // K m/s
+    double u_star; // m/s, friction velocity, (uw^2 + vw^2)^(1/4)
+    double tau; // N/m^2, momentum flux, -rho uw
+    double H; // W/m^2, sensible heat flux, rho cp wT
+} Eddy_Flux_t;
+
+/* called on the pipeline thread as a block of a sensor closes */
+typedef void (*Eddy_Flux_Callback_t)(int index, const Eddy_Flux_t* flux, void* arg);
+
+/* eddy_flux.cxx */
+void eddy_flux_clear(Eddy_Flux_Accum_t* acc, int64_t t0);
+void eddy_flux_add(Eddy_Flux_Accum_t* acc, const Anemometer_Data_t* sample);
+/* false if the block has fewer than 3 samples */
+bool eddy_flux_compute(const Eddy_Flux_Accum_t* acc, double pressure, Eddy_Flux_t* flux);
+
+/* block length and air pressure of the next start */
+bool eddy_flux_set_block(double seconds);
+double eddy_flux_get_block(void);
+void eddy_flux_set_pressure(double pa);
+void eddy_flux_set_callback(Eddy_Flux_Callback_t, void* arg);
+/* clears the blocks and puts the stage in the pipeline, for the sensors
+ * of the registry measuring w and T; called by the acquisition */
+bool eddy_flux_start(int n_sensors);
+/* newest closed block of a sensor, false if none yet or not a 3-D sensor */
+bool eddy_flux_get_latest(int index, Eddy_Flux_t* flux);
+
+#endif
+
+/* End of eddy_flux.h */
@@ -0,0 +1,133 @@
+/*
+ * Fast Fourier transforms
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <string.h>
+#include <math.h>
+#include "io/fft.h"
+
+static bool fft_power_of_two(int n)
+{
+    return n >= 1 and (n & (n-1)) == 0;
+}
+
+bool fft_plan(Fft_Plan_t* plan, int n)
+{
+    if (n < 2 or !fft_power_of_two(n))
+        return false;
+    plan->n = n;
+    plan->swap.clear();
+    int bits = 0;
+    while ((1 << bits) < n)
+        bits++;
+    for (int i = 0; i < n; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++)
+            r |= ((i >> b) & 1) << (bits-1-b);
+        if (i < r) {
+            plan->swap.push_back(i);
+            plan->swap.push_back(r);
+        }
+    }
+    plan->wr.resize(n/2);
+    plan->wi.resize(n/2);
+    for (int k = 0; k < n/2; k++) {
+        plan->wr[k] = (float)cos(2.*M_PI*k/n);
+        plan->wi[k] = (float)-sin(2.*M_PI*k/n);
+    }
+    return true;
+}
+
+bool fft_real_plan(Fft_Real_Plan_t* plan, int n)
+{
+    if (n < 4 or !fft_power_of_two(n) or !fft_plan(&plan->half, n/2))
+        return false;
+    plan->n = n;
+    plan->wr.resize(n/2+1);
+    plan->wi.resize(n/2+1);
+    for (int k = 0; k <= n/2; k++) {
+        plan->wr[k] = (float)cos(2.*M_PI*k/n);
+        plan->wi[k] = (float)-sin(2.*M_PI*k/n);
+    }
+    return true;
+}
+
+void fft_batch(const Fft_Plan_t* plan, float* re, float* im, int lanes, bool inverse)
+{
+    const int n = plan->n;
+    // bit reversed order, whole rows
+    for (size_t p = 0; p < plan->swap.size(); p += 2) {
+        float* ra = re + plan->swap[p]*lanes;
+        float* rb = re + plan->swap[p+1]*lanes;
+        float* ia = im + plan->swap[p]*lanes;
+        float* ib = im + plan->swap[p+1]*lanes;
+        for (int s = 0; s < lanes; s++) {
+            float t = ra[s]; ra[s] = rb[s]; rb[s] = t;
+            t = ia[s]; ia[s] = ib[s]; ib[s] = t;
+        }
+    }
+    const float sign = inverse ? -1.f : 1.f;
+    for (int len = 2; len <= n; len <<= 1) {
+        const int half = len >> 1, step = n/len;
+        for (int i = 0; i < n; i += len)
+            for (int j = 0; j < half; j++) {
+                const float wr = plan->wr[j*step], wi = sign*plan->wi[j*step];
+                float* __restrict__ ar = re + (i+j)*lanes;
+                float* __restrict__ ai = im + (i+j)*lanes;
+                float* __restrict__ br = re + (i+j+half)*lanes;
+                float* __restrict__ bi = im + (i+j+half)*lanes;
+                for (int s = 0; s < lanes; s++) {
+                    float tr = br[s]*wr - bi[s]*wi;
+                    float ti = br[s]*wi + bi[s]*wr;
+                    br[s] = ar[s] - tr;
+                    bi[s] = ai[s] - ti;
+                    ar[s] += tr;
+                    ai[s] += ti;
+                }
+            }
+    }
+}
+
+void fft_real_batch(const Fft_Real_Plan_t* plan, const float* x, float* re, float* im, int lanes)
+{
+    const int m = plan->n/2;
+    // even points real, odd imaginary
+    for (int k = 0; k < m; k++) {
+        memcpy(re + k*lanes, x + 2*k*lanes, lanes*sizeof(float));
+        memcpy(im + k*lanes, x + (2*k+1)*lanes, lanes*sizeof(float));
+    }
+    fft_batch(&plan->half, re, im, lanes);
+
+    // split Z into the spectra of the even and odd points, bins k and m-k at once
+    for (int s = 0; s < lanes; s++) {
+        float r0 = re[s], i0 = im[s];
+        re[s] = r0 + i0;
+        im[s] = 0.f;
+        re[m*lanes + s] = r0 - i0;
+        im[m*lanes + s] = 0.f;
+    }
+    for (int k = 1; k <= m/2; k++) {
+        const int j = m - k;
+        const float wr = plan->wr[k], wi = plan->wi[k];
+        float* __restrict__ kr = re + k*lanes;
+        float* __restrict__ ki = im + k*lanes;
+        float* __restrict__ jr = re + j*lanes;
+        float* __restrict__ ji = im + j*lanes;
+        for (int s = 0; s < lanes; s++) {
+            // E = (Z[k] + conj Z[j])/2, O = -i (Z[k] - conj Z[j])/2
+            float er = 0.5f*(kr[s] + jr[s]), ei = 0.5f*(ki[s] - ji[s]);
+            float orr = 0.5f*(ki[s] + ji[s]), oi = -0.5f*(kr[s] - jr[s]);
+            // X[k] = E + W^k O, X[j] = conj(E) - conj(W^k) conj(O)
+            float xr = er + wr*orr - wi*oi, xi = ei + wr*oi + wi*orr;
+            jr[s] = er - wr*orr + wi*oi;
+            ji[s] = -ei + wr*oi + wi*orr;
+            kr[s] = xr;
+            ki[s] = xi;
+        }
+    }
+}
+
+/* End of fft.cxx */
@@ -0,0 +1,42 @@
+/*
+ * Fast Fourier transforms
+ *
+ * Iterative radix-2 transforms of power-of-two lengths, over a batch of
+ * signals at once: the signals are interleaved, element k of signal s at
+ * [k*lanes + s], so every butterfly runs over all the signals in one
+ * contiguous inner loop the compiler vectorises, and a batch of 16 signals
+ * of 1024 points stays within L2. Real signals of n points are transformed
+ * as complex ones of n/2 points, then split.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+
+typedef struct {
+    int n; // points, complex
+    std::vector<int> swap; // bit reversal, pairs of rows to swap
+    std::vector<float> wr, wi; // twiddles, exp(-2 pi i k/n) for k < n/2
+} Fft_Plan_t;
+
+typedef struct {
+    int n; // points, real
+    Fft_Plan_t half; // of n/2 points
+    std::vector<float> wr, wi; // exp(-2 pi i k/n) for k <= n/2, the split
+} Fft_Real_Plan_t;
+
+/* n a power of two, at least 2 (4 for real ones) */
+bool fft_plan(Fft_Plan_t* plan, int n);
+bool fft_real_plan(Fft_Real_Plan_t* plan, int n);
+/* in place, re & im of n*lanes; the inverse is not scaled by 1/n */
+void fft_batch(const Fft_Plan_t* plan, float* re, float* im, int lanes, bool inverse = false);
+/* x of n*lanes to bins 0 to n/2, re & im of (n/2+1)*lanes */
+void fft_real_batch(const Fft_Real_Plan_t* plan, const float* x, float* re, float* im, int lanes);
+
+#endif
+
+/* End of fft.h */
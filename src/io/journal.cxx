@@ -0,0 +1,343 @@
+/*
+ * Sample journal
+ *
+ * The address space for the whole journal is reserved once, the file is
+ * mapped into it extent by extent, so the mapping never moves and the
+ * pipeline thread appends without locks. The commit thread allocates the
+ * next extent before the writer gets there, the writer only does it
+ * itself if the commit thread fell behind.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <string>
+#include "io/journal.h"
+#include "io/sample_pipeline.h"
+
+static int fd = -1;
+static std::string file_name;
+static char* base = NULL; // JOURNAL_MAX_SIZE reserved
+static uint32_t header_size = 0;
+static int num_sensors = 0;
+static bool header_done = false; // anchor & sensors filled in, pipeline thread only
+static std::atomic<uint64_t> written(0); // records, stored by the pipeline thread
+static std::atomic<size_t> mapped(0); // bytes of file mapped
+static std::atomic<unsigned long> dropped(0);
+static pthread_mutex_t extend_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_mutex_t journal_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t journal_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t commit_thread_handle;
+static bool exit_thread = false;
+static bool journaling = false;
+
+static inline Journal_File_Header_t* journal_header(void)
+{
+    return (Journal_File_Header_t*)base;
+}
+
+/* allocate and map the file up to at least end bytes */
+static bool journal_extend(size_t end)
+{
+    bool ok = true;
+    pthread_mutex_lock(&extend_mutex);
+    size_t m = mapped.load(std::memory_order_relaxed);
+    while (m < end) {
+        if (m + JOURNAL_EXTENT_SIZE > JOURNAL_MAX_SIZE
+                or posix_fallocate(fd, m, JOURNAL_EXTENT_SIZE) != 0
+                or mmap(base + m, JOURNAL_EXTENT_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_FIXED, fd, m) == MAP_FAILED) {
+            ok = false;
+            break;
+        }
+        m += JOURNAL_EXTENT_SIZE;
+        mapped.store(m, std::memory_order_release);
+    }
+    pthread_mutex_unlock(&extend_mutex);
+    return ok;
+}
+
+/* make records [from, to) and then the header durable */
+static void journal_commit(uint64_t from, uint64_t to, bool extended)
+{
+    if (to > from) {
+        size_t start = (header_size + from*sizeof(Journal_Record_t)) & ~(size_t)(JOURNAL_PAGE_SIZE-1);
+        size_t end = header_size + to*sizeof(Journal_Record_t);
+        if (msync(base + start, end - start, MS_SYNC) < 0)
+            perror(file_name.c_str());
+    }
+    if (extended) // file size changed
+        fdatasync(fd);
+    journal_header()->committed = to;
+    msync(base, JOURNAL_PAGE_SIZE, MS_SYNC);
+}
+
+static void* journal_commit_loop(void* args)
+{
+    uint64_t committed = 0;
+    size_t synced_size = mapped.load();
+
+    pthread_mutex_lock(&journal_mutex);
+    while (!exit_thread) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += JOURNAL_COMMIT_PERIOD_MS*1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&journal_cond, &journal_mutex, &deadline);
+        pthread_mutex_unlock(&journal_mutex);
+
+        // keep half an extent ahead of the writer
+        uint64_t n = written.load(std::memory_order_acquire);
+        size_t end = header_size + n*sizeof(Journal_Record_t);
+        if (end + JOURNAL_EXTENT_SIZE/2 > mapped.load(std::memory_order_relaxed))
+            journal_extend(end + JOURNAL_EXTENT_SIZE/2);
+        size_t size = mapped.load(std::memory_order_relaxed);
+        if (n > committed or size != synced_size) {
+            journal_commit(committed, n, size != synced_size);
+            committed = n;
+            synced_size = size;
+        }
+
+        pthread_mutex_lock(&journal_mutex);
+    }
+    pthread_mutex_unlock(&journal_mutex);
+
+    // pipeline stopped, the rest
+    journal_commit(committed, written.load(std::memory_order_acquire), false);
+    return 0;
+}
+
+/* samples only flow once acquisition started, so the anchor is this session's */
+static void journal_write_session(void)
+{
+    Journal_File_Header_t* fh = journal_header();
+    const Anemometer_Time_Anchor_t* anchor = sonic_anemometer_get_time_anchor();
+    fh->time_anchor_realtime = anchor->realtime;
+    fh->time_anchor_monotonic = anchor->monotonic;
+    Capture_Sensor_Info_t* info = (Capture_Sensor_Info_t*)(base + sizeof(Journal_File_Header_t));
+    for (int i = 0; i < num_sensors and i < sonic_anemometer_get_num(); i++) {
+        const char* type = sonic_anemometer_get_type(i);
+        const char* port = sonic_anemometer_get_port_path(i);
+        strncpy(info[i].type, type ? type : "", sizeof(info[i].type)-1);
+        strncpy(info[i].port, port ? port : "", sizeof(info[i].port)-1);
+    }
+    header_done = true;
+}
+
+/* pipeline stage, first of all, a memcpy per sample */
+static void journal_stage(int index, Anemometer_Data_t* samples, int n, void* arg)
+{
+    if (index < 0 or index >= num_sensors)
+        return;
+    if (!header_done)
+        journal_write_session();
+
+    uint64_t w = written.load(std::memory_order_relaxed);
+    size_t end = header_size + (w + n)*sizeof(Journal_Record_t);
+    if (end > mapped.load(std::memory_order_acquire) and !journal_extend(end)) {
+        dropped.fetch_add(n, std::memory_order_relaxed);
+        return;
+    }
+
+    Journal_Record_t* dst = (Journal_Record_t*)(base + header_size) + w;
+    Journal_Record_t rec;
+    rec.index = index;
+    for (int i = 0; i < n; i++) {
+        rec.t = samples[i].t;
+        rec.speed[0] = samples[i].speed[0];
+        rec.speed[1] = samples[i].speed[1];
+        rec.speed[2] = samples[i].speed[2];
+        rec.temperature = samples[i].temperature;
+        rec.status = samples[i].status;
+        rec.latency = samples[i].latency;
+        rec.check = journal_record_check(&rec);
+        memcpy(dst + i, &rec, sizeof(rec));
+    }
+    written.store(w + n, std::memory_order_release);
+}
+
+static void journal_release(void)
+{
+    if (base)
+        munmap(base, JOURNAL_MAX_SIZE);
+    base = NULL;
+    if (fd >= 0)
+        close(fd);
+    fd = -1;
+}
+
+static void journal_stop_commit_thread(void)
+{
+    pthread_mutex_lock(&journal_mutex);
+    exit_thread = true;
+    pthread_cond_signal(&journal_cond);
+    pthread_mutex_unlock(&journal_mutex);
+    pthread_join(commit_thread_handle, NULL);
+}
+
+bool WR_Journal_start(const char* name, int n_sensors)
+{
+    if (journaling or name == NULL or n_sensors < 1)
+        return false;
+
+    file_name = name;
+    fd = open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        perror(name);
+        return false;
+    }
+    // address space only, the file is mapped into it as it grows
+    void* addr = mmap(NULL, JOURNAL_MAX_SIZE, PROT_NONE,
+            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (addr == MAP_FAILED) {
+        perror("mmap");
+        journal_release();
+        return false;
+    }
+    base = (char*)addr;
+    mapped.store(0);
+    written.store(0);
+    dropped.store(0);
+    num_sensors = n_sensors;
+    header_done = false;
+    header_size = (sizeof(Journal_File_Header_t) + n_sensors*sizeof(Capture_Sensor_Info_t)
+            + JOURNAL_PAGE_SIZE-1) & ~(JOURNAL_PAGE_SIZE-1);
+    if (!journal_extend(header_size)) {
+        fprintf(stderr, "ERROR: could not allocate %s\n", name);
+        journal_release();
+        ::remove(name);
+        return false;
+    }
+
+    // the mapping is zero filled already
+    Journal_File_Header_t* fh = journal_header();
+    memcpy(fh->magic, JOURNAL_MAGIC, sizeof(fh->magic));
+    fh->version = JOURNAL_VERSION;
+    fh->header_size = header_size;
+    fh->n_sensors = n_sensors;
+    fh->record_size = sizeof(Journal_Record_t);
+    journal_commit(0, 0, true);
+
+    exit_thread = false;
+    if (pthread_create(&commit_thread_handle, NULL, &journal_commit_loop, NULL) != 0) {
+        journal_release();
+        ::remove(name);
+        return false;
+    }
+    // before any other consumer of the samples
+    if (!sample_pipeline_add_stage(&journal_stage, NULL, SAMPLE_STAGE_JOURNAL)) {
+        journal_stop_commit_thread();
+        journal_release();
+        ::remove(name);
+        return false;
+    }
+    journaling = true;
+
+    return true;
+}
+
+/* call after acquisition stopped, so the last samples are journaled */
+void WR_Journal_stop(void)
+{
+    if (!journaling)
+        return;
+
+    sample_pipeline_remove_stage(&journal_stage, NULL);
+    journal_stop_commit_thread();
+
+    // drop the allocated but unused tail
+    if (ftruncate(fd, header_size + written.load()*sizeof(Journal_Record_t)) < 0
+            or fdatasync(fd) < 0)
+        perror(file_name.c_str());
+    if (dropped.load())
+        fprintf(stderr, "%lu samples not journaled, disk full.\n", dropped.load());
+    journal_release();
+    journaling = false;
+}
+
+bool WR_Journal_is_journaling(void)
+{
+    return journaling;
+}
+
+uint64_t WR_Journal_get_num_records(void)
+{
+    return written.load(std::memory_order_relaxed);
+}
+
+unsigned long WR_Journal_get_dropped(void)
+{
+    return dropped.load(std::memory_order_relaxed);
+}
+
+bool WR_Journal_open(const char* name, Journal_Reader_t* reader)
+{
+    memset(reader, 0, sizeof(*reader));
+    int jfd = open(name, O_RDONLY);
+    if (jfd < 0) {
+        perror(name);
+        return false;
+    }
+    struct stat st;
+    if (fstat(jfd, &st) < 0 or st.st_size < (off_t)sizeof(Journal_File_Header_t)) {
+        fprintf(stderr, "ERROR: %s is not a journal\n", name);
+        close(jfd);
+        return false;
+    }
+    void* addr = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, jfd, 0);
+    close(jfd);
+    if (addr == MAP_FAILED) {
+        perror(name);
+        return false;
+    }
+    madvise(addr, st.st_size, MADV_SEQUENTIAL);
+    reader->map_size = st.st_size;
+    const char* map = (const char*)addr;
+    reader->header = (const Journal_File_Header_t*)map;
+
+    const Journal_File_Header_t* fh = reader->header;
+    if (memcmp(fh->magic, JOURNAL_MAGIC, sizeof(fh->magic)) != 0
+            or fh->version != JOURNAL_VERSION or fh->n_sensors < 1
+            or fh->record_size != sizeof(Journal_Record_t)
+            or fh->header_size > reader->map_size
+            or fh->header_size < sizeof(Journal_File_Header_t) + fh->n_sensors*sizeof(Capture_Sensor_Info_t)) {
+        fprintf(stderr, "ERROR: %s is not a journal\n", name);
+        WR_Journal_close(reader);
+        return false;
+    }
+    reader->sensors = (const Capture_Sensor_Info_t*)(map + sizeof(Journal_File_Header_t));
+    reader->records = (const Journal_Record_t*)(map + fh->header_size);
+
+    // committed records, then whatever made it to disk after the last commit
+    uint64_t available = (reader->map_size - fh->header_size)/sizeof(Journal_Record_t);
+    uint64_t n = fh->committed < available ? fh->committed : available;
+    while (n < available and reader->records[n].check == journal_record_check(&reader->records[n])
+            and reader->records[n].index < fh->n_sensors)
+        n++;
+    reader->num_records = n;
+
+    return true;
+}
+
+void WR_Journal_close(Journal_Reader_t* reader)
+{
+    if (reader->header)
+        munmap((void*)reader->header, reader->map_size);
+    memset(reader, 0, sizeof(*reader));
+}
+
+/* End of journal.cxx */
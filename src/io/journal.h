@@ -0,0 +1,92 @@
+/*
+ * Sample journal
+ *
+ * Crash-safe, append-only log of every anemometer sample, written before
+ * any other consumer sees the samples (it is the first stage of the sample
+ * pipeline). An HDF5 file left open by a crash or a power cut is often
+ * unreadable, the journal is not: it is a memory-mapped file of fixed-size
+ * records, appending a sample is a memcpy into the mapping and a commit
+ * thread makes the records durable in groups with msync()/fdatasync().
+ *
+ * The file is allocated (not just sized) in JOURNAL_EXTENT_SIZE steps
+ * ahead of the writer, so a full disk shows up as dropped samples rather
+ * than SIGBUS on a store into the mapping.
+ *
+ * File layout, little endian:
+ *   Journal_File_Header_t, then n_sensors Capture_Sensor_Info_t, padded
+ *   with zeros to header_size bytes (a multiple of JOURNAL_PAGE_SIZE);
+ *   then Journal_Record_t records. The first `committed` records are
+ *   durable; a record after them is valid if its check matches, the file
+ *   is zero filled beyond the last record written.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include "io/serial_anemometers.h"
+#include "io/capture.h" // Capture_Sensor_Info_t
+
+#define JOURNAL_MAGIC               "WRJNL\0\0\0"
+#define JOURNAL_VERSION             1
+#define JOURNAL_PAGE_SIZE           4096
+#define JOURNAL_EXTENT_SIZE         (64UL*1024*1024) // file grows by this much, multiple of JOURNAL_PAGE_SIZE
+#define JOURNAL_MAX_SIZE            (1ULL<<40) // address space reserved for the mapping
+#define JOURNAL_COMMIT_PERIOD_MS    200 // group commit interval, at most this much lost on power cut
+
+typedef struct {
+    char magic[8]; // JOURNAL_MAGIC
+    uint32_t version;
+    uint32_t header_size; // bytes before the first record
+    uint32_t n_sensors;
+    uint32_t record_size; // sizeof(Journal_Record_t)
+    int64_t time_anchor_realtime; // ns, see Anemometer_Time_Anchor_t, 0 until the first sample
+    int64_t time_anchor_monotonic;
+    uint64_t committed; // records known to be on disk
+} Journal_File_Header_t;
+
+typedef struct {
+    int64_t t; // ns, CLOCK_MONOTONIC, as Anemometer_Data_t
+    float speed[3];
+    float temperature;
+    int32_t status;
+    int32_t latency;
+    uint32_t index; // sensor
+    uint32_t check; // journal_record_check() of the fields above
+} Journal_Record_t;
+
+/* tells a written record from zeros or a torn write */
+static inline uint32_t journal_record_check(const Journal_Record_t* rec)
+{
+    const uint32_t* w = (const uint32_t*)rec;
+    uint32_t h = 2166136261u; // FNV-1a over words
+    for (unsigned i = 0; i < offsetof(Journal_Record_t, check)/4; i++)
+        h = (h ^ w[i]) * 16777619u;
+    return h;
+}
+
+/* journal.cxx, started and stopped by the recorder */
+bool WR_Journal_start(const char* file_name, int n_sensors);
+void WR_Journal_stop(void);
+bool WR_Journal_is_journaling(void);
+uint64_t WR_Journal_get_num_records(void);
+unsigned long WR_Journal_get_dropped(void); // samples not journaled, disk full
+
+/* reading, for conversion and recovery; num_records counts the committed
+ * records plus the valid ones written after the last commit */
+typedef struct {
+    const Journal_File_Header_t* header;
+    const Capture_Sensor_Info_t* sensors;
+    const Journal_Record_t* records;
+    uint64_t num_records;
+    size_t map_size;
+} Journal_Reader_t;
+bool WR_Journal_open(const char* file_name, Journal_Reader_t*);
+void WR_Journal_close(Journal_Reader_t*);
+
+#endif
+
+/* End of journal.h */
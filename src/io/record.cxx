@@ -0,0 +1,1172 @@
+/*
+ * Data Recording
+ *
+ * The recorder hooks into the sample pipeline as a stage, which only copies
+ * the drained batches into per-sensor pending buffers. A writer thread swaps
+ * those buffers out and appends them to the HDF5 datasets, so neither the
+ * serial readers nor the pipeline ever wait on the disk, and the buffers
+ * keep their capacity from one batch to the next.
+ *
+ * Segments are rolled over by the writer thread between two writes, so no
+ * sample is lost or written twice. A time based rollover cuts the batch of
+ * every sensor at the segment boundary, one based on size happens after
+ * the write which crossed it.
+ *
+ * Summaries are built by the writer thread too, from the samples it
+ * writes: every sample goes into the open 1 s bin of its sensor, a closed
+ * bin is merged into the open bin of the next resolution, so a sample is
+ * only looked at once. Closed bins are written after every batch.
+ *
+ * The session's metadata goes to the root of every file as it is created,
+ * the sensors' type, port and baud rate to their groups with the time
+ * anchor, once samples flow and the acquisition knows them. Stopping adds
+ * the session to the session index next to it (see session_index.h).
+ *
+ * Spectra come from the spectral stage's callback on the pipeline thread
+ * (see sample_psd.h), are queued like the samples and appended by the
+ * writer thread to the file being written, whose datasets for them are
+ * created with its first spectrum, sized by the first of the session.
+ * Fluxes of the eddy-covariance stage (see eddy_flux.h) take the same way.
+ *
+ * Author: Roice (LUO Bing)
+ * Date: 2017-04-16 create this file
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h> // fsync()
+#include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string>
+#include <vector>
+#include <hdf5.h>
+#include "io/record.h"
+#include "io/serial_anemometers.h"
+#include "io/sample_pipeline.h"
+#include "io/journal.h"
+#include "io/anemometer_driver.h"
+#include "io/session_index.h"
+#include "io/sample_psd.h"
+#include "io/eddy_flux.h"
+
+#ifndef WR_BUILD_ID // set by CMake from git describe
+#define WR_BUILD_ID "unknown"
+#endif
+
+static const char* record_field_names[RECORD_NUM_FIELDS] = {"time", "u", "v", "w", "T", "status", "latency"};
+static const char* record_field_units[RECORD_NUM_FIELDS] = {"ns, CLOCK_MONOTONIC", "m/s", "m/s", "m/s", "degC", "", "ns"};
+static Record_Filter_Chain_t record_field_filters[RECORD_NUM_FIELDS]; // none
+static const char* record_summary_names[RECORD_NUM_SUMMARIES] = {"summary_1s", "summary_10s", "summary_1min", "summary_10min"};
+static const int64_t record_summary_widths[RECORD_NUM_SUMMARIES] = {1000000000LL, 10000000000LL, 60000000000LL, 600000000000LL};
+#define RECORD_NO_BIN   INT64_MIN
+
+typedef struct {
+    hid_t group;
+    hid_t dset[RECORD_NUM_FIELDS];
+    hid_t index; // time_index
+    hid_t summary[RECORD_NUM_SUMMARIES];
+    hsize_t count; // samples written to the current file
+    hsize_t summary_count[RECORD_NUM_SUMMARIES]; // bins written to the current file
+    Record_Stats_t bin[RECORD_NUM_SUMMARIES]; // open bins
+    int64_t bin_t[RECORD_NUM_SUMMARIES]; // their start, RECORD_NO_BIN if none
+    std::vector<Record_Summary_t> closed[RECORD_NUM_SUMMARIES]; // not written yet
+    std::vector<Anemometer_Data_t> pending; // filled by the pipeline stage
+    std::vector<Anemometer_Data_t> writing; // owned by the writer thread
+    size_t written; // of writing, by the writer thread
+    unsigned long dropped; // samples lost because the writer fell behind
+    unsigned long failed; // samples, bins and spectra lost to write errors
+    unsigned long failed_bins;
+    unsigned long failed_spectra;
+    unsigned long failed_fluxes;
+    std::string type, port; // given by offline producers, else from the acquisition
+    hid_t psd, psd_info; // -1 until the file's first spectrum
+    hsize_t psd_count; // spectra written to the current file
+    std::vector<float> psd_pending, psd_writing; // spectra of psd_bins per channel
+    std::vector<Sample_Psd_Info_t> psd_info_pending, psd_info_writing;
+    hid_t flux; // -1 until the file's first block
+    hsize_t flux_count; // blocks written to the current file
+    std::vector<Eddy_Flux_t> flux_pending, flux_writing;
+} Record_Sensor_t;
+
+typedef struct {
+    std::string file_name;
+    uint64_t samples;
+    int64_t first_t; // ns, CLOCK_MONOTONIC, 0 while empty
+    int64_t last_t;
+    std::vector<uint64_t> counts; // samples per sensor
+} Record_Segment_t;
+
+static hid_t file = -1;
+static std::string file_name; // being written
+static std::string session_name; // file names of the session without extension
+static std::string journal_name;
+static std::string manifest_name;
+// rollover, none if both 0
+static int64_t segment_duration = 0; // ns
+static uint64_t segment_size = 0; // bytes
+static int64_t segment_end_t = 0; // ns, 0 until the first sample
+static bool index_sessions = true; // add stopped sessions to the session index
+static std::vector<Record_Segment_t> segments;
+static bool anchor_written = false;
+static bool anchor_given = false;
+static Anemometer_Time_Anchor_t given_anchor;
+static std::vector< std::pair<std::string, std::string> > metadata; // root attributes
+static int64_t start_realtime = 0; // ns, wall clock of WR_Record_start()
+static std::vector<Record_Sensor_t> sensors;
+static hid_t summary_type = -1;
+static hid_t psd_info_type = -1;
+static hid_t flux_type = -1;
+static int psd_bins = 0; // of the session's first spectrum, 0 until then
+static int64_t summary_offset = 0; // wall clock minus CLOCK_MONOTONIC, aligns the bins
+static bool summary_aligned = false;
+// column scratch of the writer thread
+static std::vector<long long> col_time;
+static std::vector<float> col_float;
+static std::vector<int> col_int;
+
+static pthread_mutex_t record_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t record_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t record_swapped_cond = PTHREAD_COND_INITIALIZER; // pending buffers emptied
+static pthread_t writer_thread_handle;
+static bool exit_thread = false;
+static bool recording = false;
+
+static hid_t record_field_type(int field)
+{
+    if (field == RECORD_FIELD_TIME)
+        return H5T_NATIVE_LLONG;
+    else if (field == RECORD_FIELD_STATUS or field == RECORD_FIELD_LATENCY)
+        return H5T_NATIVE_INT;
+    return H5T_NATIVE_FLOAT;
+}
+
+static void record_write_string_attribute(hid_t obj, const char* name, const char* value)
+{
+    hid_t type = H5Tcopy(H5T_C_S1);
+    H5Tset_size(type, strlen(value) > 0 ? strlen(value) : 1);
+    hid_t space = H5Screate(H5S_SCALAR);
+    hid_t attr = H5Acreate2(obj, name, type, space, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attr, type, value);
+    H5Aclose(attr);
+    H5Sclose(space);
+    H5Tclose(type);
+}
+
+static void record_write_int64_attribute(hid_t obj, const char* name, int64_t value)
+{
+    hid_t space = H5Screate(H5S_SCALAR);
+    hid_t attr = H5Acreate2(obj, name, H5T_NATIVE_INT64, space, H5P_DEFAULT, H5P_DEFAULT);
+    H5Awrite(attr, H5T_NATIVE_INT64, &value);
+    H5Aclose(attr);
+    H5Sclose(space);
+}
+
+/* sample times are CLOCK_MONOTONIC, the anchor maps them to wall clock */
+static void record_write_time_anchor(void)
+{
+    const Anemometer_Time_Anchor_t* anchor = anchor_given ? &given_anchor
+        : sonic_anemometer_get_time_anchor();
+    record_write_int64_attribute(file, "time_anchor_realtime_ns", anchor->realtime);
+    record_write_int64_attribute(file, "time_anchor_monotonic_ns", anchor->monotonic);
+    anchor_written = true;
+}
+
+/* type, port & baud rate of every sensor */
+static void record_write_sensor_info(void)
+{
+    for (size_t i = 0; i < sensors.size(); i++) {
+        const char* type = sensors[i].type.empty() ? sonic_anemometer_get_type(i) : sensors[i].type.c_str();
+        const char* port = sensors[i].port.empty() ? sonic_anemometer_get_port_path(i) : sensors[i].port.c_str();
+        const Anemometer_Driver_t* driver = type ? anemometer_driver_find(type) : NULL;
+        record_write_string_attribute(sensors[i].group, "type", type ? type : "");
+        record_write_string_attribute(sensors[i].group, "port", port ? port : "");
+        record_write_int64_attribute(sensors[i].group, "baud", driver ? driver->baud : 0);
+    }
+}
+
+/* written once per file as it is created, the same in every segment */
+static void record_write_metadata(void)
+{
+    char host[256] = "";
+    gethostname(host, sizeof(host)-1);
+    record_write_string_attribute(file, "software", "WindRecorder " WR_BUILD_ID);
+    record_write_string_attribute(file, "host", host);
+    record_write_int64_attribute(file, "start_realtime_ns", start_realtime);
+    for (size_t k = 0; k < metadata.size(); k++)
+        record_write_string_attribute(file, metadata[k].first.c_str(), metadata[k].second.c_str());
+}
+
+static hid_t record_create_dataset(hid_t group, int field)
+{
+    hsize_t dims[1] = {0};
+    hsize_t maxdims[1] = {H5S_UNLIMITED};
+    hsize_t chunk[1] = {RECORD_CHUNK_SIZE};
+
+    hid_t space = H5Screate_simple(1, dims, maxdims);
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 1, chunk);
+    const Record_Filter_Chain_t* chain = &record_field_filters[field];
+    if (chain->filters & RECORD_FILTER_SCALEOFFSET) {
+        if (record_field_type(field) == H5T_NATIVE_FLOAT)
+            H5Pset_scaleoffset(dcpl, H5Z_SO_FLOAT_DSCALE, chain->decimals);
+        else
+            H5Pset_scaleoffset(dcpl, H5Z_SO_INT, H5Z_SO_INT_MINBITS_DEFAULT);
+    }
+    if (chain->filters & RECORD_FILTER_SHUFFLE)
+        H5Pset_shuffle(dcpl);
+    if (chain->filters & RECORD_FILTER_DEFLATE)
+        H5Pset_deflate(dcpl, chain->deflate_level);
+    hid_t dset = H5Dcreate2(group, record_field_names[field], record_field_type(field),
+            space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    H5Sclose(space);
+    if (dset >= 0 and record_field_units[field][0])
+        record_write_string_attribute(dset, "units", record_field_units[field]);
+    return dset;
+}
+
+/* small and read whole by readers, left uncompressed */
+static hid_t record_create_index(hid_t group)
+{
+    hsize_t dims[1] = {0};
+    hsize_t maxdims[1] = {H5S_UNLIMITED};
+    hsize_t chunk[1] = {1024};
+
+    hid_t space = H5Screate_simple(1, dims, maxdims);
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 1, chunk);
+    hid_t dset = H5Dcreate2(group, RECORD_INDEX_NAME, H5T_NATIVE_LLONG,
+            space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    H5Sclose(space);
+    if (dset >= 0)
+        record_write_int64_attribute(dset, "stride", RECORD_CHUNK_SIZE);
+    return dset;
+}
+
+static hid_t record_create_summary(hid_t group, int level)
+{
+    hsize_t dims[1] = {0};
+    hsize_t maxdims[1] = {H5S_UNLIMITED};
+    hsize_t chunk[1] = {(hsize_t)(1024 >> 2*level)}; // about a quarter of an hour of bins and up
+
+    hid_t space = H5Screate_simple(1, dims, maxdims);
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 1, chunk);
+    // compressed if the wind is, scale-offset does not apply to compounds
+    const Record_Filter_Chain_t* chain = &record_field_filters[RECORD_FIELD_U];
+    if (chain->filters & RECORD_FILTER_DEFLATE) {
+        H5Pset_shuffle(dcpl);
+        H5Pset_deflate(dcpl, chain->deflate_level);
+    }
+    hid_t dset = H5Dcreate2(group, record_summary_names[level], summary_type,
+            space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    H5Sclose(space);
+    if (dset >= 0)
+        record_write_int64_attribute(dset, "width_ns", record_summary_widths[level]);
+    return dset;
+}
+
+/* spectra, rows of SAMPLE_PSD_CHANNELS x psd_bins, and what each averages */
+static void record_create_spectra(hid_t group, hid_t* psd, hid_t* info)
+{
+    hsize_t dims[3] = {0, SAMPLE_PSD_CHANNELS, (hsize_t)psd_bins};
+    hsize_t maxdims[3] = {H5S_UNLIMITED, SAMPLE_PSD_CHANNELS, (hsize_t)psd_bins};
+    hsize_t chunk[3] = {4, SAMPLE_PSD_CHANNELS, (hsize_t)psd_bins};
+
+    hid_t space = H5Screate_simple(3, dims, maxdims);
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 3, chunk);
+    *psd = H5Dcreate2(group, "psd", H5T_NATIVE_FLOAT, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    H5Sclose(space);
+    if (*psd >= 0) {
+        record_write_string_attribute(*psd, "channels", "u, v, w, T");
+        record_write_string_attribute(*psd, "units", "(m/s)^2/Hz, degC^2/Hz, one-sided");
+    }
+
+    hsize_t dims1[1] = {0};
+    hsize_t maxdims1[1] = {H5S_UNLIMITED};
+    hsize_t chunk1[1] = {64};
+    space = H5Screate_simple(1, dims1, maxdims1);
+    dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 1, chunk1);
+    *info = H5Dcreate2(group, "psd_info", psd_info_type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    H5Sclose(space);
+}
+
+/* fluxes, one Eddy_Flux_t per averaging block */
+static hid_t record_create_flux(hid_t group)
+{
+    hsize_t dims[1] = {0};
+    hsize_t maxdims[1] = {H5S_UNLIMITED};
+    hsize_t chunk[1] = {64};
+    hid_t space = H5Screate_simple(1, dims, maxdims);
+    hid_t dcpl = H5Pcreate(H5P_DATASET_CREATE);
+    H5Pset_chunk(dcpl, 1, chunk);
+    hid_t dset = H5Dcreate2(group, "flux", flux_type, space, H5P_DEFAULT, dcpl, H5P_DEFAULT);
+    H5Pclose(dcpl);
+    H5Sclose(space);
+    return dset;
+}
+
+/* append n values to the end of a 1-D extendible dataset */
+static bool record_append(hid_t dset, hid_t type, const void* buf, hsize_t offset, hsize_t n)
+{
+    hsize_t size[1] = {offset + n};
+    hsize_t start[1] = {offset};
+    hsize_t count[1] = {n};
+
+    if (H5Dset_extent(dset, size) < 0)
+        return false;
+    hid_t filespace = H5Dget_space(dset);
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, count, NULL);
+    hid_t memspace = H5Screate_simple(1, count, NULL);
+    herr_t err = H5Dwrite(dset, type, memspace, filespace, H5P_DEFAULT, buf);
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+    return err >= 0;
+}
+
+void record_stats_clear(Record_Stats_t* stats)
+{
+    memset(stats, 0, sizeof(*stats));
+}
+
+/* Welford's update */
+void record_stats_add(Record_Stats_t* stats, const Anemometer_Data_t* sample)
+{
+    if (sample->status != 0) {
+        stats->flagged++;
+        return;
+    }
+    float x[4] = {sample->speed[0], sample->speed[1], sample->speed[2], sample->temperature};
+    stats->count++;
+    for (int f = 0; f < 4; f++) {
+        double delta = x[f] - stats->mean[f];
+        stats->mean[f] += delta/stats->count;
+        stats->m2[f] += delta*(x[f] - stats->mean[f]);
+        if (stats->count == 1 or x[f] < stats->min[f])
+            stats->min[f] = x[f];
+        if (stats->count == 1 or x[f] > stats->max[f])
+            stats->max[f] = x[f];
+    }
+}
+
+void record_stats_merge(Record_Stats_t* stats, const Record_Stats_t* other)
+{
+    stats->flagged += other->flagged;
+    if (other->count == 0)
+        return;
+    if (stats->count == 0) {
+        uint64_t flagged = stats->flagged;
+        *stats = *other;
+        stats->flagged = flagged;
+        return;
+    }
+    double n = (double)stats->count + other->count;
+    for (int f = 0; f < 4; f++) {
+        double delta = other->mean[f] - stats->mean[f];
+        stats->mean[f] += delta*other->count/n;
+        stats->m2[f] += other->m2[f] + delta*delta*stats->count*other->count/n;
+        if (other->min[f] < stats->min[f])
+            stats->min[f] = other->min[f];
+        if (other->max[f] > stats->max[f])
+            stats->max[f] = other->max[f];
+    }
+    stats->count += other->count;
+}
+
+void record_stats_merge_summary(Record_Stats_t* stats, const Record_Summary_t* summary)
+{
+    Record_Stats_t other;
+    other.count = summary->count;
+    other.flagged = summary->flagged;
+    for (int f = 0; f < 4; f++) {
+        other.mean[f] = summary->mean[f];
+        other.m2[f] = (double)summary->var[f]*summary->count;
+        other.min[f] = summary->min[f];
+        other.max[f] = summary->max[f];
+    }
+    record_stats_merge(stats, &other);
+}
+
+void record_stats_to_summary(const Record_Stats_t* stats, int64_t t, Record_Summary_t* summary)
+{
+    memset(summary, 0, sizeof(*summary));
+    summary->t = t;
+    summary->count = stats->count < UINT32_MAX ? stats->count : UINT32_MAX;
+    summary->flagged = stats->flagged < UINT32_MAX ? stats->flagged : UINT32_MAX;
+    if (stats->count == 0)
+        return;
+    for (int f = 0; f < 4; f++) {
+        summary->min[f] = stats->min[f];
+        summary->max[f] = stats->max[f];
+        summary->mean[f] = stats->mean[f];
+        summary->var[f] = stats->m2[f]/stats->count;
+    }
+}
+
+static int64_t record_bin_start(int64_t t, int level)
+{
+    int64_t width = record_summary_widths[level];
+    int64_t r = (t + summary_offset) % width;
+    return t - (r < 0 ? r + width : r);
+}
+
+/* close the open bin of a level, into the open one of the next level */
+static void record_close_bin(Record_Sensor_t* sensor, int level)
+{
+    Record_Summary_t summary;
+    record_stats_to_summary(&sensor->bin[level], sensor->bin_t[level], &summary);
+    sensor->closed[level].push_back(summary);
+    if (level+1 < RECORD_NUM_SUMMARIES) {
+        int64_t start = record_bin_start(sensor->bin_t[level], level+1);
+        if (sensor->bin_t[level+1] != start) {
+            if (sensor->bin_t[level+1] != RECORD_NO_BIN)
+                record_close_bin(sensor, level+1);
+            sensor->bin_t[level+1] = start;
+            record_stats_clear(&sensor->bin[level+1]);
+        }
+        record_stats_merge(&sensor->bin[level+1], &sensor->bin[level]);
+    }
+    sensor->bin_t[level] = RECORD_NO_BIN;
+}
+
+static void record_summarize(Record_Sensor_t* sensor, const Anemometer_Data_t* samples, hsize_t n)
+{
+    if (!summary_aligned) {
+        const Anemometer_Time_Anchor_t* anchor = anchor_given ? &given_anchor
+            : sonic_anemometer_get_time_anchor();
+        summary_offset = anchor->realtime - anchor->monotonic;
+        summary_aligned = true;
+    }
+    for (hsize_t i = 0; i < n; i++) {
+        int64_t start = record_bin_start(samples[i].t, 0);
+        if (sensor->bin_t[0] != start) {
+            if (sensor->bin_t[0] != RECORD_NO_BIN)
+                record_close_bin(sensor, 0);
+            sensor->bin_t[0] = start;
+            record_stats_clear(&sensor->bin[0]);
+        }
+        record_stats_add(&sensor->bin[0], &samples[i]);
+    }
+}
+
+static void record_write_summaries(Record_Sensor_t* sensor)
+{
+    for (int level = 0; level < RECORD_NUM_SUMMARIES; level++) {
+        std::vector<Record_Summary_t>* closed = &sensor->closed[level];
+        if (closed->empty())
+            continue;
+        if (record_append(sensor->summary[level], summary_type, closed->data(),
+                    sensor->summary_count[level], closed->size()))
+            sensor->summary_count[level] += closed->size();
+        else {
+            hsize_t size[1] = {sensor->summary_count[level]};
+            H5Dset_extent(sensor->summary[level], size);
+            sensor->failed_bins += closed->size();
+        }
+        closed->clear();
+    }
+}
+
+static void record_write_spectra(Record_Sensor_t* sensor)
+{
+    hsize_t n = sensor->psd_info_writing.size();
+    if (n == 0)
+        return;
+    if (sensor->psd < 0 and sensor->psd_info < 0)
+        record_create_spectra(sensor->group, &sensor->psd, &sensor->psd_info);
+    if (sensor->psd < 0 or sensor->psd_info < 0) {
+        sensor->failed_spectra += n;
+        return;
+    }
+    hsize_t size[3] = {sensor->psd_count + n, SAMPLE_PSD_CHANNELS, (hsize_t)psd_bins};
+    hsize_t start[3] = {sensor->psd_count, 0, 0};
+    bool ok = H5Dset_extent(sensor->psd, size) >= 0;
+    if (ok) {
+        hid_t filespace = H5Dget_space(sensor->psd);
+        size[0] = n;
+        H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, size, NULL);
+        hid_t memspace = H5Screate_simple(3, size, NULL);
+        ok = H5Dwrite(sensor->psd, H5T_NATIVE_FLOAT, memspace, filespace, H5P_DEFAULT, sensor->psd_writing.data()) >= 0;
+        H5Sclose(memspace);
+        H5Sclose(filespace);
+    }
+    ok = ok and record_append(sensor->psd_info, psd_info_type, sensor->psd_info_writing.data(), sensor->psd_count, n);
+    if (!ok) {
+        // both back to the rows written, so they keep matching
+        size[0] = sensor->psd_count;
+        H5Dset_extent(sensor->psd, size);
+        H5Dset_extent(sensor->psd_info, size);
+        sensor->failed_spectra += n;
+        return;
+    }
+    sensor->psd_count += n;
+}
+
+static void record_write_fluxes(Record_Sensor_t* sensor)
+{
+    hsize_t n = sensor->flux_writing.size();
+    if (n == 0)
+        return;
+    if (sensor->flux < 0)
+        sensor->flux = record_create_flux(sensor->group);
+    if (sensor->flux < 0 or !record_append(sensor->flux, flux_type, sensor->flux_writing.data(), sensor->flux_count, n)) {
+        if (sensor->flux >= 0) {
+            hsize_t size[1] = {sensor->flux_count};
+            H5Dset_extent(sensor->flux, size);
+        }
+        sensor->failed_fluxes += n;
+        return;
+    }
+    sensor->flux_count += n;
+}
+
+static void record_write_sensor(Record_Sensor_t* sensor, const Anemometer_Data_t* samples, hsize_t n)
+{
+    if (n == 0)
+        return;
+
+    col_time.resize(n);
+    col_float.resize(n);
+    col_int.resize(n);
+    for (hsize_t i = 0; i < n; i++)
+        col_time[i] = samples[i].t;
+    bool ok = record_append(sensor->dset[RECORD_FIELD_TIME], H5T_NATIVE_LLONG, col_time.data(), sensor->count, n);
+    for (int axis = 0; axis < 3 and ok; axis++) {
+        for (hsize_t i = 0; i < n; i++)
+            col_float[i] = samples[i].speed[axis];
+        ok = record_append(sensor->dset[RECORD_FIELD_U+axis], H5T_NATIVE_FLOAT, col_float.data(), sensor->count, n);
+    }
+    if (ok) {
+        for (hsize_t i = 0; i < n; i++)
+            col_float[i] = samples[i].temperature;
+        ok = record_append(sensor->dset[RECORD_FIELD_T], H5T_NATIVE_FLOAT, col_float.data(), sensor->count, n);
+    }
+    if (ok) {
+        for (hsize_t i = 0; i < n; i++)
+            col_int[i] = samples[i].status;
+        ok = record_append(sensor->dset[RECORD_FIELD_STATUS], H5T_NATIVE_INT, col_int.data(), sensor->count, n);
+    }
+    if (ok) {
+        for (hsize_t i = 0; i < n; i++)
+            col_int[i] = samples[i].latency;
+        ok = record_append(sensor->dset[RECORD_FIELD_LATENCY], H5T_NATIVE_INT, col_int.data(), sensor->count, n);
+    }
+
+    // first samples of the chunks begun by this batch
+    for (hsize_t k = (sensor->count + RECORD_CHUNK_SIZE-1)/RECORD_CHUNK_SIZE*RECORD_CHUNK_SIZE;
+            k < sensor->count + n and ok; k += RECORD_CHUNK_SIZE) {
+        long long t = samples[k - sensor->count].t;
+        ok = record_append(sensor->index, H5T_NATIVE_LLONG, &t, k/RECORD_CHUNK_SIZE, 1);
+    }
+    if (!ok) {
+        // the batch is lost as a whole, the fields keep one length
+        hsize_t size[1] = {sensor->count};
+        for (int f = 0; f < RECORD_NUM_FIELDS; f++)
+            H5Dset_extent(sensor->dset[f], size);
+        size[0] = (sensor->count + RECORD_CHUNK_SIZE-1)/RECORD_CHUNK_SIZE;
+        H5Dset_extent(sensor->index, size);
+        sensor->failed += n;
+        return;
+    }
+    record_summarize(sensor, samples, n);
+    record_write_summaries(sensor);
+
+    sensor->count += n;
+    Record_Segment_t* segment = &segments.back();
+    if (segment->samples == 0 or samples[0].t < segment->first_t)
+        segment->first_t = samples[0].t;
+    if (segment->samples == 0 or samples[n-1].t > segment->last_t)
+        segment->last_t = samples[n-1].t;
+    segment->samples += n;
+    segment->counts[sensor - sensors.data()] += n;
+
+    // samples only flow once acquisition started, so the anchor is this session's
+    if (!anchor_written) {
+        record_write_time_anchor();
+        record_write_sensor_info();
+    }
+}
+
+/* session description, segments in order, rewritten as a whole on change */
+static void record_write_manifest(bool closed)
+{
+    if (manifest_name.empty())
+        return;
+    std::string tmp_name = manifest_name + ".tmp";
+    FILE* fp = fopen(tmp_name.c_str(), "w");
+    if (fp == NULL) {
+        perror(tmp_name.c_str());
+        return;
+    }
+    const Anemometer_Time_Anchor_t* anchor = anchor_given ? &given_anchor
+        : sonic_anemometer_get_time_anchor();
+    fprintf(fp, "[Session]\n");
+    fprintf(fp, "num_of_anemometers=%d\n", (int)sensors.size());
+    fprintf(fp, "time_anchor_realtime_ns=%lld\n", (long long)anchor->realtime);
+    fprintf(fp, "time_anchor_monotonic_ns=%lld\n", (long long)anchor->monotonic);
+    fprintf(fp, "segment_duration_s=%g\n", segment_duration/1e9);
+    fprintf(fp, "segment_size_bytes=%llu\n", (unsigned long long)segment_size);
+    fprintf(fp, "journal=%s\n", journal_name.substr(journal_name.rfind('/')+1).c_str());
+    fprintf(fp, "num_of_segments=%d\n", (int)segments.size());
+    fprintf(fp, "closed=%d\n", closed ? 1 : 0);
+    for (size_t k = 0; k < segments.size(); k++) {
+        const Record_Segment_t* segment = &segments[k];
+        fprintf(fp, "\n[Segment_%d]\n", (int)k+1);
+        // relative to the manifest
+        fprintf(fp, "file=%s\n", segment->file_name.substr(segment->file_name.rfind('/')+1).c_str());
+        fprintf(fp, "samples=%llu\n", (unsigned long long)segment->samples);
+        fprintf(fp, "first_time_ns=%lld\n", (long long)segment->first_t);
+        fprintf(fp, "last_time_ns=%lld\n", (long long)segment->last_t);
+        fprintf(fp, "anemometer_samples=");
+        for (size_t i = 0; i < segment->counts.size(); i++)
+            fprintf(fp, i ? ",%llu" : "%llu", (unsigned long long)segment->counts[i]);
+        fprintf(fp, "\n");
+    }
+    bool ok = fflush(fp) == 0 and fsync(fileno(fp)) == 0;
+    fclose(fp);
+    if (!ok or rename(tmp_name.c_str(), manifest_name.c_str()) < 0)
+        perror(manifest_name.c_str());
+}
+
+/* groups and datasets of every sensor in a new file */
+static void record_create_groups(void)
+{
+    char group_name[64];
+    record_write_metadata();
+    for (size_t i = 0; i < sensors.size(); i++) {
+        snprintf(group_name, sizeof(group_name), "anemometer_%d", (int)i+1);
+        sensors[i].group = H5Gcreate2(file, group_name, H5P_DEFAULT, H5P_DEFAULT, H5P_DEFAULT);
+        for (int f = 0; f < RECORD_NUM_FIELDS; f++)
+            sensors[i].dset[f] = record_create_dataset(sensors[i].group, f);
+        sensors[i].index = record_create_index(sensors[i].group);
+        sensors[i].count = 0;
+        for (int level = 0; level < RECORD_NUM_SUMMARIES; level++) {
+            sensors[i].summary[level] = record_create_summary(sensors[i].group, level);
+            sensors[i].summary_count[level] = 0;
+            sensors[i].bin_t[level] = RECORD_NO_BIN;
+            sensors[i].closed[level].clear();
+        }
+        sensors[i].psd = sensors[i].psd_info = -1;
+        sensors[i].psd_count = 0;
+        sensors[i].flux = -1;
+        sensors[i].flux_count = 0;
+    }
+    anchor_written = false;
+}
+
+/* the bins still open go to the file being closed */
+static void record_close_file(void)
+{
+    for (size_t i = 0; i < sensors.size(); i++) {
+        for (int level = 0; level < RECORD_NUM_SUMMARIES; level++)
+            if (sensors[i].bin_t[level] != RECORD_NO_BIN)
+                record_close_bin(&sensors[i], level);
+        record_write_summaries(&sensors[i]);
+        for (int f = 0; f < RECORD_NUM_FIELDS; f++)
+            H5Dclose(sensors[i].dset[f]);
+        H5Dclose(sensors[i].index);
+        for (int level = 0; level < RECORD_NUM_SUMMARIES; level++)
+            H5Dclose(sensors[i].summary[level]);
+        if (sensors[i].psd >= 0)
+            H5Dclose(sensors[i].psd);
+        if (sensors[i].psd_info >= 0)
+            H5Dclose(sensors[i].psd_info);
+        if (sensors[i].flux >= 0)
+            H5Dclose(sensors[i].flux);
+        H5Gclose(sensors[i].group);
+    }
+    H5Fclose(file);
+    file = -1;
+}
+
+static std::string record_segment_name(int k)
+{
+    char buf[32];
+    snprintf(buf, sizeof(buf), "_%04d.h5", k);
+    return session_name + buf;
+}
+
+/* continue in the next segment, the current one is kept if that fails */
+static bool record_rollover(void)
+{
+    std::string name = record_segment_name(segments.size()+1);
+    hid_t next = H5Fcreate(name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (next < 0) {
+        fprintf(stderr, "ERROR: could not create %s, recording on to %s\n", name.c_str(), file_name.c_str());
+        return false;
+    }
+    record_close_file();
+    file = next;
+    file_name = name;
+    record_create_groups();
+    Record_Segment_t segment = {name, 0, 0, 0};
+    segment.counts.assign(sensors.size(), 0);
+    segments.push_back(segment);
+    record_write_manifest(false);
+    return true;
+}
+
+/* write the swapped out batches, rolling over on the way if it is time */
+static void record_write_batches(void)
+{
+    for (size_t i = 0; i < sensors.size(); i++)
+        sensors[i].written = 0;
+
+    // the time based boundaries are counted from the first sample
+    if (segment_duration and segment_end_t == 0) {
+        for (size_t i = 0; i < sensors.size(); i++)
+            if (!sensors[i].writing.empty() and (segment_end_t == 0
+                        or sensors[i].writing[0].t + segment_duration < segment_end_t))
+                segment_end_t = sensors[i].writing[0].t + segment_duration;
+    }
+
+    for (;;) {
+        int64_t cut = segment_end_t ? segment_end_t : INT64_MAX;
+        int64_t next_t = INT64_MAX; // earliest sample left for the next segment
+        for (size_t i = 0; i < sensors.size(); i++) {
+            Record_Sensor_t* sensor = &sensors[i];
+            size_t k = sensor->written;
+            while (k < sensor->writing.size() and sensor->writing[k].t < cut)
+                k++;
+            record_write_sensor(sensor, sensor->writing.data() + sensor->written, k - sensor->written);
+            sensor->written = k;
+            if (k < sensor->writing.size() and sensor->writing[k].t < next_t)
+                next_t = sensor->writing[k].t;
+        }
+        if (next_t == INT64_MAX)
+            break;
+        // skip the boundaries of a gap in the data
+        segment_end_t += ((next_t - segment_end_t)/segment_duration + 1)*segment_duration;
+        record_rollover();
+    }
+
+    for (size_t i = 0; i < sensors.size(); i++) {
+        sensors[i].writing.clear(); // keeps capacity
+        record_write_spectra(&sensors[i]);
+        sensors[i].psd_writing.clear();
+        sensors[i].psd_info_writing.clear();
+        record_write_fluxes(&sensors[i]);
+        sensors[i].flux_writing.clear();
+    }
+    H5Fflush(file, H5F_SCOPE_LOCAL);
+
+    hsize_t size = 0;
+    if (segment_size and H5Fget_filesize(file, &size) >= 0 and size >= segment_size)
+        record_rollover();
+}
+
+/* swap pending buffers out, call with record_mutex held */
+static void record_swap_pending(void)
+{
+    for (size_t i = 0; i < sensors.size(); i++) {
+        sensors[i].pending.swap(sensors[i].writing);
+        sensors[i].psd_pending.swap(sensors[i].psd_writing);
+        sensors[i].psd_info_pending.swap(sensors[i].psd_info_writing);
+        sensors[i].flux_pending.swap(sensors[i].flux_writing);
+    }
+    pthread_cond_broadcast(&record_swapped_cond);
+}
+
+static void* record_writer_loop(void* args)
+{
+    pthread_mutex_lock(&record_mutex);
+    while (!exit_thread) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += RECORD_FLUSH_PERIOD_MS/1000;
+        deadline.tv_nsec += (RECORD_FLUSH_PERIOD_MS%1000)*1000000L;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&record_cond, &record_mutex, &deadline);
+
+        record_swap_pending();
+        pthread_mutex_unlock(&record_mutex);
+        record_write_batches();
+        pthread_mutex_lock(&record_mutex);
+    }
+    record_swap_pending();
+    pthread_mutex_unlock(&record_mutex);
+    record_write_batches();
+    return 0;
+}
+
+/* pipeline stage, never touches the file */
+static void record_stage(int index, Anemometer_Data_t* samples, int n, void* arg)
+{
+    if (index < 0 or index >= (int)sensors.size())
+        return;
+
+    pthread_mutex_lock(&record_mutex);
+    Record_Sensor_t* sensor = &sensors[index];
+    if (sensor->pending.size() + n > RECORD_MAX_PENDING)
+        sensor->dropped += n;
+    else {
+        sensor->pending.insert(sensor->pending.end(), samples, samples+n);
+        if (sensor->pending.size() >= RECORD_BATCH_SIZE)
+            pthread_cond_signal(&record_cond);
+    }
+    pthread_mutex_unlock(&record_mutex);
+}
+
+/* spectral stage callback, on the pipeline thread too */
+static void record_spectrum(int index, const Sample_Psd_Info_t* info, const float* psd, void* arg)
+{
+    if (index < 0 or index >= (int)sensors.size())
+        return;
+
+    pthread_mutex_lock(&record_mutex);
+    if (psd_bins == 0)
+        psd_bins = info->n_bins; // the stage keeps its segment length while running
+    if (recording and info->n_bins == psd_bins) {
+        Record_Sensor_t* sensor = &sensors[index];
+        sensor->psd_pending.insert(sensor->psd_pending.end(), psd, psd + SAMPLE_PSD_CHANNELS*psd_bins);
+        sensor->psd_info_pending.push_back(*info);
+    }
+    pthread_mutex_unlock(&record_mutex);
+}
+
+/* eddy-covariance stage callback, on the pipeline thread as well */
+static void record_flux(int index, const Eddy_Flux_t* flux, void* arg)
+{
+    if (index < 0 or index >= (int)sensors.size())
+        return;
+
+    pthread_mutex_lock(&record_mutex);
+    if (recording)
+        sensors[index].flux_pending.push_back(*flux);
+    pthread_mutex_unlock(&record_mutex);
+}
+
+void WR_Record_set_time_anchor(const Anemometer_Time_Anchor_t* anchor)
+{
+    given_anchor = *anchor;
+    anchor_given = true;
+}
+
+void WR_Record_set_sensor_info(int index, const char* type, const char* port)
+{
+    if (index < 0 or index >= (int)sensors.size())
+        return;
+    sensors[index].type = type;
+    sensors[index].port = port;
+}
+
+void WR_Record_set_metadata(const char* key, const char* value)
+{
+    for (size_t k = 0; k < metadata.size(); k++)
+        if (metadata[k].first == key) {
+            metadata[k].second = value;
+            return;
+        }
+    metadata.push_back(std::make_pair(std::string(key), std::string(value)));
+}
+
+void WR_Record_clear_metadata(void)
+{
+    metadata.clear();
+}
+
+void WR_Record_append(int index, const Anemometer_Data_t* samples, int n)
+{
+    if (index < 0 or index >= (int)sensors.size() or n <= 0)
+        return;
+
+    pthread_mutex_lock(&record_mutex);
+    Record_Sensor_t* sensor = &sensors[index];
+    while (recording and !sensor->pending.empty() and sensor->pending.size() + n > RECORD_MAX_PENDING) {
+        pthread_cond_signal(&record_cond);
+        pthread_cond_wait(&record_swapped_cond, &record_mutex);
+    }
+    sensor->pending.insert(sensor->pending.end(), samples, samples+n);
+    if (sensor->pending.size() >= RECORD_BATCH_SIZE)
+        pthread_cond_signal(&record_cond);
+    pthread_mutex_unlock(&record_mutex);
+}
+
+bool WR_Record_set_filters(const char* field, const Record_Filter_Chain_t* chain)
+{
+    if (recording)
+        return false;
+    if ((chain->filters & RECORD_FILTER_DEFLATE) and (chain->deflate_level < 1 or chain->deflate_level > 9
+                or !H5Zfilter_avail(H5Z_FILTER_DEFLATE)))
+        return false;
+    if ((chain->filters & RECORD_FILTER_SCALEOFFSET) and chain->decimals < 0)
+        return false;
+
+    bool found = false;
+    for (int f = 0; f < RECORD_NUM_FIELDS; f++) {
+        if (field == NULL or strcmp(field, record_field_names[f]) == 0) {
+            record_field_filters[f] = *chain;
+            found = true;
+        }
+    }
+    return found;
+}
+
+bool WR_Record_set_compression(int deflate_level, int decimals)
+{
+    Record_Filter_Chain_t chain = {0, deflate_level, decimals};
+    if (deflate_level > 0)
+        chain.filters = RECORD_FILTER_SHUFFLE | RECORD_FILTER_DEFLATE;
+    if (!WR_Record_set_filters(NULL, &chain))
+        return false;
+    if (decimals < 0)
+        return true;
+    chain.filters = RECORD_FILTER_SCALEOFFSET | (deflate_level > 0 ? RECORD_FILTER_DEFLATE : 0);
+    for (int f = RECORD_FIELD_U; f <= RECORD_FIELD_T; f++)
+        record_field_filters[f] = chain;
+    return true;
+}
+
+void WR_Record_set_segments(double duration_s, uint64_t size_bytes)
+{
+    segment_duration = duration_s > 0. ? (int64_t)(duration_s*1e9) : 0;
+    segment_size = size_bytes;
+}
+
+void WR_Record_set_index(bool enable)
+{
+    index_sessions = enable;
+}
+
+bool WR_Record_start(int n_sensors, const char* name, bool journal)
+{
+    if (recording or n_sensors < 1)
+        return false;
+
+    // file names, WR_record_<time>.h5 or WR_record_<time>_NNNN.h5 & .manifest when rolling over
+    if (name)
+        session_name = name;
+    else {
+        char buf[64];
+        time_t now = time(NULL);
+        strftime(buf, sizeof(buf), "WR_record_%Y-%m-%d_%H-%M-%S.h5", localtime(&now));
+        session_name = buf;
+    }
+    size_t ext = session_name.rfind(".h5");
+    if (ext != std::string::npos and ext == session_name.size()-3)
+        session_name.erase(ext);
+    bool rolling = segment_duration or segment_size;
+    file_name = rolling ? record_segment_name(1) : session_name + ".h5";
+    manifest_name = rolling ? session_name + ".manifest" : "";
+
+    file = H5Fcreate(file_name.c_str(), H5F_ACC_TRUNC, H5P_DEFAULT, H5P_DEFAULT);
+    if (file < 0)
+        return false;
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    start_realtime = now.tv_sec*1000000000LL + now.tv_nsec;
+    if (summary_type < 0)
+        summary_type = WR_Record_get_summary_type();
+    if (psd_info_type < 0) {
+        psd_info_type = H5Tcreate(H5T_COMPOUND, sizeof(Sample_Psd_Info_t));
+        H5Tinsert(psd_info_type, "first_t", HOFFSET(Sample_Psd_Info_t, first_t), H5T_NATIVE_INT64);
+        H5Tinsert(psd_info_type, "last_t", HOFFSET(Sample_Psd_Info_t, last_t), H5T_NATIVE_INT64);
+        H5Tinsert(psd_info_type, "segments", HOFFSET(Sample_Psd_Info_t, segments), H5T_NATIVE_INT);
+        H5Tinsert(psd_info_type, "n_bins", HOFFSET(Sample_Psd_Info_t, n_bins), H5T_NATIVE_INT);
+        H5Tinsert(psd_info_type, "df", HOFFSET(Sample_Psd_Info_t, df), H5T_NATIVE_FLOAT);
+    }
+    if (flux_type < 0)
+        flux_type = WR_Record_get_flux_type();
+    psd_bins = 0;
+    summary_aligned = false;
+    sensors.resize(n_sensors);
+    record_create_groups();
+    segments.clear();
+    Record_Segment_t segment = {file_name, 0, 0, 0};
+    segment.counts.assign(n_sensors, 0);
+    segments.push_back(segment);
+    segment_end_t = 0;
+    for (int i = 0; i < n_sensors; i++) {
+        sensors[i].dropped = 0;
+        sensors[i].failed = sensors[i].failed_bins = sensors[i].failed_spectra = sensors[i].failed_fluxes = 0;
+        sensors[i].pending.clear();
+        sensors[i].pending.reserve(RECORD_BATCH_SIZE*2);
+        sensors[i].writing.clear();
+        sensors[i].writing.reserve(RECORD_BATCH_SIZE*2);
+        sensors[i].type.clear();
+        sensors[i].port.clear();
+        sensors[i].psd_pending.clear();
+        sensors[i].psd_writing.clear();
+        sensors[i].psd_info_pending.clear();
+        sensors[i].psd_info_writing.clear();
+        sensors[i].flux_pending.clear();
+        sensors[i].flux_writing.clear();
+    }
+
+    // the journal goes first, WR_record_<time>.wrj
+    journal_name.clear();
+    if (journal) {
+        journal_name = session_name + ".wrj";
+        if (!WR_Journal_start(journal_name.c_str(), n_sensors)) {
+            record_close_file();
+            ::remove(file_name.c_str());
+            journal_name.clear();
+            return false;
+        }
+    }
+
+    // samples pile up in pending until the writer runs
+    exit_thread = false;
+    bool stage_added = sample_pipeline_add_stage(&record_stage, NULL);
+    if (!stage_added or pthread_create(&writer_thread_handle, NULL, &record_writer_loop, NULL) != 0) {
+        if (stage_added)
+            sample_pipeline_remove_stage(&record_stage, NULL);
+        WR_Journal_stop();
+        record_close_file();
+        ::remove(file_name.c_str());
+        if (!journal_name.empty())
+            ::remove(journal_name.c_str());
+        journal_name.clear();
+        return false;
+    }
+    sample_psd_set_callback(&record_spectrum, NULL);
+    eddy_flux_set_callback(&record_flux, NULL);
+    recording = true;
+    record_write_manifest(false);
+
+    return true;
+}
+
+/* call after acquisition stopped, so the last samples are recorded */
+void WR_Record_stop(void)
+{
+    if (!recording)
+        return;
+
+    WR_Journal_stop();
+    sample_pipeline_remove_stage(&record_stage, NULL);
+    sample_psd_set_callback(NULL, NULL);
+    eddy_flux_set_callback(NULL, NULL);
+    pthread_mutex_lock(&record_mutex);
+    exit_thread = true;
+    recording = false;
+    pthread_cond_signal(&record_cond);
+    pthread_cond_broadcast(&record_swapped_cond);
+    pthread_mutex_unlock(&record_mutex);
+    pthread_join(writer_thread_handle, NULL);
+
+    record_close_file(); // writes the last bins
+    for (size_t i = 0; i < sensors.size(); i++) {
+        if (sensors[i].dropped)
+            fprintf(stderr, "Anemometer %d: %lu samples not recorded, disk too slow.\n", (int)i+1, sensors[i].dropped);
+        if (sensors[i].failed or sensors[i].failed_bins or sensors[i].failed_spectra or sensors[i].failed_fluxes)
+            fprintf(stderr, "Anemometer %d: %lu samples, %lu summary bins, %lu spectra, %lu flux blocks not recorded, write failed.\n",
+                    (int)i+1, sensors[i].failed, sensors[i].failed_bins, sensors[i].failed_spectra, sensors[i].failed_fluxes);
+    }
+    // a rollover right at the end leaves an empty segment
+    if (segments.size() > 1 and segments.back().samples == 0) {
+        ::remove(segments.back().file_name.c_str());
+        segments.pop_back();
+    }
+    record_write_manifest(true);
+    // sessions which never got a sample (failed to start) are not worth finding
+    std::string name = manifest_name.empty() ? file_name : manifest_name;
+    Session_Info_t info;
+    if (index_sessions and segments.back().samples > 0 and (!WR_Session_describe(name.c_str(), &info)
+            or !WR_Session_index_add(WR_Session_index_name(name.c_str()).c_str(), &info)))
+        fprintf(stderr, "WARNING: %s not added to the session index\n", name.c_str());
+    if (manifest_name.empty())
+        printf("Record saved to %s\n", file_name.c_str());
+    else
+        printf("Record saved to %d segments, see %s\n", (int)segments.size(), manifest_name.c_str());
+    anchor_given = false;
+}
+
+const char* WR_Record_get_field_name(int field)
+{
+    return field >= 0 and field < RECORD_NUM_FIELDS ? record_field_names[field] : NULL;
+}
+
+const char* WR_Record_get_summary_name(int level)
+{
+    return level >= 0 and level < RECORD_NUM_SUMMARIES ? record_summary_names[level] : NULL;
+}
+
+int64_t WR_Record_get_summary_width(int level)
+{
+    return level >= 0 and level < RECORD_NUM_SUMMARIES ? record_summary_widths[level] : 0;
+}
+
+/* members named u_min, ..., T_var */
+hid_t WR_Record_get_summary_type(void)
+{
+    hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(Record_Summary_t));
+    H5Tinsert(type, "time", HOFFSET(Record_Summary_t, t), H5T_NATIVE_INT64);
+    H5Tinsert(type, "count", HOFFSET(Record_Summary_t, count), H5T_NATIVE_UINT32);
+    H5Tinsert(type, "flagged", HOFFSET(Record_Summary_t, flagged), H5T_NATIVE_UINT32);
+    const char* fields[4] = {"u", "v", "w", "T"};
+    const char* stats[4] = {"min", "max", "mean", "var"};
+    const size_t offsets[4] = {HOFFSET(Record_Summary_t, min), HOFFSET(Record_Summary_t, max),
+        HOFFSET(Record_Summary_t, mean), HOFFSET(Record_Summary_t, var)};
+    char name[16];
+    for (int s = 0; s < 4; s++)
+        for (int f = 0; f < 4; f++) {
+            snprintf(name, sizeof(name), "%s_%s", fields[f], stats[s]);
+            H5Tinsert(type, name, offsets[s] + f*sizeof(float), H5T_NATIVE_FLOAT);
+        }
+    return type;
+}
+
+/* members named as those of Eddy_Flux_t, sigma as sigma_u, ..., sigma_T */
+hid_t WR_Record_get_flux_type(void)
+{
+    hid_t type = H5Tcreate(H5T_COMPOUND, sizeof(Eddy_Flux_t));
+    H5Tinsert(type, "time", HOFFSET(Eddy_Flux_t, t), H5T_NATIVE_INT64);
+    H5Tinsert(type, "width", HOFFSET(Eddy_Flux_t, width), H5T_NATIVE_INT64);
+    H5Tinsert(type, "count", HOFFSET(Eddy_Flux_t, count), H5T_NATIVE_UINT64);
+    H5Tinsert(type, "flagged", HOFFSET(Eddy_Flux_t, flagged), H5T_NATIVE_UINT64);
+    H5Tinsert(type, "speed", HOFFSET(Eddy_Flux_t, speed), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "direction", HOFFSET(Eddy_Flux_t, direction), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "yaw", HOFFSET(Eddy_Flux_t, yaw), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "pitch", HOFFSET(Eddy_Flux_t, pitch), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "T", HOFFSET(Eddy_Flux_t, T), H5T_NATIVE_DOUBLE);
+    const char* sigmas[4] = {"sigma_u", "sigma_v", "sigma_w", "sigma_T"};
+    for (int f = 0; f < 4; f++)
+        H5Tinsert(type, sigmas[f], HOFFSET(Eddy_Flux_t, sigma) + f*sizeof(double), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "uw", HOFFSET(Eddy_Flux_t, uw), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "vw", HOFFSET(Eddy_Flux_t, vw), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "wT", HOFFSET(Eddy_Flux_t, wT), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "u_star", HOFFSET(Eddy_Flux_t, u_star), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "tau", HOFFSET(Eddy_Flux_t, tau), H5T_NATIVE_DOUBLE);
+    H5Tinsert(type, "H", HOFFSET(Eddy_Flux_t, H), H5T_NATIVE_DOUBLE);
+    return type;
+}
+
+bool WR_Record_is_recording(void)
+{
+    return recording;
+}
+
+const char* WR_Record_get_file_name(void)
+{
+    return file_name.c_str();
+}
+
+const char* WR_Record_get_session_name(void)
+{
+    return session_name.c_str();
+}
+
+const char* WR_Record_get_manifest_name(void)
+{
+    return manifest_name.c_str();
+}
+
+const char* WR_Record_get_journal_name(void)
+{
+    return journal_name.c_str();
+}
+
+/* End of record.cxx */
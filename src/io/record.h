@@ -0,0 +1,164 @@
+/*
+ * Data Recording
+ *
+ * Anemometer samples are streamed to an HDF5 file while running. Every
+ * anemometer gets a group "/anemometer_N" holding one extendible, chunked
+ * dataset per field (time, u, v, w, T, status, latency), appended in
+ * batches by a background writer thread. Sample times are CLOCK_MONOTONIC
+ * nanoseconds, the file attributes time_anchor_realtime_ns and
+ * time_anchor_monotonic_ns map them to wall clock.
+ *
+ * Unless disabled, the samples are first written to a crash-safe journal
+ * (see journal.h) next to the record, WR_record_<time>.wrj, from which
+ * wr_journal2h5 rebuilds the HDF5 file if it did not survive.
+ *
+ * Long sessions can be split into segments, WR_record_<time>_0001.h5,
+ * _0002.h5, ..., each one a complete record of its own, rolled over after
+ * a given duration of data and/or once the file reached a given size.
+ * WR_record_<time>.manifest (INI) lists the segments with their sample
+ * counts (in all and per sensor) and time spans, so they can be read as
+ * one session.
+ *
+ * Next to the fields, "time_index" holds the time of every
+ * RECORD_CHUNK_SIZE-th sample, the first of each chunk, so a reader finds
+ * a time by looking at a single chunk (see record_reader.h). Samples of a
+ * sensor are recorded in acquisition order, their times never decrease.
+ *
+ * Summaries of wind and temperature are kept at RECORD_NUM_SUMMARIES
+ * resolutions as they are recorded, "summary_1s", "_10s", "_1min" and
+ * "_10min": one Record_Summary_t per bin, bins aligned to wall clock,
+ * each resolution built by merging the bins of the finer one. Bins open
+ * when a segment is rolled over are closed into it, so a bin may be split
+ * between two segments.
+ *
+ * Every dataset has its own filter chain, applied chunk by chunk by the
+ * writer thread: scale-offset (floats rounded to a number of decimals,
+ * integers packed losslessly), then byte shuffle, then deflate. Readers
+ * need nothing special, HDF5 undoes the chain.
+ *
+ * Every file describes its session in attributes of its root, written
+ * once as it is created: "software" (name and build), "host",
+ * "start_realtime_ns" (wall clock of the start) and the metadata given by
+ * WR_Record_set_metadata(), "config" being the settings file the session
+ * ran with. The group of a sensor has its "type", "port" and "baud" rate.
+ * Stopped sessions are added to the session index of their directory
+ * (see session_index.h), unless turned off by WR_Record_set_index().
+ *
+ * Once the spectral stage publishes, a sensor's group also has the Welch
+ * spectra of every period (see sample_psd.h): "psd", one row of
+ * SAMPLE_PSD_CHANNELS x bins floats per spectrum, and "psd_info", one
+ * Sample_Psd_Info_t per row (the time span, segments averaged and bin
+ * width). A spectrum goes to the file being written when it is published;
+ * files without any, e.g. of offline producers, have neither dataset.
+ *
+ * Likewise the group of a 3-D sensor gets "flux", one Eddy_Flux_t per
+ * averaging block of the eddy-covariance stage (see eddy_flux.h), as the
+ * block closes; the block open when recording stops is not kept.
+ *
+ * Author: Roice (LUO Bing)
+ * Date: 2017-04-16 create this file
+ */
+
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <hdf5.h>
+#include "io/serial_anemometers.h"
+
+#define RECORD_CHUNK_SIZE       4096 // samples per HDF5 chunk
+#define RECORD_BATCH_SIZE       1024 // pending samples of a sensor that wake up the writer
+#define RECORD_FLUSH_PERIOD_MS  1000 // data reaches the file at least this often
+#define RECORD_MAX_PENDING      (1<<20) // samples per sensor buffered if the disk stalls
+#define RECORD_INDEX_NAME       "time_index" // time of the first sample of every chunk
+
+/* datasets of a sensor's group */
+enum {
+    RECORD_FIELD_TIME = 0,
+    RECORD_FIELD_U,
+    RECORD_FIELD_V,
+    RECORD_FIELD_W,
+    RECORD_FIELD_T,
+    RECORD_FIELD_STATUS,
+    RECORD_FIELD_LATENCY,
+    RECORD_NUM_FIELDS
+};
+
+#define RECORD_NUM_SUMMARIES    4 // 1 s, 10 s, 1 min, 10 min
+
+/* a bin of a summary, statistics of u, v, w & T of the samples with status 0 */
+typedef struct {
+    int64_t t; // start of the bin, ns, CLOCK_MONOTONIC
+    uint32_t count; // samples with status 0
+    uint32_t flagged; // samples with another status, left out
+    float min[4]; // u, v, w, T
+    float max[4];
+    float mean[4];
+    float var[4]; // population variance
+} Record_Summary_t;
+
+/* running statistics of a bin, merged pairwise (Chan et al.) */
+typedef struct {
+    uint64_t count;
+    uint64_t flagged;
+    double mean[4];
+    double m2[4]; // sum of squared deviations from the mean
+    float min[4];
+    float max[4];
+} Record_Stats_t;
+
+void record_stats_clear(Record_Stats_t*);
+void record_stats_add(Record_Stats_t*, const Anemometer_Data_t*);
+void record_stats_merge(Record_Stats_t*, const Record_Stats_t*);
+void record_stats_merge_summary(Record_Stats_t*, const Record_Summary_t*);
+void record_stats_to_summary(const Record_Stats_t*, int64_t t, Record_Summary_t*);
+
+/* filters of a chain, applied in this order */
+/* scale-offset keeps floats within half a unit of the last decimal kept, values
+ * already on that grid (Gill UVW, Young) come back to the float's precision,
+ * derived ones (WindSonic u & v from polar) are rounded; integers lossless */
+#define RECORD_FILTER_SCALEOFFSET   0x1
+#define RECORD_FILTER_SHUFFLE       0x2 // byte shuffle, helps deflate on slowly varying values
+#define RECORD_FILTER_DEFLATE       0x4 // zlib, at deflate_level
+
+typedef struct {
+    unsigned filters; // RECORD_FILTER_*, 0 stores the dataset uncompressed
+    int deflate_level; // 1 fastest to 9 smallest
+    int decimals; // scale-offset of floats, 2 for Gill and Young wind & temperature
+} Record_Filter_Chain_t;
+
+/* segments for the following sessions, 0 and 0 for a single file */
+void WR_Record_set_segments(double duration_s, uint64_t size_bytes);
+/* whether the following sessions go to the session index, on by default */
+void WR_Record_set_index(bool enable);
+/* filter chain of the datasets named field ("time", "u", "v", "w", "T",
+ * "status", "latency", NULL for all) for the following sessions */
+bool WR_Record_set_filters(const char* field, const Record_Filter_Chain_t*);
+/* the usual chains: shuffle & deflate at level (0 uncompressed), wind and
+ * temperature scale-offset to decimals instead of shuffled (-1 keeps them exact) */
+bool WR_Record_set_compression(int deflate_level, int decimals);
+const char* WR_Record_get_field_name(int field); // dataset name
+const char* WR_Record_get_summary_name(int level);
+int64_t WR_Record_get_summary_width(int level); // ns
+hid_t WR_Record_get_summary_type(void); // of Record_Summary_t, H5Tclose() it
+hid_t WR_Record_get_flux_type(void); // of Eddy_Flux_t, H5Tclose() it
+/* metadata of the following sessions, a string attribute of the root of
+ * every file; the names above are taken. Kept until cleared */
+void WR_Record_set_metadata(const char* key, const char* value);
+void WR_Record_clear_metadata(void);
+bool WR_Record_start(int n_sensors, const char* file_name = 0, bool journal = true);
+void WR_Record_stop(void);
+bool WR_Record_is_recording(void);
+const char* WR_Record_get_file_name(void); // being written
+const char* WR_Record_get_session_name(void); // file names of the session without extension
+const char* WR_Record_get_manifest_name(void); // empty if not rolling over
+const char* WR_Record_get_journal_name(void); // empty if not journaling
+/* offline producers (journal conversion) instead of the pipeline: appending
+ * waits for the writer rather than dropping, and the session's anchor and
+ * sensors are given instead of taken from the acquisition */
+void WR_Record_set_time_anchor(const Anemometer_Time_Anchor_t*);
+void WR_Record_set_sensor_info(int index, const char* type, const char* port);
+void WR_Record_append(int index, const Anemometer_Data_t*, int n);
+
+#endif
+
+/* End of record.h */
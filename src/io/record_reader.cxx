@@ -0,0 +1,649 @@
+/*
+ * Record reader
+ *
+ * A sensor's samples in a segment are found through the time index: the
+ * entries bracket the time within one stride of samples, which is one
+ * chunk of the time dataset, read and searched as a whole. Segments of a
+ * manifest ending before the time are skipped without searching, those
+ * starting after it are not even opened.
+ *
+ * Summaries and raw samples alike are accumulated into bins of a given
+ * width (a single one for an aggregate) with the recorder's pairwise
+ * merge, so a range split across resolutions and segments adds up to
+ * exactly what its samples give.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <boost/property_tree/ptree.hpp>
+#include <boost/property_tree/ini_parser.hpp>
+#include "io/record_reader.h"
+
+static bool reader_ends_with(const std::string& s, const char* suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n and s.compare(s.size()-n, n, suffix) == 0;
+}
+
+static hid_t reader_field_type(int field)
+{
+    if (field == RECORD_FIELD_TIME)
+        return H5T_NATIVE_INT64;
+    if (field == RECORD_FIELD_STATUS or field == RECORD_FIELD_LATENCY)
+        return H5T_NATIVE_INT;
+    return H5T_NATIVE_FLOAT;
+}
+
+static void* reader_column(Reader_Columns_t* out, int field, size_t n)
+{
+    switch (field) {
+        case RECORD_FIELD_TIME: out->time.resize(n); return out->time.data();
+        case RECORD_FIELD_U: out->u.resize(n); return out->u.data();
+        case RECORD_FIELD_V: out->v.resize(n); return out->v.data();
+        case RECORD_FIELD_W: out->w.resize(n); return out->w.data();
+        case RECORD_FIELD_T: out->T.resize(n); return out->T.data();
+        case RECORD_FIELD_STATUS: out->status.resize(n); return out->status.data();
+        case RECORD_FIELD_LATENCY: out->latency.resize(n); return out->latency.data();
+    }
+    return NULL;
+}
+
+/* n values from first on of a 1-D dataset */
+static bool reader_read_slab(hid_t dset, hid_t type, uint64_t first, size_t n, void* buf)
+{
+    if (n == 0)
+        return true;
+    hsize_t start[1] = {first};
+    hsize_t count[1] = {n};
+    hid_t filespace = H5Dget_space(dset);
+    H5Sselect_hyperslab(filespace, H5S_SELECT_SET, start, NULL, count, NULL);
+    hid_t memspace = H5Screate_simple(1, count, NULL);
+    herr_t err = H5Dread(dset, type, memspace, filespace, H5P_DEFAULT, buf);
+    H5Sclose(memspace);
+    H5Sclose(filespace);
+    return err >= 0;
+}
+
+static int64_t reader_time_at(Reader_Sensor_t* sensor, uint64_t k)
+{
+    int64_t t = 0;
+    reader_read_slab(sensor->dset[RECORD_FIELD_TIME], H5T_NATIVE_INT64, k, 1, &t);
+    return t;
+}
+
+static bool reader_read_int64_attribute(hid_t obj, const char* name, int64_t* value)
+{
+    if (H5Aexists(obj, name) <= 0)
+        return false;
+    hid_t attr = H5Aopen(obj, name, H5P_DEFAULT);
+    herr_t err = H5Aread(attr, H5T_NATIVE_INT64, value);
+    H5Aclose(attr);
+    return err >= 0;
+}
+
+static bool reader_open_file(Reader_Segment_t* segment)
+{
+    if (segment->file >= 0)
+        return true;
+    if (access(segment->file_name.c_str(), R_OK) == 0)
+        segment->file = H5Fopen(segment->file_name.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (segment->file < 0) {
+        fprintf(stderr, "ERROR: could not open %s\n", segment->file_name.c_str());
+        return false;
+    }
+    return true;
+}
+
+/* datasets, sample count and time index of a sensor in a segment */
+static Reader_Sensor_t* reader_load(Record_Reader_t* reader, size_t k, int index)
+{
+    Reader_Segment_t* segment = &reader->segments[k];
+    Reader_Sensor_t* sensor = &segment->sensors[index];
+    if (sensor->loaded)
+        return sensor;
+    sensor->loaded = true;
+    sensor->counted = true;
+    sensor->count = 0;
+    if (!reader_open_file(segment))
+        return sensor; // empty, the other segments can still be read
+
+    char group_name[64];
+    snprintf(group_name, sizeof(group_name), "anemometer_%d", index+1);
+    if (H5Lexists(segment->file, group_name, H5P_DEFAULT) <= 0)
+        return sensor;
+    hid_t group = H5Gopen2(segment->file, group_name, H5P_DEFAULT);
+    for (int f = 0; f < RECORD_NUM_FIELDS; f++)
+        sensor->dset[f] = H5Dopen2(group, WR_Record_get_field_name(f), H5P_DEFAULT);
+    if (sensor->dset[RECORD_FIELD_TIME] >= 0) {
+        hsize_t dims[1] = {0};
+        hid_t space = H5Dget_space(sensor->dset[RECORD_FIELD_TIME]);
+        H5Sget_simple_extent_dims(space, dims, NULL);
+        H5Sclose(space);
+        sensor->count = dims[0];
+    }
+    // records made before the index was written are bisected
+    if (H5Lexists(group, RECORD_INDEX_NAME, H5P_DEFAULT) > 0) {
+        hid_t dset = H5Dopen2(group, RECORD_INDEX_NAME, H5P_DEFAULT);
+        int64_t stride = 0;
+        hsize_t dims[1] = {0};
+        hid_t space = H5Dget_space(dset);
+        H5Sget_simple_extent_dims(space, dims, NULL);
+        H5Sclose(space);
+        if (reader_read_int64_attribute(dset, "stride", &stride) and stride > 0) {
+            sensor->stride = stride;
+            sensor->index.resize(dims[0]);
+            if (!reader_read_slab(dset, H5T_NATIVE_INT64, 0, dims[0], sensor->index.data()))
+                sensor->index.clear();
+        }
+        H5Dclose(dset);
+    }
+    for (int level = 0; level < RECORD_NUM_SUMMARIES; level++) {
+        const char* name = WR_Record_get_summary_name(level);
+        if (H5Lexists(group, name, H5P_DEFAULT) <= 0)
+            continue;
+        sensor->summary[level] = H5Dopen2(group, name, H5P_DEFAULT);
+        hsize_t dims[1] = {0};
+        hid_t space = H5Dget_space(sensor->summary[level]);
+        H5Sget_simple_extent_dims(space, dims, NULL);
+        H5Sclose(space);
+        sensor->summary_count[level] = dims[0];
+    }
+    H5Gclose(group);
+    return sensor;
+}
+
+/* samples of a sensor in a segment, without opening it if the manifest tells */
+static uint64_t reader_count(Record_Reader_t* reader, size_t k, int index)
+{
+    Reader_Sensor_t* sensor = &reader->segments[k].sensors[index];
+    return sensor->counted ? sensor->count : reader_load(reader, k, index)->count;
+}
+
+/* first of the elements [lo, hi) of a dataset, of size bytes starting with
+ * an int64 time, at or after t, hi if none; bisected down to a chunk, which
+ * is read whole. Whole elements, HDF5 is slow to pick members of compounds */
+static uint64_t reader_search(hid_t dset, hid_t type, size_t size, uint64_t lo, uint64_t hi, int64_t t)
+{
+    std::vector<char> buf(std::min(hi - lo, (uint64_t)RECORD_CHUNK_SIZE)*size);
+    int64_t mid_t;
+    while (hi - lo > RECORD_CHUNK_SIZE) {
+        uint64_t mid = lo + (hi - lo)/2;
+        reader_read_slab(dset, type, mid, 1, buf.data());
+        memcpy(&mid_t, buf.data(), sizeof(mid_t));
+        if (mid_t < t)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    if (!reader_read_slab(dset, type, lo, hi - lo, buf.data()))
+        return hi;
+    const char* base = buf.data() - lo*size;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo)/2;
+        memcpy(&mid_t, base + mid*size, sizeof(mid_t));
+        if (mid_t < t)
+            lo = mid+1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/* first sample of a segment at or after t, count if none */
+static uint64_t reader_find_in(Reader_Sensor_t* sensor, int64_t t)
+{
+    if (sensor->count == 0)
+        return 0;
+    if (sensor->index.empty())
+        return reader_search(sensor->dset[RECORD_FIELD_TIME], H5T_NATIVE_INT64, sizeof(int64_t),
+                0, sensor->count, t);
+    // the index brackets t within a stride
+    size_t j = std::lower_bound(sensor->index.begin(), sensor->index.end(), t) - sensor->index.begin();
+    if (j == 0)
+        return 0;
+    return reader_search(sensor->dset[RECORD_FIELD_TIME], H5T_NATIVE_INT64, sizeof(int64_t),
+            (j-1)*sensor->stride, std::min((uint64_t)j*sensor->stride, sensor->count), t);
+}
+
+static bool reader_open_manifest(const std::string& name, Record_Reader_t* reader)
+{
+    boost::property_tree::ptree pt;
+    try {
+        boost::property_tree::ini_parser::read_ini(name, pt);
+        reader->num_sensors = pt.get<int>("Session.num_of_anemometers");
+        reader->anchor.realtime = pt.get<long long>("Session.time_anchor_realtime_ns", 0);
+        reader->anchor.monotonic = pt.get<long long>("Session.time_anchor_monotonic_ns", 0);
+        reader->closed = pt.get<int>("Session.closed", 0) != 0;
+        int n_segments = pt.get<int>("Session.num_of_segments");
+        // segment files are named relative to the manifest
+        size_t slash = name.rfind('/');
+        std::string dir = slash == std::string::npos ? "" : name.substr(0, slash+1);
+        for (int k = 0; k < n_segments; k++) {
+            std::string section = "Segment_" + std::to_string(k+1);
+            Reader_Segment_t segment;
+            segment.file_name = dir + pt.get<std::string>(section + ".file");
+            segment.file = -1;
+            segment.spanned = pt.get<unsigned long long>(section + ".samples", 0) > 0;
+            segment.first_t = pt.get<long long>(section + ".first_time_ns", 0);
+            segment.last_t = pt.get<long long>(section + ".last_time_ns", 0);
+            // older manifests lack them
+            std::string counts = pt.get<std::string>(section + ".anemometer_samples", "");
+            for (size_t p = 0; !counts.empty() and p != std::string::npos; ) {
+                size_t comma = counts.find(',', p);
+                segment.counts.push_back(strtoull(counts.c_str() + p, NULL, 10));
+                p = comma == std::string::npos ? comma : comma+1;
+            }
+            reader->segments.push_back(segment);
+        }
+    }
+    catch (boost::property_tree::ptree_error &e) {
+        fprintf(stderr, "ERROR: %s is not a session manifest\n", name.c_str());
+        return false;
+    }
+    return reader->num_sensors > 0;
+}
+
+static bool reader_open_record(const std::string& name, Record_Reader_t* reader)
+{
+    Reader_Segment_t segment;
+    segment.file_name = name;
+    segment.file = -1;
+    segment.spanned = false;
+    segment.first_t = segment.last_t = 0;
+    reader->segments.push_back(segment);
+    if (!reader_open_file(&reader->segments[0]))
+        return false;
+    hid_t file = reader->segments[0].file;
+
+    char group_name[64];
+    for (;;) {
+        snprintf(group_name, sizeof(group_name), "anemometer_%d", reader->num_sensors+1);
+        if (H5Lexists(file, group_name, H5P_DEFAULT) <= 0)
+            break;
+        reader->num_sensors++;
+    }
+    int64_t realtime = 0, monotonic = 0;
+    reader_read_int64_attribute(file, "time_anchor_realtime_ns", &realtime);
+    reader_read_int64_attribute(file, "time_anchor_monotonic_ns", &monotonic);
+    reader->anchor.realtime = realtime;
+    reader->anchor.monotonic = monotonic;
+    reader->closed = true; // HDF5 would not have opened it otherwise
+    if (reader->num_sensors == 0)
+        fprintf(stderr, "ERROR: no anemometers recorded in %s\n", name.c_str());
+    return reader->num_sensors > 0;
+}
+
+bool WR_Reader_open(const char* name, Record_Reader_t* reader)
+{
+    reader->num_sensors = 0;
+    reader->anchor.realtime = reader->anchor.monotonic = 0;
+    reader->closed = false;
+    reader->segments.clear();
+    reader->summary_type = -1;
+
+    std::string file_name = name;
+    bool manifest;
+    if (reader_ends_with(file_name, ".manifest"))
+        manifest = true;
+    else if (reader_ends_with(file_name, ".h5"))
+        manifest = false;
+    else {
+        manifest = access((file_name + ".manifest").c_str(), F_OK) == 0;
+        file_name += manifest ? ".manifest" : ".h5";
+    }
+    if (!(manifest ? reader_open_manifest(file_name, reader) : reader_open_record(file_name, reader))) {
+        WR_Reader_close(reader);
+        return false;
+    }
+    reader->summary_type = WR_Record_get_summary_type();
+
+    Reader_Sensor_t sensor;
+    sensor.loaded = false;
+    for (int f = 0; f < RECORD_NUM_FIELDS; f++)
+        sensor.dset[f] = -1;
+    sensor.stride = 0;
+    for (int level = 0; level < RECORD_NUM_SUMMARIES; level++) {
+        sensor.summary[level] = -1;
+        sensor.summary_count[level] = 0;
+    }
+    for (size_t k = 0; k < reader->segments.size(); k++) {
+        Reader_Segment_t* segment = &reader->segments[k];
+        bool counted = (int)segment->counts.size() == reader->num_sensors;
+        segment->sensors.assign(reader->num_sensors, sensor);
+        for (int i = 0; i < reader->num_sensors; i++) {
+            segment->sensors[i].counted = counted;
+            segment->sensors[i].count = counted ? segment->counts[i] : 0;
+        }
+    }
+
+    return true;
+}
+
+void WR_Reader_close(Record_Reader_t* reader)
+{
+    for (size_t k = 0; k < reader->segments.size(); k++) {
+        Reader_Segment_t* segment = &reader->segments[k];
+        for (size_t i = 0; i < segment->sensors.size(); i++)
+            for (int f = 0; f < RECORD_NUM_FIELDS; f++)
+                if (segment->sensors[i].dset[f] >= 0)
+                    H5Dclose(segment->sensors[i].dset[f]);
+        for (size_t i = 0; i < segment->sensors.size(); i++)
+            for (int level = 0; level < RECORD_NUM_SUMMARIES; level++)
+                if (segment->sensors[i].summary[level] >= 0)
+                    H5Dclose(segment->sensors[i].summary[level]);
+        if (segment->file >= 0)
+            H5Fclose(segment->file);
+    }
+    reader->segments.clear();
+    reader->num_sensors = 0;
+    if (reader->summary_type >= 0)
+        H5Tclose(reader->summary_type);
+    reader->summary_type = -1;
+}
+
+uint64_t WR_Reader_get_num_samples(Record_Reader_t* reader, int index)
+{
+    if (index < 0 or index >= reader->num_sensors)
+        return 0;
+    uint64_t n = 0;
+    for (size_t k = 0; k < reader->segments.size(); k++)
+        n += reader_count(reader, k, index);
+    return n;
+}
+
+bool WR_Reader_get_time_span(Record_Reader_t* reader, int index, int64_t* first_t, int64_t* last_t)
+{
+    if (index < 0 or index >= reader->num_sensors)
+        return false;
+    size_t n = reader->segments.size();
+    size_t first = 0, last = n;
+    while (first < n and reader_count(reader, first, index) == 0)
+        first++;
+    if (first == n)
+        return false;
+    while (last > first and reader_count(reader, last-1, index) == 0)
+        last--;
+    *first_t = reader_time_at(reader_load(reader, first, index), 0);
+    Reader_Sensor_t* sensor = reader_load(reader, last-1, index);
+    *last_t = reader_time_at(sensor, sensor->count-1);
+    return true;
+}
+
+int64_t WR_Reader_get_start_time(Record_Reader_t* reader)
+{
+    // earliest of the spans, segments need not start in time order
+    int64_t start = 0;
+    bool found = false;
+    for (size_t k = 0; k < reader->segments.size(); k++)
+        if (reader->segments[k].spanned and (!found or reader->segments[k].first_t < start)) {
+            start = reader->segments[k].first_t;
+            found = true;
+        }
+    if (found)
+        return start;
+    // a single record, earliest of the sensors
+    for (int i = 0; i < reader->num_sensors; i++) {
+        int64_t first_t, last_t;
+        if (WR_Reader_get_time_span(reader, i, &first_t, &last_t) and (!found or first_t < start)) {
+            start = first_t;
+            found = true;
+        }
+    }
+    return start;
+}
+
+uint64_t WR_Reader_find(Record_Reader_t* reader, int index, int64_t t)
+{
+    if (index < 0 or index >= reader->num_sensors)
+        return 0;
+    uint64_t pos = 0;
+    for (size_t k = 0; k < reader->segments.size(); k++) {
+        Reader_Segment_t* segment = &reader->segments[k];
+        uint64_t count = reader_count(reader, k, index);
+        // a span is of all sensors, and offline producers need not cut every
+        // sensor at the same time, so it only tells which segments end before t
+        if (count > 0 and !(segment->spanned and segment->last_t < t)) {
+            Reader_Sensor_t* sensor = reader_load(reader, k, index);
+            uint64_t p = reader_find_in(sensor, t);
+            if (p < sensor->count)
+                return pos + p;
+        }
+        pos += count;
+    }
+    return pos;
+}
+
+size_t WR_Reader_read(Record_Reader_t* reader, int index, uint64_t first, size_t n,
+        unsigned columns, Reader_Columns_t* out)
+{
+    out->first = first;
+    out->count = 0;
+    for (int f = 0; f < RECORD_NUM_FIELDS; f++)
+        reader_column(out, f, 0);
+    if (index < 0 or index >= reader->num_sensors)
+        return 0;
+
+    size_t done = 0;
+    uint64_t pos = 0; // of the segment's first sample
+    for (size_t k = 0; k < reader->segments.size() and done < n; k++) {
+        uint64_t count = reader_count(reader, k, index);
+        if (first + done < pos + count) {
+            Reader_Sensor_t* sensor = reader_load(reader, k, index);
+            uint64_t offset = first + done - pos;
+            size_t m = std::min((uint64_t)(n - done), sensor->count - offset);
+            for (int f = 0; f < RECORD_NUM_FIELDS; f++) {
+                if (!(columns & READER_COLUMN(f)))
+                    continue;
+                char* column = (char*)reader_column(out, f, done + m);
+                if (!reader_read_slab(sensor->dset[f], reader_field_type(f), offset, m,
+                            column + done*H5Tget_size(reader_field_type(f)))) {
+                    fprintf(stderr, "ERROR: could not read %s of anemometer %d in %s\n",
+                            WR_Record_get_field_name(f), index+1, reader->segments[k].file_name.c_str());
+                    m = 0;
+                    break;
+                }
+            }
+            done += m;
+        }
+        pos += count;
+    }
+    for (int f = 0; f < RECORD_NUM_FIELDS; f++)
+        if (columns & READER_COLUMN(f))
+            reader_column(out, f, done);
+    out->count = done;
+    return done;
+}
+
+size_t WR_Reader_read_range(Record_Reader_t* reader, int index, int64_t t0, int64_t t1,
+        unsigned columns, Reader_Columns_t* out)
+{
+    uint64_t first = WR_Reader_find(reader, index, t0);
+    uint64_t last = t1 > t0 ? WR_Reader_find(reader, index, t1) : first;
+    return WR_Reader_read(reader, index, first, last - first, columns, out);
+}
+
+/* bins [start + k*width, start + (k+1)*width) being filled */
+typedef struct {
+    std::vector<Record_Stats_t> stats;
+    int64_t start;
+    int64_t width;
+} Reader_Bins_t;
+
+#define READER_BLOCK    65536 // samples or summary bins read at once
+
+static inline Record_Stats_t* reader_bin(Reader_Bins_t* bins, int64_t t)
+{
+    if (t < bins->start)
+        return NULL;
+    uint64_t k = (uint64_t)(t - bins->start)/bins->width;
+    return k < bins->stats.size() ? &bins->stats[k] : NULL;
+}
+
+/* start of the wall clock aligned bin of width holding t */
+static int64_t reader_align(const Record_Reader_t* reader, int64_t t, int64_t width)
+{
+    int64_t r = (t + (reader->anchor.realtime - reader->anchor.monotonic)) % width;
+    return t - (r < 0 ? r + width : r);
+}
+
+/* samples of a segment in times [a, b) into the bins */
+static void reader_add_samples(Reader_Sensor_t* sensor, int64_t a, int64_t b, Reader_Bins_t* bins)
+{
+    uint64_t p0 = reader_find_in(sensor, a);
+    uint64_t p1 = reader_find_in(sensor, b);
+    size_t block = std::min((uint64_t)READER_BLOCK, p1 - p0);
+    std::vector<int64_t> time(block);
+    std::vector<float> values[4];
+    std::vector<int> status(block);
+    for (int f = 0; f < 4; f++)
+        values[f].resize(block);
+    for (uint64_t p = p0; p < p1; p += READER_BLOCK) {
+        size_t n = std::min((uint64_t)READER_BLOCK, p1 - p);
+        bool ok = reader_read_slab(sensor->dset[RECORD_FIELD_TIME], H5T_NATIVE_INT64, p, n, time.data())
+            and reader_read_slab(sensor->dset[RECORD_FIELD_STATUS], H5T_NATIVE_INT, p, n, status.data());
+        for (int f = 0; f < 4; f++)
+            ok = ok and reader_read_slab(sensor->dset[RECORD_FIELD_U+f], H5T_NATIVE_FLOAT, p, n, values[f].data());
+        if (!ok)
+            return;
+        Anemometer_Data_t sample;
+        for (size_t i = 0; i < n; i++) {
+            Record_Stats_t* stats = reader_bin(bins, time[i]);
+            if (stats == NULL)
+                continue;
+            sample.speed[0] = values[0][i];
+            sample.speed[1] = values[1][i];
+            sample.speed[2] = values[2][i];
+            sample.temperature = values[3][i];
+            sample.status = status[i];
+            record_stats_add(stats, &sample);
+        }
+    }
+}
+
+/* summary bins of a segment starting in [a, b) into the bins */
+static void reader_add_summaries(Record_Reader_t* reader, Reader_Sensor_t* sensor, int level,
+        int64_t a, int64_t b, Reader_Bins_t* bins)
+{
+    hid_t dset = sensor->summary[level];
+    uint64_t q0 = reader_search(dset, reader->summary_type, sizeof(Record_Summary_t), 0,
+            sensor->summary_count[level], a);
+    uint64_t q1 = reader_search(dset, reader->summary_type, sizeof(Record_Summary_t), q0,
+            sensor->summary_count[level], b);
+    std::vector<Record_Summary_t> summaries(std::min((uint64_t)READER_BLOCK, q1 - q0));
+    for (uint64_t q = q0; q < q1; q += READER_BLOCK) {
+        size_t n = std::min((uint64_t)READER_BLOCK, q1 - q);
+        if (!reader_read_slab(dset, reader->summary_type, q, n, summaries.data()))
+            return;
+        for (size_t i = 0; i < n; i++) {
+            Record_Stats_t* stats = reader_bin(bins, summaries[i].t);
+            if (stats)
+                record_stats_merge_summary(stats, &summaries[i]);
+        }
+    }
+}
+
+/* times [a, b) of every segment into the bins, from a summary level or
+ * from raw samples (level -1); with a level, a and b are on its bins */
+static void reader_add_span(Record_Reader_t* reader, int index, int level, int64_t a, int64_t b,
+        Reader_Bins_t* bins)
+{
+    for (size_t k = 0; k < reader->segments.size(); k++) {
+        Reader_Segment_t* segment = &reader->segments[k];
+        if (segment->spanned and (segment->last_t < a or segment->first_t >= b))
+            continue;
+        if (reader_count(reader, k, index) == 0)
+            continue;
+        Reader_Sensor_t* sensor = reader_load(reader, k, index);
+        if (level >= 0 and sensor->summary[level] >= 0)
+            reader_add_summaries(reader, sensor, level, a, b, bins);
+        else
+            reader_add_samples(sensor, a, b, bins);
+    }
+}
+
+/* [t0, t1) from the given level down, returns the coarsest level used */
+static int reader_aggregate_span(Record_Reader_t* reader, int index, int level, int64_t t0, int64_t t1,
+        Reader_Bins_t* bins)
+{
+    if (t0 >= t1)
+        return -1;
+    if (level < 0) {
+        reader_add_span(reader, index, -1, t0, t1, bins);
+        return -1;
+    }
+    int64_t width = WR_Record_get_summary_width(level);
+    int64_t a = reader_align(reader, t0, width);
+    if (a < t0)
+        a += width;
+    int64_t b = reader_align(reader, t1, width);
+    if (a >= b)
+        return reader_aggregate_span(reader, index, level-1, t0, t1, bins);
+    reader_aggregate_span(reader, index, level-1, t0, a, bins);
+    reader_add_span(reader, index, level, a, b, bins);
+    reader_aggregate_span(reader, index, level-1, b, t1, bins);
+    return level;
+}
+
+/* limit [t0, t1) to the sensor's samples, false if none are in it */
+static bool reader_clamp(Record_Reader_t* reader, int index, int64_t* t0, int64_t* t1)
+{
+    int64_t first_t, last_t;
+    if (!WR_Reader_get_time_span(reader, index, &first_t, &last_t))
+        return false;
+    if (*t0 < first_t)
+        *t0 = first_t;
+    if (*t1 > last_t)
+        *t1 = last_t + 1;
+    return *t0 < *t1;
+}
+
+int WR_Reader_aggregate(Record_Reader_t* reader, int index, int64_t t0, int64_t t1, Record_Summary_t* out)
+{
+    Reader_Bins_t bins;
+    bins.stats.resize(1);
+    record_stats_clear(&bins.stats[0]);
+    int level = -1;
+    int64_t start = t0;
+    if (reader_clamp(reader, index, &t0, &t1)) {
+        bins.start = t0;
+        bins.width = t1 - t0;
+        level = reader_aggregate_span(reader, index, RECORD_NUM_SUMMARIES-1, t0, t1, &bins);
+    }
+    record_stats_to_summary(&bins.stats[0], start, out);
+    return level;
+}
+
+size_t WR_Reader_read_series(Record_Reader_t* reader, int index, int64_t t0, int64_t t1,
+        int64_t width, std::vector<Record_Summary_t>* out)
+{
+    out->clear();
+    if (width <= 0 or !reader_clamp(reader, index, &t0, &t1))
+        return 0;
+    Reader_Bins_t bins;
+    bins.start = reader_align(reader, t0, width);
+    bins.width = width;
+    bins.stats.resize((t1 - bins.start + width-1)/width);
+    for (size_t k = 0; k < bins.stats.size(); k++)
+        record_stats_clear(&bins.stats[k]);
+
+    int level = RECORD_NUM_SUMMARIES-1;
+    while (level >= 0 and width % WR_Record_get_summary_width(level) != 0)
+        level--;
+    reader_add_span(reader, index, level, bins.start, bins.start + bins.stats.size()*width, &bins);
+
+    Record_Summary_t summary;
+    for (size_t k = 0; k < bins.stats.size(); k++) {
+        if (bins.stats[k].count == 0 and bins.stats[k].flagged == 0)
+            continue;
+        record_stats_to_summary(&bins.stats[k], bins.start + k*width, &summary);
+        out->push_back(summary);
+    }
+    return out->size();
+}
+
+/* End of record_reader.cxx */
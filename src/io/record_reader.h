@@ -0,0 +1,109 @@
+/*
+ * Record reader
+ *
+ * Reads recorded sessions back, a single HDF5 record or the segments
+ * listed by a manifest (see record.h), as one session per sensor: samples
+ * are numbered from 0 across the segments, and ranges of samples or of
+ * time are read into contiguous arrays, one per field (SoA), with one
+ * hyperslab read per field and segment.
+ *
+ * Opening reads the manifest only. Segment files are opened when a query
+ * first touches them, a sensor's datasets and its time index when it is
+ * first read; the manifest's sample counts spare opening the segments
+ * before the samples asked for. So opening and querying a long session
+ * costs about as much as the data asked for. A time is found through the manifest's segment
+ * spans, then the time index (records without one are bisected), then the
+ * one chunk of times holding it.
+ *
+ * Aggregates (count, min, max, mean, variance) over a time range are
+ * answered from the recorded summaries: the coarsest resolution whose
+ * bins fit in the range covers its middle, finer ones the ends, raw
+ * samples only the fraction of a second left at either end. Segments
+ * recorded without summaries are read sample by sample.
+ *
+ * Not thread safe, give every thread its own reader. Sessions still being
+ * recorded can not be read, HDF5 files are only complete once closed.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef RECORD_READER_H
+#define RECORD_READER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <hdf5.h>
+#include "io/record.h"
+
+/* columns to read, bits of RECORD_FIELD_* */
+#define READER_COLUMN(field)    (1u << (field))
+#define READER_COLUMNS_WIND     (READER_COLUMN(RECORD_FIELD_U) | READER_COLUMN(RECORD_FIELD_V) \
+        | READER_COLUMN(RECORD_FIELD_W) | READER_COLUMN(RECORD_FIELD_T))
+#define READER_COLUMNS_ALL      ((1u << RECORD_NUM_FIELDS) - 1)
+
+typedef struct {
+    uint64_t first; // position of the first sample in the session
+    size_t count;
+    // the columns asked for hold count values, the others are left empty
+    std::vector<int64_t> time; // ns, CLOCK_MONOTONIC
+    std::vector<float> u, v, w, T;
+    std::vector<int> status, latency;
+} Reader_Columns_t;
+
+typedef struct {
+    bool loaded;
+    bool counted; // count known, from the manifest or once loaded
+    hid_t dset[RECORD_NUM_FIELDS];
+    uint64_t count; // samples in the segment
+    uint64_t stride; // samples between index entries
+    std::vector<int64_t> index; // empty if the record has none
+    hid_t summary[RECORD_NUM_SUMMARIES]; // -1 if the record has none
+    uint64_t summary_count[RECORD_NUM_SUMMARIES]; // bins
+} Reader_Sensor_t;
+
+typedef struct {
+    std::string file_name;
+    hid_t file; // -1 until touched
+    bool spanned; // first_t & last_t known from the manifest
+    int64_t first_t, last_t; // all sensors
+    std::vector<uint64_t> counts; // per sensor, from the manifest
+    std::vector<Reader_Sensor_t> sensors;
+} Reader_Segment_t;
+
+typedef struct {
+    int num_sensors;
+    Anemometer_Time_Anchor_t anchor;
+    bool closed; // recording was stopped properly
+    std::vector<Reader_Segment_t> segments;
+    hid_t summary_type; // Record_Summary_t
+} Record_Reader_t;
+
+/* name is a record (.h5), a manifest (.manifest) or the session name without extension */
+bool WR_Reader_open(const char* name, Record_Reader_t* reader);
+void WR_Reader_close(Record_Reader_t* reader);
+uint64_t WR_Reader_get_num_samples(Record_Reader_t* reader, int index);
+/* times of the first and last samples of a sensor, false if it has none */
+bool WR_Reader_get_time_span(Record_Reader_t* reader, int index, int64_t* first_t, int64_t* last_t);
+/* first sample of the session, from the manifest if there is one */
+int64_t WR_Reader_get_start_time(Record_Reader_t* reader);
+/* position of the first sample at or after t, the number of samples if none */
+uint64_t WR_Reader_find(Record_Reader_t* reader, int index, int64_t t);
+/* samples [first, first+n) or those in times [t0, t1), returns how many were read */
+size_t WR_Reader_read(Record_Reader_t* reader, int index, uint64_t first, size_t n,
+        unsigned columns, Reader_Columns_t* out);
+size_t WR_Reader_read_range(Record_Reader_t* reader, int index, int64_t t0, int64_t t1,
+        unsigned columns, Reader_Columns_t* out);
+/* statistics of the samples in times [t0, t1), out->t is t0; returns the
+ * coarsest summary level used, -1 if only raw samples were */
+int WR_Reader_aggregate(Record_Reader_t* reader, int index, int64_t t0, int64_t t1, Record_Summary_t* out);
+/* statistics in bins of width ns over [t0, t1), aligned to wall clock, for
+ * plots; from the coarsest summary whose bins divide width, from raw
+ * samples if none does. Empty bins are left out, returns how many are kept */
+size_t WR_Reader_read_series(Record_Reader_t* reader, int index, int64_t t0, int64_t t1,
+        int64_t width, std::vector<Record_Summary_t>* out);
+
+#endif
+
+/* End of record_reader.h */
@@ -0,0 +1,262 @@
+/*
+ * Replay of raw serial captures
+ *
+ * The capture file is mapped read-only and indexed once per sensor, the
+ * workers then merge their sensors' chunks by time with a small heap and
+ * hand the mapped bytes straight to the parsers, without copies.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <atomic>
+#include <queue>
+#include <vector>
+#include "io/replay.h"
+#include "io/serial.h"
+#include "io/serial_anemometers.h"
+
+typedef struct {
+    pthread_t handle;
+    std::vector<int> sensors;
+} Replay_Worker_t;
+
+static const char* map = NULL; // the capture file
+static size_t map_size = 0;
+static const Capture_File_Header_t* header = NULL;
+static std::vector< std::vector<size_t> > chunks; // record offsets of each sensor
+static uint64_t num_chunks = 0;
+static int64_t first_t = 0;
+
+static Serial_Epoll_Handler_t* handlers = NULL;
+static double speed = 1.;
+static int64_t t_offset = 0;
+static int64_t start_t = 0; // replay clock at first_t
+static Replay_Worker_t workers[REPLAY_MAX_THREADS];
+static int num_workers = 0;
+static std::atomic<int> workers_done(0);
+static std::atomic<bool> exit_thread(false);
+
+static inline const Capture_Record_Header_t* replay_record(size_t offset)
+{
+    return (const Capture_Record_Header_t*)(map + offset);
+}
+
+/* parsers keep up with any replay, the sample pipeline drains every
+ * SAMPLE_PIPELINE_PERIOD_MS only, so do not overrun its rings */
+static void replay_wait_for_pipeline(int index)
+{
+    struct timespec ts = {0, 1000000};
+    while (sonic_anemometer_get_pending(index) > SERIAL_ANEMOMETER_RING_SIZE/2
+            and !exit_thread.load(std::memory_order_relaxed))
+        nanosleep(&ts, NULL);
+}
+
+static void* replay_worker_loop(void* args)
+{
+    Replay_Worker_t* worker = (Replay_Worker_t*)args;
+    typedef std::pair<int64_t, int> Next_t; // time of next chunk, sensor
+    std::priority_queue<Next_t, std::vector<Next_t>, std::greater<Next_t> > next;
+    std::vector<size_t> cursor(worker->sensors.size(), 0);
+    std::vector<int> slot(chunks.size(), -1); // sensor -> cursor
+
+    for (size_t k = 0; k < worker->sensors.size(); k++) {
+        int idx = worker->sensors[k];
+        slot[idx] = k;
+        if (!chunks[idx].empty())
+            next.push(Next_t(replay_record(chunks[idx][0])->t, idx));
+    }
+
+    while (!next.empty() and !exit_thread.load(std::memory_order_relaxed)) {
+        int idx = next.top().second;
+        int64_t t = next.top().first;
+        next.pop();
+
+        if (speed > 0.) { // original timing, scaled
+            int64_t due = start_t + (int64_t)((t - first_t)/speed);
+            if (due > serial_clock_ns()) {
+                struct timespec ts;
+                ts.tv_sec = due/1000000000LL;
+                ts.tv_nsec = due%1000000000LL;
+                clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+            }
+        }
+        replay_wait_for_pipeline(idx);
+
+        size_t& c = cursor[slot[idx]];
+        const Capture_Record_Header_t* rec = replay_record(chunks[idx][c]);
+        handlers[idx]((char*)(rec + 1), rec->len, idx, rec->t + t_offset);
+        if (++c < chunks[idx].size())
+            next.push(Next_t(replay_record(chunks[idx][c])->t, idx));
+    }
+
+    workers_done.fetch_add(1);
+    return 0;
+}
+
+static void replay_close(void)
+{
+    if (map)
+        munmap((void*)map, map_size);
+    map = NULL;
+    map_size = 0;
+    header = NULL;
+    chunks.clear();
+    num_chunks = 0;
+}
+
+int WR_Replay_get_num_sensors(const char* file_name)
+{
+    Capture_File_Header_t fh;
+    FILE* fp = fopen(file_name, "rb");
+    if (fp == NULL)
+        return -1;
+    bool ok = fread(&fh, sizeof(fh), 1, fp) == 1
+        and memcmp(fh.magic, CAPTURE_MAGIC, sizeof(fh.magic)) == 0
+        and fh.version == CAPTURE_VERSION;
+    fclose(fp);
+    return ok ? (int)fh.n_sensors : -1;
+}
+
+bool WR_Replay_open(const char* file_name, int* n_sensors)
+{
+    if (map or file_name == NULL)
+        return false;
+
+    int fd = open(file_name, O_RDONLY);
+    if (fd < 0) {
+        perror(file_name);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 or st.st_size < (off_t)sizeof(Capture_File_Header_t)) {
+        fprintf(stderr, "ERROR: %s is not a capture file\n", file_name);
+        close(fd);
+        return false;
+    }
+    map_size = st.st_size;
+    void* addr = mmap(NULL, map_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+        perror(file_name);
+        map_size = 0;
+        return false;
+    }
+    map = (const char*)addr;
+    madvise(addr, map_size, MADV_SEQUENTIAL);
+
+    header = (const Capture_File_Header_t*)map;
+    if (memcmp(header->magic, CAPTURE_MAGIC, sizeof(header->magic)) != 0
+            or header->version != CAPTURE_VERSION or header->n_sensors < 1
+            or header->header_size > map_size
+            or header->header_size < sizeof(Capture_File_Header_t) + header->n_sensors*sizeof(Capture_Sensor_Info_t)) {
+        fprintf(stderr, "ERROR: %s is not a capture file\n", file_name);
+        replay_close();
+        return false;
+    }
+
+    // index the chunks of every sensor
+    chunks.assign(header->n_sensors, std::vector<size_t>());
+    first_t = INT64_MAX;
+    size_t offset = header->header_size;
+    while (offset + sizeof(Capture_Record_Header_t) <= map_size) {
+        const Capture_Record_Header_t* rec = replay_record(offset);
+        size_t size = CAPTURE_RECORD_SIZE(rec->len);
+        if (rec->index >= header->n_sensors or offset + size > map_size) {
+            fprintf(stderr, "WARNING: %s truncated or corrupted after %lu chunks\n",
+                    file_name, (unsigned long)num_chunks);
+            break;
+        }
+        chunks[rec->index].push_back(offset);
+        if (rec->t < first_t)
+            first_t = rec->t;
+        num_chunks++;
+        offset += size;
+    }
+    if (num_chunks == 0)
+        first_t = 0;
+
+    *n_sensors = header->n_sensors;
+    return true;
+}
+
+const Capture_File_Header_t* WR_Replay_get_header(void)
+{
+    return header;
+}
+
+const Capture_Sensor_Info_t* WR_Replay_get_sensor_info(int index)
+{
+    if (header == NULL or index < 0 or index >= (int)header->n_sensors)
+        return NULL;
+    return (const Capture_Sensor_Info_t*)(map + sizeof(Capture_File_Header_t)) + index;
+}
+
+int64_t WR_Replay_get_first_time(void)
+{
+    return first_t;
+}
+
+uint64_t WR_Replay_get_num_chunks(void)
+{
+    return num_chunks;
+}
+
+bool WR_Replay_start(Serial_Epoll_Handler_t* h, double s, int n_threads, int64_t offset)
+{
+    if (map == NULL or num_workers or h == NULL)
+        return false;
+
+    int n_sensors = header->n_sensors;
+    if (n_threads < 1) n_threads = 1;
+    if (n_threads > REPLAY_MAX_THREADS) n_threads = REPLAY_MAX_THREADS;
+    if (n_threads > n_sensors) n_threads = n_sensors;
+
+    handlers = new Serial_Epoll_Handler_t[n_sensors];
+    for (int i = 0; i < n_sensors; i++)
+        handlers[i] = h[i];
+    speed = s;
+    t_offset = offset;
+    start_t = serial_clock_ns();
+    exit_thread.store(false);
+    workers_done.store(0);
+    for (int i = 0; i < n_threads; i++)
+        workers[i].sensors.clear();
+    for (int i = 0; i < n_sensors; i++)
+        workers[i % n_threads].sensors.push_back(i);
+
+    for (num_workers = 0; num_workers < n_threads; num_workers++) {
+        if (pthread_create(&workers[num_workers].handle, NULL, &replay_worker_loop, (void*)&workers[num_workers]) != 0) {
+            WR_Replay_stop();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool WR_Replay_is_done(void)
+{
+    return num_workers > 0 and workers_done.load() == num_workers;
+}
+
+void WR_Replay_stop(void)
+{
+    exit_thread.store(true);
+    for (int i = 0; i < num_workers; i++)
+        pthread_join(workers[i].handle, NULL);
+    num_workers = 0;
+    delete [] handlers;
+    handlers = NULL;
+    replay_close();
+}
+
+/* End of replay.cxx */
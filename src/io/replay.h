@@ -0,0 +1,42 @@
+/*
+ * Replay of raw serial captures
+ *
+ * Feeds the chunks of a capture file (see capture.h) back through the
+ * driver parsers, chunk for chunk as they were read, so the samples, the
+ * sample pipeline and everything downstream (history, recorder, UI) see
+ * the same data as in the field. Sensors are dealt round-robin to worker
+ * threads, each one going through its sensors' chunks in time order.
+ *
+ * Speed 1 keeps the original timing between chunks, speed N runs N times
+ * faster, speed 0 goes as fast as the parsers and the pipeline allow.
+ * Chunk times are shifted by a constant offset to the replay clock and the
+ * session time anchor is shifted alike, so wall clock times are unchanged.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdint.h>
+#include "io/capture.h"
+#include "io/serial_epoll.h" // Serial_Epoll_Handler_t
+
+#define REPLAY_MAX_THREADS  16
+
+/* replay.cxx, normally driven by sonic_anemometer_init_replay() */
+int WR_Replay_get_num_sensors(const char* file_name); // from the file header, -1 if not a capture
+bool WR_Replay_open(const char* file_name, int* n_sensors);
+const Capture_File_Header_t* WR_Replay_get_header(void);
+const Capture_Sensor_Info_t* WR_Replay_get_sensor_info(int index);
+int64_t WR_Replay_get_first_time(void); // ns, of the earliest chunk
+uint64_t WR_Replay_get_num_chunks(void);
+/* handlers[i] parses the chunks of sensor i, t_offset is added to chunk times */
+bool WR_Replay_start(Serial_Epoll_Handler_t* handlers, double speed, int n_threads, int64_t t_offset);
+bool WR_Replay_is_done(void); // every chunk handed to the parsers
+void WR_Replay_stop(void); // also closes the file
+
+#endif
+
+/* End of replay.h */
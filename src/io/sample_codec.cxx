@@ -0,0 +1,291 @@
+/*
+ * Sample block codec
+ *
+ * Bit fields are packed least significant bit first into 64-bit words.
+ *
+ *   time:      first raw (64); then delta-of-delta d, zigzag coded:
+ *              '0' d = 0 | '10' 14 bits | '110' 20 bits | '1110' 32 bits | '1111' 64 bits
+ *   float:     first raw (32); then x = value XOR previous:
+ *              '0' x = 0 | '10' bits in the previous window |
+ *              '11' leading zeros (5), length-1 (5), bits
+ *   int:       first raw (32); then delta d, zigzag coded:
+ *              '0' d = 0 | '10' 8 bits | '110' 16 bits | '111' 32 bits
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <string.h>
+#include "io/sample_codec.h"
+
+static inline uint64_t codec_mask(int n)
+{
+    return n >= 64 ? ~0ULL : (1ULL << n) - 1;
+}
+
+typedef struct {
+    std::vector<uint64_t>* out;
+    uint64_t acc;
+    int used; // bits of acc
+} Bit_Writer_t;
+
+static inline void codec_put(Bit_Writer_t* w, uint64_t v, int n)
+{
+    if (n == 0)
+        return;
+    v &= codec_mask(n);
+    w->acc |= v << w->used;
+    if (w->used + n >= 64) {
+        w->out->push_back(w->acc);
+        w->acc = w->used ? v >> (64 - w->used) : 0;
+        w->used += n - 64;
+    }
+    else
+        w->used += n;
+}
+
+typedef struct {
+    const uint64_t* bits;
+    size_t n_words;
+    size_t word;
+    uint64_t cur;
+    int pos; // next bit of cur
+} Bit_Reader_t;
+
+static inline uint64_t codec_get(Bit_Reader_t* r, int n)
+{
+    if (n == 0)
+        return 0;
+    uint64_t v = r->cur >> r->pos;
+    if (r->pos + n >= 64) {
+        r->word++;
+        r->cur = r->word < r->n_words ? r->bits[r->word] : 0;
+        if (r->pos + n > 64)
+            v |= r->cur << (64 - r->pos);
+        r->pos += n - 64;
+    }
+    else
+        r->pos += n;
+    return v & codec_mask(n);
+}
+
+/* number of leading '1's of a prefix, up to max */
+static inline int codec_get_prefix(Bit_Reader_t* r, int max)
+{
+    int k = 0;
+    while (k < max and codec_get(r, 1))
+        k++;
+    return k;
+}
+
+static inline uint64_t codec_zigzag(int64_t v)
+{
+    return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t codec_unzigzag(uint64_t z)
+{
+    return (int64_t)(z >> 1) ^ -(int64_t)(z & 1);
+}
+
+/* times */
+static void codec_put_dod(Bit_Writer_t* w, int64_t dod)
+{
+    uint64_t z = codec_zigzag(dod);
+    if (z == 0)
+        codec_put(w, 0, 1);
+    else if (z < (1ULL << 14)) {
+        codec_put(w, 0x1, 2); // '10', lsb first
+        codec_put(w, z, 14);
+    }
+    else if (z < (1ULL << 20)) {
+        codec_put(w, 0x3, 3); // '110'
+        codec_put(w, z, 20);
+    }
+    else if (z < (1ULL << 32)) {
+        codec_put(w, 0x7, 4); // '1110'
+        codec_put(w, z, 32);
+    }
+    else {
+        codec_put(w, 0xF, 4); // '1111'
+        codec_put(w, z, 64);
+    }
+}
+
+static int64_t codec_get_dod(Bit_Reader_t* r)
+{
+    static const int width[5] = {0, 14, 20, 32, 64};
+    int k = codec_get_prefix(r, 4);
+    return k ? codec_unzigzag(codec_get(r, width[k])) : 0;
+}
+
+/* floats */
+typedef struct {
+    uint32_t prev;
+    int leading; // window of the previous meaningful bits
+    int trailing;
+} Float_State_t;
+
+static inline uint32_t codec_float_bits(float f)
+{
+    uint32_t u;
+    memcpy(&u, &f, sizeof(u));
+    return u;
+}
+
+static inline float codec_bits_float(uint32_t u)
+{
+    float f;
+    memcpy(&f, &u, sizeof(f));
+    return f;
+}
+
+static void codec_put_float(Bit_Writer_t* w, Float_State_t* s, uint32_t v)
+{
+    uint32_t x = v ^ s->prev;
+    s->prev = v;
+    if (x == 0) {
+        codec_put(w, 0, 1);
+        return;
+    }
+    int leading = __builtin_clz(x);
+    int trailing = __builtin_ctz(x);
+    if (leading > 31)
+        leading = 31;
+    if (s->leading >= 0 and leading >= s->leading and trailing >= s->trailing) {
+        codec_put(w, 0x1, 2); // '10'
+        codec_put(w, x >> s->trailing, 32 - s->leading - s->trailing);
+    }
+    else {
+        int length = 32 - leading - trailing;
+        codec_put(w, 0x3, 2); // '11'
+        codec_put(w, leading, 5);
+        codec_put(w, length - 1, 5);
+        codec_put(w, x >> trailing, length);
+        s->leading = leading;
+        s->trailing = trailing;
+    }
+}
+
+static uint32_t codec_get_float(Bit_Reader_t* r, Float_State_t* s)
+{
+    int k = codec_get_prefix(r, 2);
+    if (k == 0)
+        return s->prev;
+    if (k == 2) {
+        s->leading = codec_get(r, 5);
+        int length = codec_get(r, 5) + 1;
+        s->trailing = 32 - s->leading - length;
+    }
+    uint32_t x = codec_get(r, 32 - s->leading - s->trailing) << s->trailing;
+    s->prev ^= x;
+    return s->prev;
+}
+
+/* ints */
+static void codec_put_int(Bit_Writer_t* w, int32_t* prev, int32_t v)
+{
+    uint64_t z = codec_zigzag((int64_t)v - *prev);
+    *prev = v;
+    if (z == 0)
+        codec_put(w, 0, 1);
+    else if (z < (1U << 8)) {
+        codec_put(w, 0x1, 2); // '10'
+        codec_put(w, z, 8);
+    }
+    else if (z < (1U << 16)) {
+        codec_put(w, 0x3, 3); // '110'
+        codec_put(w, z, 16);
+    }
+    else {
+        codec_put(w, 0x7, 3); // '111'
+        codec_put(w, z, 33); // int32 deltas take 33 bits zigzagged
+    }
+}
+
+static int32_t codec_get_int(Bit_Reader_t* r, int32_t* prev)
+{
+    static const int width[4] = {0, 8, 16, 33};
+    int k = codec_get_prefix(r, 3);
+    if (k)
+        *prev = (int32_t)(*prev + codec_unzigzag(codec_get(r, width[k])));
+    return *prev;
+}
+
+size_t sample_block_encode(const Anemometer_Data_t* samples, int n, std::vector<uint64_t>* bits)
+{
+    size_t start = bits->size();
+    if (n <= 0)
+        return 0;
+    Bit_Writer_t w = {bits, 0, 0};
+
+    // first sample raw
+    const Anemometer_Data_t* s = &samples[0];
+    codec_put(&w, (uint64_t)s->t, 64);
+    Float_State_t fs[4];
+    for (int f = 0; f < 4; f++) {
+        fs[f].prev = codec_float_bits(f < 3 ? s->speed[f] : s->temperature);
+        fs[f].leading = -1;
+        fs[f].trailing = 0;
+        codec_put(&w, fs[f].prev, 32);
+    }
+    int32_t status = s->status, latency = s->latency;
+    codec_put(&w, (uint32_t)status, 32);
+    codec_put(&w, (uint32_t)latency, 32);
+
+    int64_t prev_t = s->t, prev_delta = 0;
+    for (int i = 1; i < n; i++) {
+        s = &samples[i];
+        int64_t delta = s->t - prev_t;
+        codec_put_dod(&w, delta - prev_delta);
+        prev_t = s->t;
+        prev_delta = delta;
+        for (int f = 0; f < 3; f++)
+            codec_put_float(&w, &fs[f], codec_float_bits(s->speed[f]));
+        codec_put_float(&w, &fs[3], codec_float_bits(s->temperature));
+        codec_put_int(&w, &status, s->status);
+        codec_put_int(&w, &latency, s->latency);
+    }
+    if (w.used)
+        bits->push_back(w.acc);
+    return bits->size() - start;
+}
+
+void sample_block_decode(const uint64_t* bits, size_t n_words, int n, Anemometer_Data_t* samples)
+{
+    if (n <= 0 or n_words == 0)
+        return;
+    Bit_Reader_t r = {bits, n_words, 0, bits[0], 0};
+
+    Anemometer_Data_t* s = &samples[0];
+    s->t = (int64_t)codec_get(&r, 64);
+    Float_State_t fs[4];
+    for (int f = 0; f < 4; f++) {
+        fs[f].prev = codec_get(&r, 32);
+        fs[f].leading = 0;
+        fs[f].trailing = 0;
+    }
+    s->speed[0] = codec_bits_float(fs[0].prev);
+    s->speed[1] = codec_bits_float(fs[1].prev);
+    s->speed[2] = codec_bits_float(fs[2].prev);
+    s->temperature = codec_bits_float(fs[3].prev);
+    int32_t status = (int32_t)codec_get(&r, 32), latency = (int32_t)codec_get(&r, 32);
+    s->status = status;
+    s->latency = latency;
+
+    int64_t prev_t = s->t, prev_delta = 0;
+    for (int i = 1; i < n; i++) {
+        s = &samples[i];
+        prev_delta += codec_get_dod(&r);
+        prev_t += prev_delta;
+        s->t = prev_t;
+        s->speed[0] = codec_bits_float(codec_get_float(&r, &fs[0]));
+        s->speed[1] = codec_bits_float(codec_get_float(&r, &fs[1]));
+        s->speed[2] = codec_bits_float(codec_get_float(&r, &fs[2]));
+        s->temperature = codec_bits_float(codec_get_float(&r, &fs[3]));
+        s->status = codec_get_int(&r, &status);
+        s->latency = codec_get_int(&r, &latency);
+    }
+}
+
+/* End of sample_codec.cxx */
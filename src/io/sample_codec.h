@@ -0,0 +1,29 @@
+/*
+ * Sample block codec
+ *
+ * Lossless compression of a run of anemometer samples of one sensor, in
+ * the style of Facebook's Gorilla time series store: times as
+ * delta-of-delta, wind and temperature as the XOR of each value with the
+ * previous one (only the meaningful bits), status and latency as deltas,
+ * all in variable-length bit fields. Samples are coded in order, so a
+ * block decodes in one sequential pass.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+#include <stdint.h>
+#include <vector>
+#include "io/serial_anemometers.h"
+
+/* appends the coded samples to bits, returns the number of words added */
+size_t sample_block_encode(const Anemometer_Data_t* samples, int n, std::vector<uint64_t>* bits);
+/* n must be the number of samples encoded */
+void sample_block_decode(const uint64_t* bits, size_t n_words, int n, Anemometer_Data_t* samples);
+
+#endif
+
+/* End of sample_codec.h */
@@ -0,0 +1,284 @@
+/*
+ * Despiking
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdlib.h>
+#include <math.h>
+#include <atomic>
+#include <new>
+#include "io/sample_despike.h"
+#include "io/sample_pipeline.h"
+#include "io/spsc_ring.h" // CACHE_LINE_SIZE
+
+#define DESPIKE_CHANNELS    4 // u, v, w, T
+#define DESPIKE_MAD_SIGMA   1.4826 // sigma over MAD of normal data
+
+typedef struct {
+    // read by any thread
+    alignas(CACHE_LINE_SIZE) std::atomic<uint64_t> spikes;
+    // pipeline thread only
+    alignas(CACHE_LINE_SIZE) Despike_Window_t windows[DESPIKE_CHANNELS];
+} Despike_Sensor_t;
+
+static int despike_mode = SAMPLE_DESPIKE_MARK;
+static int window_size = SAMPLE_DESPIKE_DEFAULT_WINDOW;
+static double threshold = SAMPLE_DESPIKE_DEFAULT_THRESHOLD;
+// of the running stage
+static int stage_mode = SAMPLE_DESPIKE_OFF;
+static Despike_Sensor_t* sensors = NULL;
+static int num_sensors = 0;
+
+/* treap of a window, ordered by value then node */
+
+static inline bool despike_less(const Despike_Node_t* nodes, int a, int b)
+{
+    return nodes[a].key < nodes[b].key or (nodes[a].key == nodes[b].key and a < b);
+}
+
+static inline void despike_update(Despike_Node_t* nodes, int t)
+{
+    int l = nodes[t].left, r = nodes[t].right;
+    nodes[t].size = 1 + (l < 0 ? 0 : nodes[l].size) + (r < 0 ? 0 : nodes[r].size);
+}
+
+/* nodes before n to *l, the others to *r */
+static void despike_split(Despike_Node_t* nodes, int t, int n, int* l, int* r)
+{
+    if (t < 0) {
+        *l = *r = -1;
+        return;
+    }
+    if (despike_less(nodes, t, n)) {
+        despike_split(nodes, nodes[t].right, n, &nodes[t].right, r);
+        *l = t;
+    }
+    else {
+        despike_split(nodes, nodes[t].left, n, l, &nodes[t].left);
+        *r = t;
+    }
+    despike_update(nodes, t);
+}
+
+/* every node of a before those of b */
+static int despike_merge(Despike_Node_t* nodes, int a, int b)
+{
+    if (a < 0)
+        return b;
+    if (b < 0)
+        return a;
+    if (nodes[a].priority > nodes[b].priority) {
+        nodes[a].right = despike_merge(nodes, nodes[a].right, b);
+        despike_update(nodes, a);
+        return a;
+    }
+    nodes[b].left = despike_merge(nodes, a, nodes[b].left);
+    despike_update(nodes, b);
+    return b;
+}
+
+static int despike_insert(Despike_Node_t* nodes, int t, int n)
+{
+    if (t < 0)
+        return n;
+    if (nodes[n].priority > nodes[t].priority) {
+        despike_split(nodes, t, n, &nodes[n].left, &nodes[n].right);
+        despike_update(nodes, n);
+        return n;
+    }
+    if (despike_less(nodes, n, t))
+        nodes[t].left = despike_insert(nodes, nodes[t].left, n);
+    else
+        nodes[t].right = despike_insert(nodes, nodes[t].right, n);
+    despike_update(nodes, t);
+    return t;
+}
+
+static int despike_erase(Despike_Node_t* nodes, int t, int n)
+{
+    if (t == n)
+        return despike_merge(nodes, nodes[t].left, nodes[t].right);
+    if (despike_less(nodes, n, t))
+        nodes[t].left = despike_erase(nodes, nodes[t].left, n);
+    else
+        nodes[t].right = despike_erase(nodes, nodes[t].right, n);
+    despike_update(nodes, t);
+    return t;
+}
+
+/* k-th smallest value, from 0 */
+static float despike_select(const Despike_Window_t* w, int k)
+{
+    const Despike_Node_t* nodes = w->nodes.data();
+    int t = w->root;
+    for (;;) {
+        int l = nodes[t].left;
+        int ls = l < 0 ? 0 : nodes[l].size;
+        if (k < ls)
+            t = l;
+        else if (k == ls)
+            return nodes[t].key;
+        else {
+            k -= ls + 1;
+            t = nodes[t].right;
+        }
+    }
+}
+
+void despike_window_init(Despike_Window_t* w, int capacity)
+{
+    w->capacity = capacity;
+    w->count = 0;
+    w->head = 0;
+    w->root = -1;
+    w->seed = 2463534242u;
+    w->nodes.resize(capacity);
+}
+
+void despike_window_push(Despike_Window_t* w, float x)
+{
+    Despike_Node_t* nodes = w->nodes.data();
+    int n = w->head;
+    if (w->count == w->capacity)
+        w->root = despike_erase(nodes, w->root, n);
+    else
+        w->count++;
+    w->head = w->head+1 == w->capacity ? 0 : w->head+1;
+
+    // xorshift32
+    w->seed ^= w->seed << 13;
+    w->seed ^= w->seed >> 17;
+    w->seed ^= w->seed << 5;
+    nodes[n].key = x;
+    nodes[n].priority = w->seed;
+    nodes[n].left = nodes[n].right = -1;
+    nodes[n].size = 1;
+    w->root = despike_insert(nodes, w->root, n);
+}
+
+float despike_window_median(const Despike_Window_t* w)
+{
+    return despike_select(w, (w->count-1)/2);
+}
+
+/* lower median of the distances to the median: with the values sorted,
+ * those from the median up and from below it down are two ascending runs
+ * of distances, A and B, and the median of the distances is their k-th
+ * smallest merged, found by bisecting how many come from A */
+float despike_window_mad(const Despike_Window_t* w, float median)
+{
+    const int n = w->count, h = (n-1)/2, k = (n-1)/2;
+    const int na = n - h, nb = h; // A[i] = s[h+i] - m, B[j] = m - s[h-1-j]
+    int lo = k+1 - nb > 0 ? k+1 - nb : 0;
+    int hi = k+1 < na ? k+1 : na;
+    for (;;) {
+        int i = (lo + hi)/2, j = k+1 - i;
+        float a_prev = i > 0 ? despike_select(w, h+i-1) - median : -INFINITY;
+        float b_next = j < nb ? median - despike_select(w, h-1-j) : INFINITY;
+        if (a_prev > b_next) {
+            hi = i-1;
+            continue;
+        }
+        float b_prev = j > 0 ? median - despike_select(w, h-j) : -INFINITY;
+        float a_next = i < na ? despike_select(w, h+i) - median : INFINITY;
+        if (b_prev > a_next) {
+            lo = i+1;
+            continue;
+        }
+        return a_prev > b_prev ? a_prev : b_prev;
+    }
+}
+
+/* pipeline stage, right after the journal */
+static void sample_despike_stage(int index, Anemometer_Data_t* samples, int n, void* arg)
+{
+    if (stage_mode == SAMPLE_DESPIKE_OFF or index < 0 or index >= num_sensors)
+        return;
+    Despike_Sensor_t* sensor = &sensors[index];
+
+    for (int i = 0; i < n; i++) {
+        Anemometer_Data_t* sample = &samples[i];
+        if (sample->status != 0)
+            continue;
+        float* x[DESPIKE_CHANNELS] = {&sample->speed[0], &sample->speed[1], &sample->speed[2],
+            &sample->temperature};
+        float raw[DESPIKE_CHANNELS];
+        bool spike = false;
+        for (int c = 0; c < DESPIKE_CHANNELS; c++) {
+            Despike_Window_t* w = &sensor->windows[c];
+            raw[c] = *x[c];
+            if (2*w->count <= w->capacity) // too few yet
+                continue;
+            float median = despike_window_median(w);
+            double sigma = DESPIKE_MAD_SIGMA*despike_window_mad(w, median);
+            if (sigma < SAMPLE_DESPIKE_MIN_SIGMA)
+                sigma = SAMPLE_DESPIKE_MIN_SIGMA;
+            if (fabs(raw[c] - median) > threshold*sigma) {
+                spike = true;
+                if (stage_mode == SAMPLE_DESPIKE_REPLACE)
+                    *x[c] = median;
+            }
+        }
+        for (int c = 0; c < DESPIKE_CHANNELS; c++)
+            despike_window_push(&sensor->windows[c], raw[c]);
+        if (spike) {
+            anemometer_counter_add(sensor->spikes, 1);
+            if (stage_mode == SAMPLE_DESPIKE_MARK)
+                sample->status |= SAMPLE_DESPIKE_STATUS;
+        }
+    }
+}
+
+bool sample_despike_set(int mode, int window, double thresh)
+{
+    if (mode < SAMPLE_DESPIKE_OFF or mode > SAMPLE_DESPIKE_REPLACE or window < 3
+            or window > SAMPLE_DESPIKE_MAX_WINDOW or !(thresh > 0.))
+        return false;
+    despike_mode = mode;
+    window_size = window;
+    threshold = thresh;
+    return true;
+}
+
+bool sample_despike_start(int n_sensors)
+{
+    if (n_sensors < 1)
+        return false;
+
+    for (int i = 0; i < num_sensors; i++)
+        sensors[i].~Despike_Sensor_t();
+    free(sensors);
+    sensors = NULL;
+    num_sensors = 0;
+    sample_pipeline_remove_stage(&sample_despike_stage, NULL);
+    stage_mode = despike_mode;
+    if (stage_mode == SAMPLE_DESPIKE_OFF)
+        return true;
+
+    // operator new does not honour the cache line alignment before C++17
+    void* block;
+    if (posix_memalign(&block, CACHE_LINE_SIZE, n_sensors*sizeof(Despike_Sensor_t)) != 0)
+        return false;
+    sensors = (Despike_Sensor_t*)block;
+    for (int i = 0; i < n_sensors; i++) {
+        Despike_Sensor_t* sensor = new (&sensors[i]) Despike_Sensor_t();
+        sensor->spikes.store(0);
+        for (int c = 0; c < DESPIKE_CHANNELS; c++)
+            despike_window_init(&sensor->windows[c], window_size);
+    }
+    num_sensors = n_sensors;
+
+    // after the journal, which keeps the raw samples, ahead of everything else
+    return sample_pipeline_add_stage(&sample_despike_stage, NULL, SAMPLE_STAGE_FILTER);
+}
+
+uint64_t sample_despike_get_count(int index)
+{
+    if (index < 0 or index >= num_sensors)
+        return 0;
+    return sensors[index].spikes.load(std::memory_order_relaxed);
+}
+
+/* End of sample_despike.cxx */
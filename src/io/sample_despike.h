@@ -0,0 +1,75 @@
+/*
+ * Despiking
+ *
+ * A stage of the sample pipeline right after the journal, ahead of the
+ * history, the recorder and everything else: every good sample of a
+ * sensor is tested against the last SAMPLE_DESPIKE_DEFAULT_WINDOW samples
+ * before it, u, v, w and T on their own. A value further than threshold
+ * robust sigmas (1.4826 times the median absolute deviation, no less than
+ * SAMPLE_DESPIKE_MIN_SIGMA) from the window's median is a spike, and the
+ * sample is either marked, SAMPLE_DESPIKE_STATUS or-ed into its status so
+ * the stages after leave it out like any flagged sample, or the spiking
+ * values are replaced by the medians. The journal of a recording keeps the
+ * raw samples either way.
+ *
+ * A window keeps its samples in a treap ordered by value, in a node pool
+ * indexed like the ring of arrival order: adding a sample and dropping the
+ * oldest take O(log w), the median a select, the MAD O(log^2 w) selects,
+ * as the smallest of the distances on both sides of the median merged.
+ * Windows take the raw values, spikes included, the median does not mind.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef SAMPLE_DESPIKE_H
+#define SAMPLE_DESPIKE_H
+
+#include <stdint.h>
+#include <vector>
+#include "io/serial_anemometers.h"
+
+#define SAMPLE_DESPIKE_DEFAULT_WINDOW       63 // samples, 2 s at 32 Hz
+#define SAMPLE_DESPIKE_MAX_WINDOW           4095
+#define SAMPLE_DESPIKE_DEFAULT_THRESHOLD    6. // robust sigmas
+#define SAMPLE_DESPIKE_MIN_SIGMA            0.02 // m/s & degC, keeps quantized calm data from spiking
+#define SAMPLE_DESPIKE_STATUS               0x10000 // or-ed into the status of a marked sample
+
+/* what is done with spikes */
+enum {
+    SAMPLE_DESPIKE_OFF = 0,
+    SAMPLE_DESPIKE_MARK,
+    SAMPLE_DESPIKE_REPLACE
+};
+
+typedef struct {
+    float key;
+    uint32_t priority;
+    int left, right; // -1 if none
+    int size; // of the subtree
+} Despike_Node_t;
+
+/* sliding window of the last capacity values */
+typedef struct {
+    int capacity;
+    int count;
+    int head; // node of the oldest value once full, else the next free one
+    int root;
+    uint32_t seed;
+    std::vector<Despike_Node_t> nodes; // one per slot of the ring
+} Despike_Window_t;
+
+/* sample_despike.cxx */
+void despike_window_init(Despike_Window_t* w, int capacity);
+void despike_window_push(Despike_Window_t* w, float x); // drops the oldest once full
+float despike_window_median(const Despike_Window_t* w); // lower median, of a non-empty window
+float despike_window_mad(const Despike_Window_t* w, float median);
+/* settings of the next start */
+bool sample_despike_set(int mode, int window, double threshold);
+/* clears the windows and (re)adds the stage, called by the acquisition */
+bool sample_despike_start(int n_sensors);
+uint64_t sample_despike_get_count(int index); // spiking samples since the start
+
+#endif
+
+/* End of sample_despike.h */
@@ -0,0 +1,214 @@
+/*
+ * Sample history
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <algorithm>
+#include "io/sample_history.h"
+#include "io/sample_codec.h"
+
+/* chunk pool */
+static Sample_Chunk_t* pool_free = NULL;
+static pthread_mutex_t pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+Sample_Chunk_t* sample_pool_get(void)
+{
+    pthread_mutex_lock(&pool_mutex);
+    if (pool_free == NULL) {
+        // chunks are never handed back to the system, the caps bound the pool
+        Sample_Chunk_t* slab = (Sample_Chunk_t*)malloc(SAMPLE_POOL_SLAB*sizeof(Sample_Chunk_t));
+        if (slab == NULL) {
+            pthread_mutex_unlock(&pool_mutex);
+            return NULL;
+        }
+        for (int i = 0; i < SAMPLE_POOL_SLAB; i++) {
+            slab[i].next_free = pool_free;
+            pool_free = &slab[i];
+        }
+    }
+    Sample_Chunk_t* chunk = pool_free;
+    pool_free = chunk->next_free;
+    pthread_mutex_unlock(&pool_mutex);
+
+    chunk->count = 0;
+    chunk->next_free = NULL;
+    return chunk;
+}
+
+void sample_pool_put(Sample_Chunk_t* chunk)
+{
+    if (chunk == NULL)
+        return;
+    pthread_mutex_lock(&pool_mutex);
+    chunk->next_free = pool_free;
+    pool_free = chunk;
+    pthread_mutex_unlock(&pool_mutex);
+}
+
+/* history */
+Sample_History::Sample_History() : num_samples(0), evicted(0), compress(false), block_bytes(0)
+{
+    pthread_mutex_init(&mutex, NULL);
+    set_cap(SAMPLE_HISTORY_DEFAULT_CAP);
+}
+
+Sample_History::~Sample_History()
+{
+    clear();
+    pthread_mutex_destroy(&mutex);
+}
+
+/* call with the lock held */
+void Sample_History::freeze_oldest_chunk(void)
+{
+    Sample_Chunk_t* chunk = chunks.front();
+    chunks.pop_front();
+    if (chunk->count > 0) {
+        code.clear();
+        sample_block_encode(chunk->samples, chunk->count, &code);
+        blocks.push_back(Sample_Block_t());
+        Sample_Block_t* block = &blocks.back();
+        block->first_t = chunk->samples[0].t;
+        block->last_t = chunk->samples[chunk->count-1].t;
+        block->count = chunk->count;
+        block->bits.assign(code.begin(), code.end()); // exact size
+        block_bytes += block->bits.capacity()*sizeof(uint64_t) + sizeof(Sample_Block_t);
+    }
+    sample_pool_put(chunk);
+}
+
+/* call with the lock held */
+void Sample_History::evict_blocks(void)
+{
+    while (!blocks.empty() and memory() > cap) {
+        Sample_Block_t* block = &blocks.front();
+        num_samples -= block->count;
+        evicted += block->count;
+        block_bytes -= block->bits.capacity()*sizeof(uint64_t) + sizeof(Sample_Block_t);
+        blocks.pop_front();
+    }
+}
+
+void Sample_History::set_cap(size_t bytes)
+{
+    pthread_mutex_lock(&mutex);
+    cap = bytes;
+    max_chunks = bytes / sizeof(Sample_Chunk_t);
+    if (max_chunks < 2) max_chunks = 2;
+    if (compress and max_chunks > SAMPLE_HISTORY_HOT_CHUNKS)
+        max_chunks = SAMPLE_HISTORY_HOT_CHUNKS;
+    while (chunks.size() > max_chunks) {
+        if (compress)
+            freeze_oldest_chunk();
+        else {
+            num_samples -= chunks.front()->count;
+            evicted += chunks.front()->count;
+            sample_pool_put(chunks.front());
+            chunks.pop_front();
+        }
+    }
+    evict_blocks();
+    pthread_mutex_unlock(&mutex);
+}
+
+/* takes effect for the chunks filled from now on */
+void Sample_History::set_compression(bool on)
+{
+    pthread_mutex_lock(&mutex);
+    compress = on;
+    pthread_mutex_unlock(&mutex);
+    set_cap(cap);
+}
+
+void Sample_History::append(const Anemometer_Data_t* samples, int n)
+{
+    pthread_mutex_lock(&mutex);
+    while (n > 0) {
+        if (chunks.empty() or chunks.back()->count == SAMPLE_CHUNK_SIZE) {
+            Sample_Chunk_t* chunk;
+            if (compress and chunks.size() >= max_chunks) {
+                freeze_oldest_chunk();
+                evict_blocks();
+                if ((chunk = sample_pool_get()) == NULL)
+                    break;
+            }
+            else if (chunks.size() >= max_chunks) { // recycle the oldest chunk
+                chunk = chunks.front();
+                chunks.pop_front();
+                num_samples -= chunk->count;
+                evicted += chunk->count;
+                chunk->count = 0;
+            }
+            else if ((chunk = sample_pool_get()) == NULL)
+                break;
+            chunks.push_back(chunk);
+        }
+        Sample_Chunk_t* tail = chunks.back();
+        int room = SAMPLE_CHUNK_SIZE - tail->count;
+        int m = n < room ? n : room;
+        memcpy(&tail->samples[tail->count], samples, m*sizeof(Anemometer_Data_t));
+        tail->count += m;
+        num_samples += m;
+        samples += m;
+        n -= m;
+    }
+    pthread_mutex_unlock(&mutex);
+}
+
+void Sample_History::clear(void)
+{
+    pthread_mutex_lock(&mutex);
+    while (!chunks.empty()) {
+        sample_pool_put(chunks.front());
+        chunks.pop_front();
+    }
+    blocks.clear();
+    block_bytes = 0;
+    num_samples = 0;
+    evicted = 0;
+    pthread_mutex_unlock(&mutex);
+}
+
+static bool sample_before(const Anemometer_Data_t& sample, int64_t t)
+{
+    return sample.t < t;
+}
+
+/* visit the part of a run of samples within [t0, t1), returns its size */
+static size_t sample_visit_range(const Anemometer_Data_t* samples, int n, int64_t t0, int64_t t1,
+        Sample_Visitor_t visit, void* arg)
+{
+    const Anemometer_Data_t* first = std::lower_bound(samples, samples+n, t0, sample_before);
+    const Anemometer_Data_t* last = std::lower_bound(first, samples+n, t1, sample_before);
+    if (last > first)
+        visit(first, last - first, arg);
+    return last - first;
+}
+
+size_t Sample_History::scan(int64_t t0, int64_t t1, Sample_Visitor_t visit, void* arg)
+{
+    size_t count = 0;
+    pthread_mutex_lock(&mutex);
+    for (size_t b = 0; b < blocks.size(); b++) {
+        const Sample_Block_t* block = &blocks[b];
+        if (block->last_t < t0 or block->first_t >= t1)
+            continue;
+        if (decoded.size() < (size_t)block->count)
+            decoded.resize(SAMPLE_CHUNK_SIZE > block->count ? SAMPLE_CHUNK_SIZE : block->count);
+        sample_block_decode(block->bits.data(), block->bits.size(), block->count, decoded.data());
+        count += sample_visit_range(decoded.data(), block->count, t0, t1, visit, arg);
+    }
+    for (size_t c = 0; c < chunks.size(); c++) {
+        const Sample_Chunk_t* chunk = chunks[c];
+        if (chunk->count == 0 or chunk->samples[chunk->count-1].t < t0 or chunk->samples[0].t >= t1)
+            continue;
+        count += sample_visit_range(chunk->samples, chunk->count, t0, t1, visit, arg);
+    }
+    pthread_mutex_unlock(&mutex);
+    return count;
+}
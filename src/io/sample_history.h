@@ -0,0 +1,96 @@
+/*
+ * Sample history
+ *
+ * Segmented, append-only storage of anemometer samples. Samples are kept
+ * in fixed-size chunks taken from a shared pool, so appending never
+ * reallocates or copies what is already stored; once the memory cap of a
+ * history is reached its oldest chunk is handed back to the pool.
+ *
+ * With compression on, only the newest SAMPLE_HISTORY_HOT_CHUNKS chunks stay
+ * as they are, older chunks are frozen into blocks coded by sample_codec
+ * (some 20 bytes a sample instead of 32 on turbulent 32 Hz data), which
+ * are dropped oldest first at the cap instead. scan() goes through both
+ * tiers by time.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef SAMPLE_HISTORY_H
+#define SAMPLE_HISTORY_H
+
+#include <stddef.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <deque>
+#include <vector>
+#include "io/serial_anemometers.h"
+
+#define SAMPLE_CHUNK_SIZE       4096 // samples per chunk
+#define SAMPLE_POOL_SLAB        16 // chunks allocated at once when the pool runs dry
+#define SAMPLE_HISTORY_DEFAULT_CAP  (64UL*1024*1024) // bytes per sensor, about a day at 32 Hz (uncompressed)
+#define SAMPLE_HISTORY_HOT_CHUNKS   2 // newest chunks not compressed
+
+typedef struct Sample_Chunk {
+    Anemometer_Data_t samples[SAMPLE_CHUNK_SIZE];
+    int count;
+    struct Sample_Chunk* next_free;
+} Sample_Chunk_t;
+
+/* a frozen chunk */
+typedef struct {
+    int64_t first_t; // ns
+    int64_t last_t;
+    int count;
+    std::vector<uint64_t> bits; // sample_block_encode()
+} Sample_Block_t;
+
+/* visitor of scan(), gets runs of samples in time order */
+typedef void (*Sample_Visitor_t)(const Anemometer_Data_t* samples, int n, void* arg);
+
+/* pool of chunks shared by all histories */
+Sample_Chunk_t* sample_pool_get(void);
+void sample_pool_put(Sample_Chunk_t*);
+
+class Sample_History
+{
+public:
+    Sample_History();
+    ~Sample_History();
+    /* writer side */
+    void append(const Anemometer_Data_t* samples, int n);
+    void clear(void);
+    void set_cap(size_t bytes);
+    void set_compression(bool);
+    /* reader side, samples with t0 <= t < t1 of both tiers, decoding the
+     * blocks in range one at a time with the lock held; returns the count */
+    size_t scan(int64_t t0, int64_t t1, Sample_Visitor_t visit, void* arg);
+    /* reader side, hold the lock while walking the uncompressed chunks */
+    void lock(void) { pthread_mutex_lock(&mutex); }
+    void unlock(void) { pthread_mutex_unlock(&mutex); }
+    int num_chunks(void) const { return chunks.size(); }
+    const Anemometer_Data_t* chunk(int i, int* n) const {
+        *n = chunks[i]->count;
+        return chunks[i]->samples;
+    }
+    int num_blocks(void) const { return blocks.size(); }
+    size_t size(void) const { return num_samples; } // both tiers
+    size_t num_evicted(void) const { return evicted; }
+    size_t memory(void) const { return chunks.size()*sizeof(Sample_Chunk_t) + block_bytes; }
+private:
+    void freeze_oldest_chunk(void);
+    void evict_blocks(void);
+    std::deque<Sample_Chunk_t*> chunks; // oldest first
+    std::deque<Sample_Block_t> blocks; // oldest first, all older than chunks
+    size_t num_samples;
+    size_t evicted; // samples dropped because of the cap
+    size_t cap; // bytes
+    size_t max_chunks;
+    bool compress;
+    size_t block_bytes; // of blocks
+    std::vector<uint64_t> code; // scratch of freeze_oldest_chunk()
+    std::vector<Anemometer_Data_t> decoded; // scratch of scan()
+    pthread_mutex_t mutex;
+};
+
+#endif
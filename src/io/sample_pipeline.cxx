@@ -0,0 +1,120 @@
+/*
+ * Sample pipeline
+ *
+ * The single consumer of the per-sensor sample rings. A thread drains every
+ * ring at a fixed interval and passes the batches through the registered
+ * stages (history, recorder, ...), so nothing downstream ever runs on the
+ * serial reading threads.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h> // nanosleep()
+#include "io/sample_pipeline.h"
+
+typedef struct {
+    Sample_Stage_t func;
+    void* arg;
+    int rank;
+} Sample_Stage_Entry_t;
+
+static Sample_Stage_Entry_t stages[SAMPLE_PIPELINE_MAX_STAGES];
+static int num_stages = 0;
+static pthread_mutex_t stages_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static pthread_t pipeline_thread_handle;
+static int num_sensors = 0;
+static volatile bool exit_thread = false;
+static bool running = false;
+
+static void sample_pipeline_pass(void)
+{
+    Anemometer_Data_t batch[SAMPLE_PIPELINE_BATCH];
+
+    for (int idx = 0; idx < num_sensors; idx++) {
+        int n;
+        do {
+            n = sonic_anemometer_drain(idx, batch, SAMPLE_PIPELINE_BATCH);
+            if (n <= 0)
+                break;
+            pthread_mutex_lock(&stages_mutex);
+            for (int s = 0; s < num_stages; s++)
+                stages[s].func(idx, batch, n, stages[s].arg);
+            pthread_mutex_unlock(&stages_mutex);
+        } while (n == SAMPLE_PIPELINE_BATCH);
+    }
+}
+
+static void* sample_pipeline_loop(void* args)
+{
+    struct timespec req;
+    req.tv_sec = 0;
+    req.tv_nsec = SAMPLE_PIPELINE_PERIOD_MS*1000000L;
+
+    while (!exit_thread) {
+        sample_pipeline_pass();
+        nanosleep(&req, NULL);
+    }
+    sample_pipeline_pass(); // what arrived before readers stopped
+    return 0;
+}
+
+bool sample_pipeline_start(int n_sensors)
+{
+    if (running)
+        return false;
+
+    num_sensors = n_sensors;
+    exit_thread = false;
+    if (pthread_create(&pipeline_thread_handle, NULL, &sample_pipeline_loop, NULL) != 0)
+        return false;
+    running = true;
+    return true;
+}
+
+/* call after the serial readers have stopped, so that every sample is passed on */
+void sample_pipeline_stop(void)
+{
+    if (!running)
+        return;
+    exit_thread = true;
+    pthread_join(pipeline_thread_handle, NULL);
+    running = false;
+}
+
+bool sample_pipeline_add_stage(Sample_Stage_t func, void* arg, int rank)
+{
+    bool ok = false;
+    pthread_mutex_lock(&stages_mutex);
+    if (num_stages < SAMPLE_PIPELINE_MAX_STAGES) {
+        int s = num_stages;
+        while (s > 0 and stages[s-1].rank > rank)
+            s--;
+        for (int k = num_stages; k > s; k--)
+            stages[k] = stages[k-1];
+        stages[s].func = func;
+        stages[s].arg = arg;
+        stages[s].rank = rank;
+        num_stages++;
+        ok = true;
+    }
+    pthread_mutex_unlock(&stages_mutex);
+    return ok;
+}
+
+void sample_pipeline_remove_stage(Sample_Stage_t func, void* arg)
+{
+    pthread_mutex_lock(&stages_mutex);
+    for (int s = 0; s < num_stages; s++) {
+        if (stages[s].func == func and stages[s].arg == arg) {
+            for (int k = s; k < num_stages-1; k++)
+                stages[k] = stages[k+1];
+            num_stages--;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&stages_mutex);
+}
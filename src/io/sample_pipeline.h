@@ -0,0 +1,27 @@
+#ifndef SAMPLE_PIPELINE_H
+#define SAMPLE_PIPELINE_H
+
+#include "io/serial_anemometers.h"
+
+#define SAMPLE_PIPELINE_PERIOD_MS   20 // drain interval
+#define SAMPLE_PIPELINE_BATCH       256 // samples drained from a ring at once
+#define SAMPLE_PIPELINE_MAX_STAGES  16
+
+/* a stage gets every drained batch of a sensor, in order of rank then
+ * registration, and may modify the samples for the stages after it */
+typedef void (*Sample_Stage_t)(int index, Anemometer_Data_t* samples, int n, void* arg);
+
+/* ranks of stages, whatever order they are added in */
+enum {
+    SAMPLE_STAGE_JOURNAL = 0, // the samples as read, before anything changes them
+    SAMPLE_STAGE_FILTER, // cleans the samples for all consumers, e.g. despiking
+    SAMPLE_STAGE_CONSUMER
+};
+
+/* sample_pipeline.cxx */
+bool sample_pipeline_start(int n_sensors);
+void sample_pipeline_stop(void);
+bool sample_pipeline_add_stage(Sample_Stage_t, void*, int rank = SAMPLE_STAGE_CONSUMER); // last of its rank
+void sample_pipeline_remove_stage(Sample_Stage_t, void*);
+
+#endif
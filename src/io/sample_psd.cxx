@@ -0,0 +1,319 @@
+/*
+ * Streaming power spectral density
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <algorithm>
+#include <new>
+#include <vector>
+#include "io/sample_psd.h"
+#include "io/sample_pipeline.h"
+#include "io/spsc_ring.h" // CACHE_LINE_SIZE
+#include "io/fft.h"
+
+#define PSD_LANES (SAMPLE_PSD_CHANNELS*SAMPLE_PSD_BATCH)
+
+typedef struct {
+    // newest spectrum
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> seq;
+    Sample_Psd_Info_t info;
+    std::vector<float> psd;
+    // pipeline thread only
+    alignas(CACHE_LINE_SIZE) std::vector<float> ring; // last segment of samples, channels interleaved
+    std::vector<int64_t> times;
+    int head; // next in the ring, the oldest once it is full
+    int filled; // since the last gap
+    int fresh; // since the last segment taken
+    bool good; // last holds a good sample
+    float last[SAMPLE_PSD_CHANNELS];
+    int64_t last_t;
+    int64_t interval; // smoothed, ns
+    // average of the period
+    std::vector<double> sum; // periodograms times dt, of bins 0 to n/2 per channel
+    int segments; // in sum
+    int staged; // taken, not transformed yet
+    double dt_sum; // s, sample intervals of the segments
+    int64_t first_t, seg_last_t;
+    int64_t period_end; // 0 before the first sample
+} Psd_Sensor_t;
+
+static int segment_next = SAMPLE_PSD_DEFAULT_SEGMENT;
+static double period_seconds = SAMPLE_PSD_DEFAULT_PERIOD_S;
+static Sample_Psd_Callback_t callback = NULL;
+static void* callback_arg = NULL;
+// of the running stage
+static int segment = 0; // 0 when disabled
+static int n_bins = 0;
+static int64_t period_width = 0; // ns
+static int64_t period_offset = 0; // wall clock minus CLOCK_MONOTONIC, aligns the periods
+static Fft_Real_Plan_t plan;
+static std::vector<float> window; // Hann, periodic
+static double window_power = 0.; // sum of squares
+static Psd_Sensor_t* sensors = NULL;
+static int num_sensors = 0;
+// segments of any sensors waiting to be transformed together
+static std::vector<float> stage_x; // segment*PSD_LANES
+static std::vector<float> stage_re, stage_im; // n_bins*PSD_LANES
+static int stage_owner[SAMPLE_PSD_BATCH];
+static double stage_dt[SAMPLE_PSD_BATCH];
+static int n_staged = 0;
+
+/* transforms the staged segments into the sums of their sensors */
+static void psd_flush(void)
+{
+    if (n_staged == 0)
+        return;
+    fft_real_batch(&plan, stage_x.data(), stage_re.data(), stage_im.data(), PSD_LANES);
+    for (int slot = 0; slot < n_staged; slot++) {
+        Psd_Sensor_t* sensor = &sensors[stage_owner[slot]];
+        const double scale = stage_dt[slot]/window_power;
+        for (int c = 0; c < SAMPLE_PSD_CHANNELS; c++) {
+            const float* re = stage_re.data() + slot*SAMPLE_PSD_CHANNELS + c;
+            const float* im = stage_im.data() + slot*SAMPLE_PSD_CHANNELS + c;
+            double* sum = sensor->sum.data() + c*n_bins;
+            for (int k = 0; k < n_bins; k++)
+                sum[k] += scale*((double)re[k*PSD_LANES]*re[k*PSD_LANES] + (double)im[k*PSD_LANES]*im[k*PSD_LANES]);
+        }
+        sensor->segments++;
+        sensor->staged--;
+        sensor->dt_sum += stage_dt[slot];
+    }
+    n_staged = 0;
+}
+
+/* the ring, mean removed and windowed, into a free slot */
+static void psd_take(int index, Psd_Sensor_t* sensor)
+{
+    if (n_staged == SAMPLE_PSD_BATCH)
+        psd_flush();
+    const int slot = n_staged++;
+    const int mask = segment-1;
+
+    double mean[SAMPLE_PSD_CHANNELS] = {0.};
+    for (int k = 0; k < segment; k++)
+        for (int c = 0; c < SAMPLE_PSD_CHANNELS; c++)
+            mean[c] += sensor->ring[k*SAMPLE_PSD_CHANNELS + c];
+    for (int c = 0; c < SAMPLE_PSD_CHANNELS; c++)
+        mean[c] /= segment;
+    float* out = stage_x.data() + slot*SAMPLE_PSD_CHANNELS;
+    for (int k = 0; k < segment; k++) {
+        const float* in = sensor->ring.data() + ((sensor->head + k) & mask)*SAMPLE_PSD_CHANNELS;
+        for (int c = 0; c < SAMPLE_PSD_CHANNELS; c++)
+            out[k*PSD_LANES + c] = (float)((in[c] - mean[c])*window[k]);
+    }
+
+    int64_t t0 = sensor->times[sensor->head];
+    int64_t t1 = sensor->times[(sensor->head + mask) & mask];
+    stage_owner[slot] = index;
+    stage_dt[slot] = (t1 - t0)/1e9/mask;
+    if (sensor->segments + sensor->staged == 0)
+        sensor->first_t = t0;
+    sensor->seg_last_t = t1;
+    sensor->staged++;
+}
+
+/* the average of the period, one-sided */
+static void psd_publish(int index, Psd_Sensor_t* sensor)
+{
+    if (sensor->staged > 0)
+        psd_flush();
+    if (sensor->segments == 0)
+        return;
+
+    Sample_Psd_Info_t info;
+    info.first_t = sensor->first_t;
+    info.last_t = sensor->seg_last_t;
+    info.segments = sensor->segments;
+    info.n_bins = n_bins;
+    info.df = (float)(sensor->segments/(sensor->dt_sum*segment));
+
+    // odd sequence while writing
+    unsigned int seq = sensor->seq.load(std::memory_order_relaxed);
+    sensor->seq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    sensor->info = info;
+    for (int c = 0; c < SAMPLE_PSD_CHANNELS; c++)
+        for (int k = 0; k < n_bins; k++) {
+            double p = sensor->sum[c*n_bins + k]/sensor->segments;
+            sensor->psd[c*n_bins + k] = (float)(k == 0 or k == n_bins-1 ? p : 2.*p);
+        }
+    sensor->seq.store(seq+2, std::memory_order_release);
+
+    if (callback)
+        callback(index, &info, sensor->psd.data(), callback_arg);
+
+    std::fill(sensor->sum.begin(), sensor->sum.end(), 0.);
+    sensor->segments = 0;
+    sensor->dt_sum = 0.;
+}
+
+static int64_t psd_period_start(int64_t t)
+{
+    int64_t r = (t + period_offset) % period_width;
+    return t - (r < 0 ? r + period_width : r);
+}
+
+/* pipeline stage */
+static void sample_psd_stage(int index, Anemometer_Data_t* samples, int n, void* arg)
+{
+    if (segment == 0 or index < 0 or index >= num_sensors)
+        return;
+    Psd_Sensor_t* sensor = &sensors[index];
+    const int mask = segment-1;
+
+    for (int i = 0; i < n; i++) {
+        const Anemometer_Data_t* sample = &samples[i];
+        if (sensor->period_end != 0 and sample->t >= sensor->period_end) {
+            psd_publish(index, sensor);
+            sensor->period_end = 0;
+        }
+        if (sensor->period_end == 0)
+            sensor->period_end = psd_period_start(sample->t) + period_width;
+
+        // a segment is evenly sampled or not taken
+        if (sensor->filled > 0) {
+            int64_t dt = sample->t - sensor->last_t;
+            if (sensor->interval == 0)
+                sensor->interval = dt;
+            else {
+                if (dt > ANEMOMETER_GAP_FACTOR*sensor->interval) {
+                    sensor->filled = 0;
+                    sensor->fresh = 0;
+                    dt = 4*sensor->interval; // as the acquisition's counters
+                }
+                sensor->interval += (dt - sensor->interval)/16;
+            }
+        }
+        sensor->last_t = sample->t;
+
+        if (sample->status == 0) {
+            sensor->last[0] = sample->speed[0];
+            sensor->last[1] = sample->speed[1];
+            sensor->last[2] = sample->speed[2];
+            sensor->last[3] = sample->temperature;
+            sensor->good = true;
+        }
+        else if (!sensor->good)
+            continue;
+        memcpy(&sensor->ring[sensor->head*SAMPLE_PSD_CHANNELS], sensor->last, sizeof(sensor->last));
+        sensor->times[sensor->head] = sample->t;
+        sensor->head = (sensor->head + 1) & mask;
+        if (sensor->filled < segment)
+            sensor->filled++;
+        if (++sensor->fresh >= segment/2 and sensor->filled == segment) {
+            psd_take(index, sensor);
+            sensor->fresh = 0;
+        }
+    }
+}
+
+bool sample_psd_set_segment(int n)
+{
+    if (n != 0 and (n < 64 or (n & (n-1)) != 0))
+        return false;
+    segment_next = n;
+    return true;
+}
+
+int sample_psd_get_num_bins(void)
+{
+    if (num_sensors > 0)
+        return n_bins;
+    return segment_next ? segment_next/2 + 1 : 0;
+}
+
+bool sample_psd_set_period(double seconds)
+{
+    if (!(seconds >= 1.))
+        return false;
+    period_seconds = seconds;
+    return true;
+}
+
+void sample_psd_set_callback(Sample_Psd_Callback_t func, void* arg)
+{
+    callback = func;
+    callback_arg = arg;
+}
+
+bool sample_psd_start(int n_sensors)
+{
+    static bool stage_added = false;
+    if (n_sensors < 1)
+        return false;
+
+    for (int i = 0; i < num_sensors; i++)
+        sensors[i].~Psd_Sensor_t();
+    free(sensors);
+    sensors = NULL;
+    num_sensors = 0;
+    segment = 0;
+    n_bins = 0;
+    n_staged = 0;
+    if (segment_next == 0)
+        return true;
+
+    if (!fft_real_plan(&plan, segment_next))
+        return false;
+    window.resize(segment_next);
+    window_power = 0.;
+    for (int k = 0; k < segment_next; k++) {
+        window[k] = (float)(0.5 - 0.5*cos(2.*M_PI*k/segment_next));
+        window_power += (double)window[k]*window[k];
+    }
+    int bins = segment_next/2 + 1;
+    stage_x.assign(segment_next*PSD_LANES, 0.f);
+    stage_re.assign(bins*PSD_LANES, 0.f);
+    stage_im.assign(bins*PSD_LANES, 0.f);
+
+    // operator new does not honour the cache line alignment before C++17
+    void* block;
+    if (posix_memalign(&block, CACHE_LINE_SIZE, n_sensors*sizeof(Psd_Sensor_t)) != 0)
+        return false;
+    sensors = (Psd_Sensor_t*)block;
+    for (int i = 0; i < n_sensors; i++) {
+        Psd_Sensor_t* sensor = new (&sensors[i]) Psd_Sensor_t();
+        sensor->seq.store(0);
+        memset(&sensor->info, 0, sizeof(sensor->info));
+        sensor->psd.assign(SAMPLE_PSD_CHANNELS*bins, 0.f);
+        sensor->ring.assign(SAMPLE_PSD_CHANNELS*segment_next, 0.f);
+        sensor->times.assign(segment_next, 0);
+        sensor->sum.assign(SAMPLE_PSD_CHANNELS*bins, 0.);
+    }
+    segment = segment_next;
+    n_bins = bins;
+    period_width = (int64_t)(period_seconds*1e9);
+    const Anemometer_Time_Anchor_t* anchor = sonic_anemometer_get_time_anchor();
+    period_offset = anchor->realtime - anchor->monotonic;
+    num_sensors = n_sensors;
+
+    if (!stage_added)
+        stage_added = sample_pipeline_add_stage(&sample_psd_stage, NULL);
+    return stage_added;
+}
+
+bool sample_psd_get(int index, Sample_Psd_Info_t* info, float* psd)
+{
+    if (index < 0 or index >= num_sensors)
+        return false;
+    Psd_Sensor_t* sensor = &sensors[index];
+
+    unsigned int seq0, seq1;
+    do {
+        seq0 = sensor->seq.load(std::memory_order_acquire);
+        *info = sensor->info;
+        memcpy(psd, sensor->psd.data(), sensor->psd.size()*sizeof(float));
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq1 = sensor->seq.load(std::memory_order_relaxed);
+    } while ((seq0 & 1) or seq0 != seq1);
+
+    return seq0 != 0; // false if none published yet
+}
+
+/* End of sample_psd.cxx */
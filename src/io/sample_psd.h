@@ -0,0 +1,61 @@
+/*
+ * Streaming power spectral density
+ *
+ * A pipeline stage estimating the spectra of u, v, w & T of every sensor
+ * by Welch's method: segments of SAMPLE_PSD_DEFAULT_SEGMENT samples
+ * overlapping by half, mean removed and Hann windowed, their periodograms
+ * averaged as they come. Every period (10 min unless set otherwise) the
+ * average so far is published and a new one begun, so each spectrum is
+ * the Welch estimate of one period.
+ *
+ * Segments are transformed SAMPLE_PSD_BATCH at a time, whichever sensors
+ * they come from, as one batch of interleaved signals (see fft.h). A
+ * segment never spans a gap in the data, the filling restarts after one;
+ * flagged samples (non-zero status) hold the previous good values.
+ *
+ * Published spectra are kept behind a sequence lock for the GUI and handed
+ * to a callback on the pipeline thread, which the recorder takes while
+ * recording (see record.h).
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef SAMPLE_PSD_H
+#define SAMPLE_PSD_H
+
+#include <stdint.h>
+#include "io/serial_anemometers.h"
+
+#define SAMPLE_PSD_CHANNELS         4 // u, v, w, T
+#define SAMPLE_PSD_DEFAULT_SEGMENT  1024 // samples, 32 s at 32 Hz
+#define SAMPLE_PSD_DEFAULT_PERIOD_S 600.
+#define SAMPLE_PSD_BATCH            4 // segments transformed together, 16 signals
+
+typedef struct {
+    int64_t first_t; // ns, CLOCK_MONOTONIC, of the first and last sample averaged
+    int64_t last_t;
+    int segments; // averaged
+    int n_bins; // segment/2 + 1, from 0 Hz
+    float df; // Hz between bins, from the sample rate
+} Sample_Psd_Info_t;
+
+/* psd holds n_bins values of u, then of v, w and T, one-sided, in
+ * (m/s)^2/Hz and K^2/Hz */
+typedef void (*Sample_Psd_Callback_t)(int index, const Sample_Psd_Info_t* info, const float* psd, void* arg);
+
+/* sample_psd.cxx */
+/* segment length of the next start, a power of two from 64, 0 to disable */
+bool sample_psd_set_segment(int n);
+int sample_psd_get_num_bins(void); // of the running stage, else of the next start; 0 if disabled
+bool sample_psd_set_period(double seconds);
+void sample_psd_set_callback(Sample_Psd_Callback_t, void* arg);
+/* clears the spectra and puts the stage in the pipeline, called by the
+ * acquisition */
+bool sample_psd_start(int n_sensors);
+/* newest spectrum of a sensor, psd of SAMPLE_PSD_CHANNELS*n_bins; false if none yet */
+bool sample_psd_get(int index, Sample_Psd_Info_t* info, float* psd);
+
+#endif
+
+/* End of sample_psd.h */
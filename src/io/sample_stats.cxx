@@ -0,0 +1,300 @@
+/*
+ * Streaming sample statistics
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <atomic>
+#include <deque>
+#include <new>
+#include "io/sample_stats.h"
+#include "io/sample_pipeline.h"
+#include "io/spsc_ring.h" // CACHE_LINE_SIZE
+
+#define STATS_NUM_PAIRS 10 // upper triangle of the 4x4 covariance matrix
+
+/* row & column of the pairs */
+static const int stats_pair_i[STATS_NUM_PAIRS] = {0, 0, 0, 0, 1, 1, 1, 2, 2, 3};
+static const int stats_pair_j[STATS_NUM_PAIRS] = {0, 1, 2, 3, 1, 2, 3, 2, 3, 3};
+
+typedef struct {
+    uint64_t n;
+    double mean[4]; // u, v, w, T
+    double m2[STATS_NUM_PAIRS]; // sums of products of deviations from the mean
+} Stats_Accum_t;
+
+typedef struct {
+    int64_t width; // ns
+    Stats_Accum_t acc;
+    uint64_t flagged;
+    uint64_t tail; // position of the oldest sample inside
+    uint64_t evicted; // samples removed since the window was last summed afresh
+} Stats_Window_t;
+
+typedef struct {
+    // snapshot, cumulative and the windows
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> seq;
+    Sample_Stats_t stats[1 + SAMPLE_STATS_MAX_WINDOWS];
+    // pipeline thread only
+    alignas(CACHE_LINE_SIZE) Stats_Accum_t total;
+    uint64_t total_flagged;
+    int64_t first_t, last_t;
+    Stats_Window_t windows[SAMPLE_STATS_MAX_WINDOWS];
+    std::deque<Anemometer_Data_t> samples; // of the widest window
+    uint64_t base; // position of samples.front()
+} Stats_Sensor_t;
+
+static double window_seconds[SAMPLE_STATS_MAX_WINDOWS] = {60., 600.};
+static int num_window_seconds = 2;
+static int num_windows = 0; // of the running statistics
+static Stats_Sensor_t* sensors = NULL;
+static int num_sensors = 0;
+
+static inline void stats_clear(Stats_Accum_t* acc)
+{
+    memset(acc, 0, sizeof(*acc));
+}
+
+static inline void stats_values(const Anemometer_Data_t* sample, double* x)
+{
+    x[0] = sample->speed[0];
+    x[1] = sample->speed[1];
+    x[2] = sample->speed[2];
+    x[3] = sample->temperature;
+}
+
+/* Welford */
+static inline void stats_add(Stats_Accum_t* acc, const double* x)
+{
+    double d[4], e[4];
+    acc->n++;
+    for (int f = 0; f < 4; f++) {
+        d[f] = x[f] - acc->mean[f];
+        acc->mean[f] += d[f]/acc->n;
+        e[f] = x[f] - acc->mean[f];
+    }
+    for (int k = 0; k < STATS_NUM_PAIRS; k++)
+        acc->m2[k] += d[stats_pair_i[k]]*e[stats_pair_j[k]];
+}
+
+/* the inverse of stats_add(), x must be in */
+static inline void stats_remove(Stats_Accum_t* acc, const double* x)
+{
+    if (acc->n <= 1) {
+        stats_clear(acc); // exactly empty, whatever rounding was left
+        return;
+    }
+    double d[4], e[4];
+    acc->n--;
+    for (int f = 0; f < 4; f++) {
+        d[f] = x[f] - acc->mean[f];
+        acc->mean[f] -= d[f]/acc->n;
+        e[f] = x[f] - acc->mean[f];
+    }
+    for (int k = 0; k < STATS_NUM_PAIRS; k++)
+        acc->m2[k] -= e[stats_pair_i[k]]*d[stats_pair_j[k]];
+}
+
+static void stats_resum(Stats_Sensor_t* sensor, Stats_Window_t* window)
+{
+    double x[4];
+    stats_clear(&window->acc);
+    for (uint64_t k = window->tail - sensor->base; k < sensor->samples.size(); k++)
+        if (sensor->samples[k].status == 0) {
+            stats_values(&sensor->samples[k], x);
+            stats_add(&window->acc, x);
+        }
+    window->evicted = 0;
+}
+
+static void stats_snapshot(const Stats_Accum_t* acc, uint64_t flagged, int64_t first_t, int64_t last_t,
+        Sample_Stats_t* stats)
+{
+    stats->first_t = first_t;
+    stats->last_t = last_t;
+    stats->count = acc->n;
+    stats->flagged = flagged;
+    for (int f = 0; f < 4; f++)
+        stats->mean[f] = acc->mean[f];
+    for (int k = 0; k < STATS_NUM_PAIRS; k++) {
+        double c = acc->n ? acc->m2[k]/acc->n : 0.;
+        stats->cov[stats_pair_i[k]][stats_pair_j[k]] = c;
+        stats->cov[stats_pair_j[k]][stats_pair_i[k]] = c;
+    }
+    double u = acc->mean[0], v = acc->mean[1];
+    stats->speed = sqrt(u*u + v*v);
+    if (stats->speed < SAMPLE_STATS_CALM) {
+        stats->direction = NAN;
+        stats->ti = NAN;
+        return;
+    }
+    stats->direction = atan2(-u, -v)*180./M_PI;
+    if (stats->direction < 0.)
+        stats->direction += 360.;
+    // variance along the mean wind
+    double var = (u*u*stats->cov[0][0] + 2.*u*v*stats->cov[0][1] + v*v*stats->cov[1][1])
+        /(stats->speed*stats->speed);
+    stats->ti = sqrt(var > 0. ? var : 0.)/stats->speed;
+}
+
+/* writer of the sequence lock, odd while writing */
+static void stats_publish(Stats_Sensor_t* sensor)
+{
+    unsigned int seq = sensor->seq.load(std::memory_order_relaxed);
+    sensor->seq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    stats_snapshot(&sensor->total, sensor->total_flagged, sensor->first_t, sensor->last_t,
+            &sensor->stats[SAMPLE_STATS_CUMULATIVE]);
+    for (int w = 0; w < num_windows; w++) {
+        Stats_Window_t* window = &sensor->windows[w];
+        int64_t first_t = window->tail - sensor->base < sensor->samples.size()
+            ? sensor->samples[window->tail - sensor->base].t : sensor->last_t;
+        stats_snapshot(&window->acc, window->flagged, first_t, sensor->last_t, &sensor->stats[1+w]);
+    }
+    sensor->seq.store(seq+2, std::memory_order_release);
+}
+
+/* pipeline stage */
+static void sample_stats_stage(int index, Anemometer_Data_t* samples, int n, void* arg)
+{
+    if (index < 0 or index >= num_sensors or n <= 0)
+        return;
+    Stats_Sensor_t* sensor = &sensors[index];
+
+    double x[4];
+    for (int i = 0; i < n; i++) {
+        const Anemometer_Data_t* sample = &samples[i];
+        if (sensor->total.n + sensor->total_flagged == 0)
+            sensor->first_t = sample->t;
+        sensor->last_t = sample->t;
+        if (sample->status == 0) {
+            stats_values(sample, x);
+            stats_add(&sensor->total, x);
+            for (int w = 0; w < num_windows; w++)
+                stats_add(&sensor->windows[w].acc, x);
+        }
+        else {
+            sensor->total_flagged++;
+            for (int w = 0; w < num_windows; w++)
+                sensor->windows[w].flagged++;
+        }
+        if (num_windows)
+            sensor->samples.push_back(*sample);
+    }
+
+    // windows end at the newest sample
+    uint64_t end = sensor->base + sensor->samples.size();
+    uint64_t oldest = end;
+    for (int w = 0; w < num_windows; w++) {
+        Stats_Window_t* window = &sensor->windows[w];
+        int64_t edge = sensor->last_t - window->width;
+        while (window->tail < end) {
+            const Anemometer_Data_t* sample = &sensor->samples[window->tail - sensor->base];
+            if (sample->t > edge)
+                break;
+            if (sample->status == 0) {
+                stats_values(sample, x);
+                stats_remove(&window->acc, x);
+            }
+            else
+                window->flagged--;
+            window->tail++;
+            window->evicted++;
+        }
+        if (window->evicted and window->evicted >= window->acc.n + window->flagged)
+            stats_resum(sensor, window);
+        if (window->tail < oldest)
+            oldest = window->tail;
+    }
+    for (; sensor->base < oldest; sensor->base++)
+        sensor->samples.pop_front();
+
+    stats_publish(sensor);
+}
+
+bool sample_stats_set_windows(const double* seconds, int n)
+{
+    if (n < 0 or n > SAMPLE_STATS_MAX_WINDOWS)
+        return false;
+    for (int w = 0; w < n; w++)
+        if (!(seconds[w] > 0.))
+            return false;
+    for (int w = 0; w < n; w++)
+        window_seconds[w] = seconds[w];
+    num_window_seconds = n;
+    return true;
+}
+
+int sample_stats_get_num_windows(void)
+{
+    return num_window_seconds;
+}
+
+double sample_stats_get_window(int window)
+{
+    return window >= 1 and window <= num_window_seconds ? window_seconds[window-1] : 0.;
+}
+
+bool sample_stats_start(int n_sensors)
+{
+    static bool stage_added = false;
+    if (n_sensors < 1)
+        return false;
+
+    for (int i = 0; i < num_sensors; i++)
+        sensors[i].~Stats_Sensor_t();
+    free(sensors);
+    sensors = NULL;
+    num_sensors = 0;
+    // operator new does not honour the cache line alignment before C++17
+    void* block;
+    if (posix_memalign(&block, CACHE_LINE_SIZE, n_sensors*sizeof(Stats_Sensor_t)) != 0)
+        return false;
+    sensors = (Stats_Sensor_t*)block;
+    num_windows = num_window_seconds;
+    for (int i = 0; i < n_sensors; i++) {
+        Stats_Sensor_t* sensor = new (&sensors[i]) Stats_Sensor_t();
+        sensor->seq.store(0);
+        memset(sensor->stats, 0, sizeof(sensor->stats));
+        stats_clear(&sensor->total);
+        sensor->total_flagged = 0;
+        sensor->first_t = sensor->last_t = 0;
+        for (int w = 0; w < num_windows; w++) {
+            Stats_Window_t* window = &sensor->windows[w];
+            window->width = (int64_t)(window_seconds[w]*1e9);
+            stats_clear(&window->acc);
+            window->flagged = 0;
+            window->tail = 0;
+            window->evicted = 0;
+        }
+        sensor->base = 0;
+    }
+    num_sensors = n_sensors;
+
+    if (!stage_added)
+        stage_added = sample_pipeline_add_stage(&sample_stats_stage, NULL);
+    return stage_added;
+}
+
+bool sample_stats_get(int index, int window, Sample_Stats_t* stats)
+{
+    if (index < 0 or index >= num_sensors or window < 0 or window > num_windows)
+        return false;
+    Stats_Sensor_t* sensor = &sensors[index];
+
+    unsigned int seq0, seq1;
+    do {
+        seq0 = sensor->seq.load(std::memory_order_acquire);
+        *stats = sensor->stats[window];
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq1 = sensor->seq.load(std::memory_order_relaxed);
+    } while ((seq0 & 1) or seq0 != seq1);
+
+    return seq0 != 0; // false if nothing received yet
+}
+
+/* End of sample_stats.cxx */
@@ -0,0 +1,58 @@
+/*
+ * Streaming sample statistics
+ *
+ * A pipeline stage keeping, per sensor, the mean and covariance matrix of
+ * u, v, w & T, the mean wind speed and direction and the turbulence
+ * intensity, since the start of acquisition and over sliding windows
+ * (1 min and 10 min unless set otherwise). Every sample is added once
+ * (Welford) and, leaving a window, removed once by the inverse update, so
+ * the cost per sample does not depend on the window length; a window is
+ * summed afresh from its samples each time all of them were replaced, to
+ * keep the rounding of the removals from piling up. Samples with a
+ * non-zero status are only counted.
+ *
+ * After every batch the statistics of a sensor are published to a
+ * snapshot behind a sequence lock, which the GUI reads every frame
+ * without ever holding up the pipeline.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef SAMPLE_STATS_H
+#define SAMPLE_STATS_H
+
+#include <stdint.h>
+#include "io/serial_anemometers.h"
+
+#define SAMPLE_STATS_MAX_WINDOWS    4
+#define SAMPLE_STATS_CUMULATIVE     0 // statistics since the start, windows are 1, 2, ...
+#define SAMPLE_STATS_CALM           0.05 // m/s, no direction nor turbulence intensity below
+
+typedef struct {
+    int64_t first_t; // ns, CLOCK_MONOTONIC, of the oldest and newest sample in
+    int64_t last_t;
+    uint64_t count; // samples with status 0
+    uint64_t flagged; // samples with another status, left out
+    double mean[4]; // u, v, w, T
+    double cov[4][4]; // population covariance of u, v, w, T
+    double speed; // m/s, of the mean horizontal wind
+    double direction; // deg, the mean wind blows from, clockwise from north; NAN if calm
+    double ti; // turbulence intensity, std of the along-wind component over speed; NAN if calm
+} Sample_Stats_t;
+
+/* sample_stats.cxx */
+/* window lengths of the next start, up to SAMPLE_STATS_MAX_WINDOWS */
+bool sample_stats_set_windows(const double* seconds, int n);
+int sample_stats_get_num_windows(void);
+double sample_stats_get_window(int window); // s, 0 for SAMPLE_STATS_CUMULATIVE
+/* clears the statistics and puts the stage in the pipeline, called by the
+ * acquisition before the first sample; stays in until the next start, so
+ * the last statistics can still be read after stopping */
+bool sample_stats_start(int n_sensors);
+/* latest snapshot of a sensor, false if it has no sample yet */
+bool sample_stats_get(int index, int window, Sample_Stats_t* stats);
+
+#endif
+
+/* End of sample_stats.h */
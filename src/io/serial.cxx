@@ -14,6 +14,8 @@
 #include <fcntl.h>   /* File control definitions */
 #include <errno.h>   /* Error number definitions */
 #include <termios.h> /* POSIX terminal control definitions */
+#include <time.h>    /* clock_gettime() */
+#include <stdint.h>
 #ifdef __linux
 #include <sys/ioctl.h>
 #endif
@@ -172,3 +174,10 @@ void serial_close(int fd)
 {
 	close(fd);
 }
+
+int64_t serial_clock_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec*1000000000LL + ts.tv_nsec;
+}
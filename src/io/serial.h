@@ -1,6 +1,7 @@
 #ifndef SERIAL_H
 #define SERIAL_H
 
+#include <stdint.h>
 #include <string>
 #include <vector>
 
@@ -10,5 +11,6 @@ bool serial_setup(int fd, int baud);
 bool serial_write(int, char*, int);
 int serial_read(int, char*, int);
 void serial_close(int fd);
+int64_t serial_clock_ns(void); // CLOCK_MONOTONIC, ns
 
 #endif
@@ -5,102 +5,565 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
 #include <string>
 #include <pthread.h>
 #include <time.h> // nanosleep()
 #include <vector>
 #include <cmath>
+#include <atomic>
+#include <new>
 #include "io/serial.h"
 #include "io/serial_anemometers.h"
-#include "io/serial_gill.h"
+#include "io/anemometer_driver.h"
+#include "io/capture.h"
+#include "io/replay.h"
+#include "io/serial_epoll.h"
+#include "io/spsc_ring.h"
+#include "io/sample_history.h"
+#include "io/sample_pipeline.h"
+#include "io/sample_despike.h"
+#include "io/sample_stats.h"
+#include "io/eddy_flux.h"
+#include "io/sample_psd.h"
+#include "io/cross_corr.h"
 
+// newest sample of a sensor, guarded by a sequence lock
+typedef struct {
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> seq;
+    Anemometer_Data_t data;
+} Anemometer_Latest_t;
+
+/* everything of one sensor, the registry keeps them contiguous in one
+ * cache-line aligned block; the fields touched for every byte and sample
+ * come first, each group starting on its own cache line */
+typedef struct Anemometer_Sensor_t {
+    alignas(CACHE_LINE_SIZE) unsigned char parser_state[SERIAL_ANEMOMETER_PARSER_STATE_SIZE];
+    alignas(CACHE_LINE_SIZE) Anemometer_Counters_t counters;
+    Anemometer_Latest_t latest;
+    SPSC_Ring<Anemometer_Data_t, SERIAL_ANEMOMETER_RING_SIZE> ring;
+    // cold
+    const Anemometer_Driver_t* driver;
+    Sample_History record;
+    int fd;
+    pthread_t read_thread_handle;
+    Anemometer_Thread_Arguments_t thread_args;
+    std::string port_path;
+    std::string type;
+} Anemometer_Sensor_t;
+
+static Anemometer_Sensor_t* sensors = NULL; // registry
+static int num_sensors = 0;
 static int num_ports = 0;
-static int fd[SERIAL_MAX_ANEMOMETERS]; // max number of sensors supported
-static pthread_t    read_thread_handle[SERIAL_MAX_ANEMOMETERS];
 static bool     exit_thread = false;
+static bool     running = false;
+static bool     replaying = false; // fed by a capture file instead of ports
+static int      acq_mode = ANEMOMETER_ACQ_EPOLL;
+static int      acq_threads = 1; // poller threads of epoll model
+static size_t   history_cap = SAMPLE_HISTORY_DEFAULT_CAP;
+static bool     history_compression = false;
+static std::string capture_file; // raw capture of the next session, empty if off
+static Anemometer_Time_Anchor_t time_anchor = {0, 0};
+
+/* pipeline stage keeping the sample history */
+static void history_stage(int index, Anemometer_Data_t* samples, int n, void* arg)
+{
+    sensors[index].record.append(samples, n);
+}
+
+static void sonic_anemometer_reset_counters(Anemometer_Counters_t* counters)
+{
+    counters->bytes.store(0);
+    counters->frames.store(0);
+    counters->checksum_failures.store(0);
+    counters->resyncs.store(0);
+    counters->gaps.store(0);
+    counters->last_t.store(0);
+    counters->interval.store(0);
+}
+
+static void sonic_anemometer_release(void)
+{
+    for (int i = 0; i < num_sensors; i++)
+        sensors[i].~Anemometer_Sensor_t();
+    free(sensors);
+    sensors = NULL;
+    num_sensors = 0;
+}
+
+bool sonic_anemometer_reserve(int n_sensors)
+{
+    if (running or n_sensors < 1)
+        return false;
+
+    sonic_anemometer_release();
+    // operator new does not honour the cache line alignment before C++17
+    void* block;
+    if (posix_memalign(&block, CACHE_LINE_SIZE, n_sensors*sizeof(Anemometer_Sensor_t)) != 0)
+        return false;
+    sensors = (Anemometer_Sensor_t*)block;
+    for (int i = 0; i < n_sensors; i++) {
+        new (&sensors[i]) Anemometer_Sensor_t();
+        memset(sensors[i].parser_state, 0, SERIAL_ANEMOMETER_PARSER_STATE_SIZE);
+        sonic_anemometer_reset_counters(&sensors[i].counters);
+        sensors[i].latest.seq.store(0);
+        memset(&sensors[i].latest.data, 0, sizeof(Anemometer_Data_t));
+        sensors[i].record.set_cap(history_cap);
+        sensors[i].record.set_compression(history_compression);
+        sensors[i].fd = -1;
+        sensors[i].driver = NULL;
+    }
+    num_sensors = n_sensors;
+
+    return true;
+}
+
+/* consumer of the sample rings, despiking right after the journal, then
+ * the history, statistics, fluxes and spectra, cleared for the new session;
+ * the cross-correlation reads the history */
+static bool sonic_anemometer_start_pipeline(int n)
+{
+    static bool history_stage_added = false;
+    if (!history_stage_added)
+        history_stage_added = sample_pipeline_add_stage(&history_stage, NULL);
+    if (!sample_despike_start(n) or !sample_stats_start(n) or !eddy_flux_start(n) or !sample_psd_start(n))
+        return false;
+    if (!sample_pipeline_start(n))
+        return false;
+    if (!cross_corr_start(n)) {
+        sample_pipeline_stop();
+        return false;
+    }
+    return true;
+}
+
+static void sonic_anemometer_stop_pipeline(void)
+{
+    cross_corr_stop();
+    sample_pipeline_stop();
+}
+
+/* tees every read chunk to the raw capture before parsing it */
+static void capture_tee(char* buf, int len, int index, int64_t t)
+{
+    WR_Capture_append(index, buf, len, t);
+    sensors[index].driver->process(buf, len, index, t);
+}
 
-static Anemometer_Thread_Arguments_t  thread_args[SERIAL_MAX_ANEMOMETERS];
-Anemometer_Data_t   wind_data[SERIAL_MAX_ANEMOMETERS];
-std::vector<Anemometer_Data_t> wind_record[SERIAL_MAX_ANEMOMETERS];
-std::string anemometer_port_path[SERIAL_MAX_ANEMOMETERS];
-std::string anemometer_type[SERIAL_MAX_ANEMOMETERS];
+/* raw capture of the bytes read in the next session, NULL to disable,
+ * call before sonic_anemometer_init */
+void sonic_anemometer_set_capture(const char* file_name)
+{
+    if (running) return;
+    capture_file = file_name ? file_name : "";
+}
+
+/* choose acquisition model, call before sonic_anemometer_init */
+void sonic_anemometer_set_acquisition(int mode, int n_threads)
+{
+    if (running) return;
+    acq_mode = mode;
+    acq_threads = n_threads;
+}
 
-bool sonic_anemometer_init(int n_ports = 1, std::string* ports = NULL, std::string* types = NULL)
+bool sonic_anemometer_init(int n_ports, const std::string* ports, const std::string* types)
 {
-    if (n_ports < 1 or n_ports > SERIAL_MAX_ANEMOMETERS)
+    if (running or n_ports < 1)
         return false;
 
     if (!ports or !types) return false;
 
+    // registry sized from the configuration
+    num_ports = 0;
+    if (!sonic_anemometer_reserve(n_ports))
+        return false;
+
     // open serial port
     for (int i = 0; i < n_ports; i++) {
-        fd[i] = serial_open(ports[i].c_str()); // blocking
-        if (fd[i] == -1)
-            return false;
-        if (types[i] == "Gill WindSonic") {
-            if (!serial_setup(fd[i], 9600)) // N81
-                return false;
-        }
-        else if (types[i] == "Gill WindMaster") {
-            if (!serial_setup(fd[i], 115200)) // N81
-                return false;
+        Anemometer_Sensor_t* sensor = &sensors[i];
+        sensor->port_path = ports[i];
+        sensor->type = types[i];
+        sensor->driver = anemometer_driver_find(types[i].c_str());
+        if (sensor->driver == NULL) { // type not recognized
+            fprintf(stderr, "ERROR: no driver for anemometer type \"%s\"\n", types[i].c_str());
+            goto fail;
         }
-        else
-            return false; // type not recognized
+        sensor->fd = serial_open(ports[i].c_str()); // blocking
+        if (sensor->fd == -1)
+            goto fail;
+        if (!serial_setup(sensor->fd, sensor->driver->baud)) // N81
+            goto fail;
+        sensor->driver->reset(i, sensor->driver->baud);
     }
 
-    // create thread for receiving anemometer measurements
+    // wall clock anchor of this session
+    struct timespec rt;
+    time_anchor.monotonic = serial_clock_ns();
+    clock_gettime(CLOCK_REALTIME, &rt);
+    time_anchor.realtime = (int64_t)rt.tv_sec*1000000000LL + rt.tv_nsec;
+
     exit_thread = false;
     num_ports = n_ports;
 
+    // raw bytes, after the anchor which goes into the capture header
+    if (!capture_file.empty() and !WR_Capture_start(capture_file.c_str(), n_ports))
+        goto fail;
+
+    // consumer of the sample rings
+    if (!sonic_anemometer_start_pipeline(n_ports))
+        goto fail;
+
+    // multiplex all ports through epoll
+    if (acq_mode == ANEMOMETER_ACQ_EPOLL) {
+        std::vector<Serial_Epoll_Handler_t> handlers(n_ports);
+        std::vector<int> fds(n_ports);
+        for (int i = 0; i < n_ports; i++) {
+            fds[i] = sensors[i].fd;
+            handlers[i] = WR_Capture_is_capturing() ? &capture_tee : sensors[i].driver->process;
+        }
+        if (!serial_epoll_start(n_ports, fds.data(), handlers.data(), acq_threads)) {
+            sonic_anemometer_stop_pipeline();
+            goto fail;
+        }
+        running = true;
+        return true;
+    }
+
+    // create thread for receiving anemometer measurements
     for (int i = 0; i < n_ports; i++) {
-        thread_args[i].arg = &exit_thread;
-        thread_args[i].index = i;
-        thread_args[i].fd = fd[i];
-        if (types[i] == "Gill WindSonic") {
-            if (pthread_create(&read_thread_handle[i], NULL, &gill_windsonic_read_loop, (void*)&thread_args[i]) != 0)
-                return false;
+        Anemometer_Sensor_t* sensor = &sensors[i];
+        sensor->thread_args.arg = &exit_thread;
+        sensor->thread_args.index = i;
+        sensor->thread_args.fd = sensor->fd;
+        sensor->thread_args.process = WR_Capture_is_capturing() ? &capture_tee : sensor->driver->process;
+        if (pthread_create(&sensor->read_thread_handle, NULL, &sonic_anemometer_read_loop, (void*)&sensor->thread_args) != 0) {
+            // stop the readers started so far, before the capture and pipeline they feed
+            exit_thread = true;
+            for (int j = 0; j < i; j++)
+                pthread_join(sensors[j].read_thread_handle, NULL);
+            sonic_anemometer_stop_pipeline();
+            goto fail;
         }
-        else if (types[i] == "Gill WindMaster") {
-            if (pthread_create(&read_thread_handle[i], NULL, &gill_windmaster_read_loop, (void*)&thread_args[i]) != 0)
-                return false;
+    }
+    running = true;
+
+    return true;
+
+fail:
+    if (WR_Capture_is_capturing()) {
+        WR_Capture_stop();
+        remove(capture_file.c_str());
+    }
+    for (int i = 0; i < n_ports; i++)
+        if (sensors[i].fd != -1) {
+            serial_close(sensors[i].fd);
+            sensors[i].fd = -1;
         }
+    num_ports = 0;
+    return false;
+}
+
+/* feed a raw capture file through the parsers instead of reading ports,
+ * speed 1 is real time, 0 as fast as possible, see replay.h */
+bool sonic_anemometer_init_replay(const char* capture_file, double speed, int n_threads)
+{
+    int n = 0;
+
+    if (running or !WR_Replay_open(capture_file, &n))
+        return false;
+
+    num_ports = 0;
+    if (!sonic_anemometer_reserve(n)) {
+        WR_Replay_stop();
+        return false;
+    }
+    std::vector<Serial_Epoll_Handler_t> handlers(n);
+    for (int i = 0; i < n; i++) {
+        const Capture_Sensor_Info_t* info = WR_Replay_get_sensor_info(i);
+        Anemometer_Sensor_t* sensor = &sensors[i];
+        sensor->port_path = std::string(info->port, strnlen(info->port, sizeof(info->port)));
+        sensor->type = std::string(info->type, strnlen(info->type, sizeof(info->type)));
+        sensor->driver = anemometer_driver_find(sensor->type.c_str());
+        if (sensor->driver == NULL) {
+            fprintf(stderr, "ERROR: no driver for anemometer type \"%s\"\n", sensor->type.c_str());
+            WR_Replay_stop();
+            return false;
+        }
+        sensor->driver->reset(i, sensor->driver->baud);
+        handlers[i] = sensor->driver->process;
+    }
+
+    // same wall clock as the captured session, on the replay clock
+    const Capture_File_Header_t* header = WR_Replay_get_header();
+    int64_t t_offset = serial_clock_ns() - WR_Replay_get_first_time();
+    time_anchor.realtime = header->time_anchor_realtime;
+    time_anchor.monotonic = header->time_anchor_monotonic + t_offset;
+
+    if (!sonic_anemometer_start_pipeline(n)) {
+        WR_Replay_stop();
+        return false;
+    }
+    if (!WR_Replay_start(handlers.data(), speed, n_threads, t_offset)) {
+        sonic_anemometer_stop_pipeline();
+        WR_Replay_stop();
+        return false;
     }
+    num_ports = n;
+    replaying = true;
+    running = true;
 
     return true;
 }
 
+bool sonic_anemometer_replay_done(void)
+{
+    return replaying and WR_Replay_is_done();
+}
+
 void sonic_anemometer_close(void)
 {
-    if (!exit_thread and num_ports) // if still running
+    if (running and num_ports) // if still running
     {
         // exit threads
-        exit_thread = true;
-        for (int i = 0; i < num_ports; i++)
-            pthread_join(read_thread_handle[i], NULL);
+        if (replaying)
+            WR_Replay_stop();
+        else if (acq_mode == ANEMOMETER_ACQ_EPOLL)
+            serial_epoll_stop();
+        else {
+            exit_thread = true;
+            for (int i = 0; i < num_ports; i++)
+                pthread_join(sensors[i].read_thread_handle, NULL);
+        }
+        running = false;
+        // pass on what is left in the rings
+        sonic_anemometer_stop_pipeline();
+        WR_Capture_stop();
+        for (int i = 0; i < num_ports; i++) {
+            Anemometer_Health_t health;
+            sonic_anemometer_get_health(i, &health);
+            if (health.checksum_failures or health.resyncs or health.gaps or health.dropped)
+                fprintf(stderr, "Anemometer %d: %llu frames, %llu checksum failures, %llu resyncs, %llu gaps, %u dropped.\n",
+                        i+1, (unsigned long long)health.frames, (unsigned long long)health.checksum_failures,
+                        (unsigned long long)health.resyncs, (unsigned long long)health.gaps, health.dropped);
+        }
         // close serial port
-        for (int i = 0; i < num_ports; i++) 
-            serial_close(fd[i]);
+        for (int i = 0; i < num_ports; i++) {
+            if (sensors[i].fd != -1)
+                serial_close(sensors[i].fd);
+            sensors[i].fd = -1;
+        }
+        replaying = false;
         printf("Anemometer serial thread terminated.\n");
     }
 }
 
-std::string* sonic_anemometer_get_port_paths(void)
+const Anemometer_Time_Anchor_t* sonic_anemometer_get_time_anchor(void)
+{
+    return &time_anchor;
+}
+
+void* sonic_anemometer_read_loop(void* args)
+{
+    Anemometer_Thread_Arguments_t* thread_args = (Anemometer_Thread_Arguments_t*)args;
+    int nbytes;
+    char frame[512];
+
+    while (!*((bool*)thread_args->arg))
+    {
+        nbytes = serial_read(thread_args->fd, frame, 512);
+        if (nbytes > 0) {
+            thread_args->process(frame, nbytes, thread_args->index, serial_clock_ns());
+            continue;
+        }
+        if (nbytes < 0) {
+            if (errno == EINTR or errno == EAGAIN)
+                continue;
+            // EIO of an unplugged adapter, every read after fails at once
+            if (*((bool*)thread_args->arg))
+                break; // told to exit, the other side may be gone already
+            fprintf(stderr, "Anemometer %d: serial port read failed: %s, stop reading it.\n",
+                    thread_args->index+1, strerror(errno));
+            break;
+        }
+        // nothing within VTIME, or end of file if the port hung up
+        struct pollfd pfd = {thread_args->fd, POLLIN, 0};
+        if (poll(&pfd, 1, 0) > 0 and (pfd.revents & (POLLHUP | POLLERR | POLLNVAL))) {
+            if (*((bool*)thread_args->arg))
+                break; // a shutdown closing the other side, nothing to report
+            fprintf(stderr, "Anemometer %d: serial port hung up, stop reading it.\n", thread_args->index+1);
+            break;
+        }
+    }
+    return 0;
+}
+
+int sonic_anemometer_get_num(void)
+{
+    return num_sensors;
+}
+
+const char* sonic_anemometer_get_port_path(int index)
+{
+    if (index < 0 or index >= num_sensors)
+        return NULL;
+    return sensors[index].port_path.c_str();
+}
+
+const char* sonic_anemometer_get_type(int index)
+{
+    if (index < 0 or index >= num_sensors)
+        return NULL;
+    return sensors[index].type.c_str();
+}
+
+void* sonic_anemometer_get_parser_state(int index)
+{
+    if (index < 0 or index >= num_sensors)
+        return NULL;
+    return sensors[index].parser_state;
+}
+
+Anemometer_Counters_t* sonic_anemometer_get_counters(int index)
+{
+    if (index < 0 or index >= num_sensors)
+        return NULL;
+    return &sensors[index].counters;
+}
+
+bool sonic_anemometer_get_health(int index, Anemometer_Health_t* health)
+{
+    if (index < 0 or index >= num_sensors)
+        return false;
+    Anemometer_Counters_t* counters = &sensors[index].counters;
+
+    health->bytes = counters->bytes.load(std::memory_order_relaxed);
+    health->frames = counters->frames.load(std::memory_order_relaxed);
+    health->checksum_failures = counters->checksum_failures.load(std::memory_order_relaxed);
+    health->resyncs = counters->resyncs.load(std::memory_order_relaxed);
+    health->gaps = counters->gaps.load(std::memory_order_relaxed);
+    health->dropped = sensors[index].ring.num_dropped();
+
+    int64_t last_t = counters->last_t.load(std::memory_order_relaxed);
+    int64_t interval = counters->interval.load(std::memory_order_relaxed);
+    if (last_t == 0) {
+        health->age = -1;
+        health->rate = 0.;
+        return true;
+    }
+    health->age = serial_clock_ns() - last_t;
+    if (health->age < 0) health->age = 0;
+    // a quiet sensor is at most as fast as the time since its last sample
+    if (health->age > interval)
+        interval = health->age;
+    health->rate = interval > 0 ? (float)(1e9/interval) : 0.;
+
+    return true;
+}
+
+Sample_History* sonic_anemometer_get_wind_record(int index)
+{
+    if (index < 0 or index >= num_sensors)
+        return NULL;
+    return &sensors[index].record;
+}
+
+void sonic_anemometer_set_history_cap(size_t bytes_per_sensor)
+{
+    history_cap = bytes_per_sensor;
+    for (int i = 0; i < num_sensors; i++)
+        sensors[i].record.set_cap(bytes_per_sensor);
+}
+
+void sonic_anemometer_set_history_compression(bool on)
+{
+    history_compression = on;
+    for (int i = 0; i < num_sensors; i++)
+        sensors[i].record.set_compression(on);
+}
+
+void sonic_anemometer_publish(int index, const Anemometer_Data_t* sample)
+{
+    if (index < 0 or index >= num_sensors)
+        return;
+    Anemometer_Sensor_t* sensor = &sensors[index];
+    Anemometer_Counters_t* counters = &sensor->counters;
+    int64_t last_t = counters->last_t.load(std::memory_order_relaxed);
+
+    // a backlog longer than a read is stamped back from each read's time on
+    // its own, so its stamps may overlap those of the read before; they are
+    // pushed just past the previous sample's, times never decrease
+    Anemometer_Data_t clamped;
+    if (last_t != 0 and sample->t <= last_t) {
+        clamped = *sample;
+        clamped.latency -= (int)(last_t + 1 - sample->t);
+        clamped.t = last_t + 1;
+        sample = &clamped;
+    }
+    sensor->ring.push(*sample);
+
+    // rate and gaps, the smoothed interval follows rate changes within ~16
+    // samples, a long gap only moves it by a bounded step
+    anemometer_counter_add(counters->frames, 1);
+    // a squeezed backlog has no interval to tell
+    if (last_t != 0 and sample->t > last_t+1) {
+        int64_t dt = sample->t - last_t;
+        int64_t interval = counters->interval.load(std::memory_order_relaxed);
+        if (interval == 0)
+            interval = dt;
+        else {
+            if (dt > ANEMOMETER_GAP_FACTOR*interval) {
+                anemometer_counter_add(counters->gaps, 1);
+                dt = 4*interval;
+            }
+            interval += (dt - interval)/16;
+        }
+        counters->interval.store(interval, std::memory_order_relaxed);
+    }
+    counters->last_t.store(sample->t, std::memory_order_relaxed);
+
+    // odd sequence while writing
+    unsigned int seq = sensor->latest.seq.load(std::memory_order_relaxed);
+    sensor->latest.seq.store(seq+1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    sensor->latest.data = *sample;
+    sensor->latest.seq.store(seq+2, std::memory_order_release);
+}
+
+int sonic_anemometer_drain(int index, Anemometer_Data_t* samples, int max)
 {
-    return anemometer_port_path;
+    if (index < 0 or index >= num_sensors or max <= 0)
+        return 0;
+    return sensors[index].ring.pop(samples, max);
 }
 
-std::string* sonic_anemometer_get_types(void)
+unsigned int sonic_anemometer_get_pending(int index)
 {
-    return anemometer_type;
+    if (index < 0 or index >= num_sensors)
+        return 0;
+    return sensors[index].ring.size();
 }
 
-std::vector<Anemometer_Data_t>* sonic_anemometer_get_wind_record(void)
+unsigned int sonic_anemometer_get_dropped(int index)
 {
-    return wind_record;
+    if (index < 0 or index >= num_sensors)
+        return 0;
+    return sensors[index].ring.num_dropped();
 }
 
-Anemometer_Data_t* sonic_anemometer_get_wind_data(void)
+bool sonic_anemometer_get_latest(int index, Anemometer_Data_t* sample)
 {
-    return wind_data;
+    if (index < 0 or index >= num_sensors)
+        return false;
+    Anemometer_Latest_t* latest = &sensors[index].latest;
+
+    unsigned int seq0, seq1;
+    do {
+        seq0 = latest->seq.load(std::memory_order_acquire);
+        *sample = latest->data;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        seq1 = latest->seq.load(std::memory_order_relaxed);
+    } while ((seq0 & 1) or seq0 != seq1);
+
+    return seq0 != 0; // false if nothing received yet
 }
@@ -1,29 +1,114 @@
 #ifndef SERIAL_ANEMOMETERS_H
 #define SERIAL_ANEMOMETERS_H
 
+#include <stddef.h>
+#include <stdint.h>
 #include <time.h>
+#include <atomic>
 #include <vector>
 #include <string>
 
-#define SERIAL_MAX_ANEMOMETERS 20
+class Sample_History; // sample_history.h
+
+/* acquisition models */
+#define ANEMOMETER_ACQ_EPOLL            0 // all ports multiplexed on a small pool of poller threads
+#define ANEMOMETER_ACQ_THREAD_PER_PORT  1 // one blocking read thread per port
+
+/* samples buffered per anemometer between parser and consumer, power of two
+ * (4096 samples = 2 min at 32 Hz) */
+#define SERIAL_ANEMOMETER_RING_SIZE     4096
+
+/* bytes of per-sensor parser state kept next to the sensor's ring, owned by
+ * the protocol driver of the sensor */
+#define SERIAL_ANEMOMETER_PARSER_STATE_SIZE 128
 
 typedef struct {
     int index;
     void* arg;
     int fd;
+    void (*process)(char* buf, int len, int index, int64_t t); // driver's parser
 } Anemometer_Thread_Arguments_t;
 
 typedef struct {
     float speed[3];
     float temperature;
-    time_t t;
+    int status; // status code reported by the anemometer
+    int latency; // ns, from arrival of the frame's first byte to the sample being parsed
+    int64_t t; // ns, CLOCK_MONOTONIC arrival of the frame's first byte (STX)
 } Anemometer_Data_t;
 
-bool sonic_anemometer_init(int, std::string*, std::string*);
+/* acquisition counters of a sensor, each written by one thread only (the
+ * reader of the port), so updates are plain relaxed load & store, read
+ * through sonic_anemometer_get_health() */
+typedef struct {
+    std::atomic<uint64_t> bytes; // read from the port
+    std::atomic<uint64_t> frames; // parsed into samples
+    std::atomic<uint64_t> checksum_failures; // complete frames with a bad checksum
+    std::atomic<uint64_t> resyncs; // frames abandoned on an unexpected byte
+    std::atomic<uint64_t> gaps; // sample intervals over ANEMOMETER_GAP_FACTOR times the usual one
+    std::atomic<int64_t> last_t; // ns, time of the newest sample
+    std::atomic<int64_t> interval; // ns, smoothed sample interval
+} Anemometer_Counters_t;
+
+/* an interval this many times the smoothed one counts as a gap */
+#define ANEMOMETER_GAP_FACTOR   2.5
+
+static inline void anemometer_counter_add(std::atomic<uint64_t>& counter, uint64_t n)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/* snapshot of the counters */
+typedef struct {
+    uint64_t bytes;
+    uint64_t frames;
+    uint64_t checksum_failures;
+    uint64_t resyncs;
+    uint64_t gaps;
+    unsigned int dropped; // samples lost because the consumer fell behind
+    int64_t age; // ns since the newest sample, -1 if none yet
+    float rate; // Hz, from the smoothed interval, decays while the sensor is quiet
+} Anemometer_Health_t;
+
+/* wall clock of a session, for converting sample times t to UTC:
+ * utc_ns = realtime + (t - monotonic) */
+typedef struct {
+    int64_t realtime; // ns since the Epoch, CLOCK_REALTIME
+    int64_t monotonic; // ns, CLOCK_MONOTONIC, taken at the same instant
+} Anemometer_Time_Anchor_t;
+
+void sonic_anemometer_set_acquisition(int mode, int n_threads);
+void sonic_anemometer_set_capture(const char* file_name);
+/* (re)build the sensor registry, done by sonic_anemometer_init, only needed
+ * by code feeding the parsers without ports */
+bool sonic_anemometer_reserve(int n_sensors);
+bool sonic_anemometer_init(int, const std::string*, const std::string*);
+/* parse a raw capture (capture.h) instead of reading ports, see replay.h */
+bool sonic_anemometer_init_replay(const char* capture_file, double speed, int n_threads);
+bool sonic_anemometer_replay_done(void);
 void sonic_anemometer_close(void);
-std::string* sonic_anemometer_get_port_paths(void);
-std::string* sonic_anemometer_get_types(void);
-Anemometer_Data_t* sonic_anemometer_get_wind_data(void);
-std::vector<Anemometer_Data_t>* sonic_anemometer_get_wind_record(void);
+/* blocking read loop of the thread-per-port model, args is an
+ * Anemometer_Thread_Arguments_t, arg pointing to the exit flag */
+void* sonic_anemometer_read_loop(void* args);
+int sonic_anemometer_get_num(void);
+const Anemometer_Time_Anchor_t* sonic_anemometer_get_time_anchor(void);
+const char* sonic_anemometer_get_port_path(int index);
+const char* sonic_anemometer_get_type(int index);
+void* sonic_anemometer_get_parser_state(int index);
+Anemometer_Counters_t* sonic_anemometer_get_counters(int index);
+/* any thread, cheap enough to poll, never blocks the readers */
+bool sonic_anemometer_get_health(int index, Anemometer_Health_t*);
+/* parser side, hand one sample to the consumer and the latest snapshot */
+void sonic_anemometer_publish(int index, const Anemometer_Data_t*);
+/* consumer side, single consumer only, returns number of samples copied */
+int sonic_anemometer_drain(int index, Anemometer_Data_t*, int max);
+unsigned int sonic_anemometer_get_pending(int index); // samples not drained yet
+unsigned int sonic_anemometer_get_dropped(int index);
+/* any thread, consistent copy of the newest sample */
+bool sonic_anemometer_get_latest(int index, Anemometer_Data_t*);
+/* per-sensor history, filled by the sample pipeline */
+Sample_History* sonic_anemometer_get_wind_record(int index);
+void sonic_anemometer_set_history_cap(size_t bytes_per_sensor);
+void sonic_anemometer_set_history_compression(bool); // older samples Gorilla coded, see sample_history.h
 
 #endif
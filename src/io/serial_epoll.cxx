@@ -0,0 +1,163 @@
+/*
+ * Event-driven serial acquisition
+ *
+ * All opened serial ports are multiplexed through epoll on a small fixed
+ * pool of threads (one by default), instead of one blocking read thread
+ * per port. Ports are dealt round-robin to the poller threads, each one
+ * owning its own epoll instance, so the bytes of a port are always handled
+ * by the same thread and the frame parsers need no locking.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <vector>
+#include "io/serial.h"
+#include "io/serial_epoll.h"
+
+#define SERIAL_EPOLL_READ_SIZE      512
+#define SERIAL_EPOLL_MAX_EVENTS     64
+
+typedef struct {
+    int fd;
+    int index;
+    Serial_Epoll_Handler_t handler;
+} Serial_Epoll_Port_t;
+
+typedef struct {
+    int epfd;
+    pthread_t handle;
+} Serial_Epoll_Thread_t;
+
+static std::vector<Serial_Epoll_Port_t> ports;
+static Serial_Epoll_Thread_t pollers[SERIAL_EPOLL_MAX_THREADS];
+static int num_pollers = 0;
+static int num_epfds = 0;
+static int wakeup_fd = -1; // written on stop, watched by every poller
+static bool running = false;
+
+static void* serial_epoll_loop(void* args)
+{
+    Serial_Epoll_Thread_t* poller = (Serial_Epoll_Thread_t*)args;
+    struct epoll_event events[SERIAL_EPOLL_MAX_EVENTS];
+    char buf[SERIAL_EPOLL_READ_SIZE];
+
+    for (;;) {
+        int n = epoll_wait(poller->epfd, events, SERIAL_EPOLL_MAX_EVENTS, -1);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            if (events[i].data.ptr == NULL) // wakeup fd, stop polling
+                return 0;
+            Serial_Epoll_Port_t* port = (Serial_Epoll_Port_t*)events[i].data.ptr;
+            if (events[i].events & EPOLLIN) {
+                int nbytes = serial_read(port->fd, buf, SERIAL_EPOLL_READ_SIZE);
+                if (nbytes > 0) {
+                    port->handler(buf, nbytes, port->index, serial_clock_ns());
+                    continue;
+                }
+                if (nbytes < 0 and (errno == EAGAIN or errno == EINTR))
+                    continue;
+                // end of file or a hard error (EIO of a dying adapter), readable
+                // forever after, level triggered it would spin this poller
+                if (nbytes < 0)
+                    fprintf(stderr, "Anemometer %d: serial port read failed: %s, stop polling it.\n",
+                            port->index+1, strerror(errno));
+                else
+                    fprintf(stderr, "Anemometer %d: serial port closed, stop polling it.\n", port->index+1);
+            }
+            else // port unplugged or closed by the other end
+                fprintf(stderr, "Anemometer %d: serial port hung up, stop polling it.\n", port->index+1);
+            epoll_ctl(poller->epfd, EPOLL_CTL_DEL, port->fd, NULL);
+        }
+    }
+    return 0;
+}
+
+bool serial_epoll_start(int n_ports, int* fds, Serial_Epoll_Handler_t* handlers, int n_threads)
+{
+    if (running or n_ports < 1 or !fds or !handlers)
+        return false;
+
+    if (n_threads < 1) n_threads = 1;
+    if (n_threads > SERIAL_EPOLL_MAX_THREADS) n_threads = SERIAL_EPOLL_MAX_THREADS;
+    if (n_threads > n_ports) n_threads = n_ports;
+
+    ports.resize(n_ports);
+    for (int i = 0; i < n_ports; i++) {
+        ports[i].fd = fds[i];
+        ports[i].index = i;
+        ports[i].handler = handlers[i];
+        // the poller never waits inside read(), VTIME is left to blocking users
+        fcntl(fds[i], F_SETFL, fcntl(fds[i], F_GETFL) | O_NONBLOCK);
+    }
+
+    wakeup_fd = eventfd(0, EFD_NONBLOCK);
+    if (wakeup_fd < 0)
+        return false;
+    running = true;
+
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    for (num_epfds = 0; num_epfds < n_threads; num_epfds++) {
+        pollers[num_epfds].epfd = epoll_create1(0);
+        if (pollers[num_epfds].epfd < 0)
+            goto fail;
+        ev.events = EPOLLIN;
+        ev.data.ptr = NULL;
+        if (epoll_ctl(pollers[num_epfds].epfd, EPOLL_CTL_ADD, wakeup_fd, &ev) < 0) {
+            close(pollers[num_epfds].epfd);
+            goto fail;
+        }
+    }
+    for (int i = 0; i < n_ports; i++) {
+        ev.events = EPOLLIN;
+        ev.data.ptr = &ports[i];
+        if (epoll_ctl(pollers[i % n_threads].epfd, EPOLL_CTL_ADD, fds[i], &ev) < 0)
+            goto fail;
+    }
+
+    for (num_pollers = 0; num_pollers < n_threads; num_pollers++) {
+        if (pthread_create(&pollers[num_pollers].handle, NULL, &serial_epoll_loop, (void*)&pollers[num_pollers]) != 0)
+            goto fail;
+    }
+
+    return true;
+
+fail:
+    serial_epoll_stop();
+    return false;
+}
+
+void serial_epoll_stop(void)
+{
+    if (!running)
+        return;
+
+    // level-triggered, so one write wakes up every poller
+    uint64_t one = 1;
+    if (write(wakeup_fd, &one, sizeof(one)) != sizeof(one))
+        perror("eventfd write");
+    for (int t = 0; t < num_pollers; t++)
+        pthread_join(pollers[t].handle, NULL);
+    for (int t = 0; t < num_epfds; t++)
+        close(pollers[t].epfd);
+    close(wakeup_fd);
+    wakeup_fd = -1;
+    num_pollers = 0;
+    num_epfds = 0;
+    ports.clear();
+    running = false;
+}
@@ -0,0 +1,17 @@
+#ifndef SERIAL_EPOLL_H
+#define SERIAL_EPOLL_H
+
+#include <stdint.h>
+
+/* bytes handler, called from the poller thread owning the port,
+ * t is the CLOCK_MONOTONIC time (ns) read() returned, i.e. the arrival
+ * of the last byte of buf */
+typedef void (*Serial_Epoll_Handler_t)(char* buf, int len, int index, int64_t t);
+
+#define SERIAL_EPOLL_MAX_THREADS    8
+
+/* serial_epoll.cxx */
+bool serial_epoll_start(int n_ports, int* fds, Serial_Epoll_Handler_t* handlers, int n_threads);
+void serial_epoll_stop(void);
+
+#endif
@@ -2,7 +2,12 @@
  * Serial Protocal for Gill Anemometers
  * Support List:
  *      Gill 2D sonic wind sensor --- WindSonic
- *      Gill 3D sonic wind sensor --- WindMaster (TODO)
+ *      Gill 3D sonic wind sensor --- WindMaster
+ *
+ * Frames are described by templates, compiled once into state tables.
+ * Every byte is classified through a 256-entry table and checked against
+ * the current state, numeric fields are accumulated as fixed-point integers
+ * while scanning, so a frame is decoded without copies or atof().
  *
  * Author:
  *      Roice Luo (Bing Luo)
@@ -13,249 +18,354 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <pthread.h>
 #include <time.h> // nanosleep()
 #include <vector>
 #include <cmath>
 #include "serial.h"
 #include "serial_anemometers.h"
+#include "serial_gill.h"
 
-// Gill WindSonic Frame Type
-typedef struct {
-    // protocol
-    char protocol[50] = {0x02, 'X', ',', 'X', 'X', 'X', ',', 'X', 'X', 'X', '.', 'X', 'X', ',', 'X', ',', 'X', 'X', ',', 0x03, 'C'};
-    // frame
-    char frame[100];
-    // checksum
-    char checksum;
-    // pointer
-    int pointer = 0;
-    // parsed value
-    char    addr; // WindSonic node address
-    float   direction;  // wind direction (deg)
-    float   speed;  // wind speed
-    char    units; // units of measure (knots, m/s etc.)
-    char    status; // anemometer status code
-} Gill_WindSonic_ASCII_Frame_t;
-typedef struct {
-    // protocol
-    char protocol[50] = {0x02, 'X', 'X', ',', 'X', 'X', ',', 'S', 'X', 'X', '.', 'X', 'X', ',', 'S', 'X', 'X', '.', 'X', 'X', ',', 'S', 'X', 'X', '.', 'X', 'X', ',', 'S', 'X', 'X', '.', 'X', 'X', ',',0x03};
-    // frame
-    char frame[100];
-    // pointer
-    int pointer = 0;
-    // parsed value
-    short    StaA; // status address
-    short    StaD; // status data
-    float  u;  // U vector cm/s
-    float  v;  // V vector cm/s
-    float  w;  // W vector cm/s
-    float  T;  // absolute temperature
-} Gill_WindMaster_ASCII_Frame_t;
+/* Frame templates
+ *  0x02    STX
+ *  0x03    ETX
+ *  'A'     alphanumeric character (address, units)
+ *  'N'     decimal digit of a numeric field
+ *  'n'     decimal digit of a field which may be empty
+ *  'X'     hex digit of a numeric field
+ *  'S'     sign of a numeric field, '+' or '-'
+ *  '.'     decimal point, fixed, so the field keeps being a scaled integer
+ *  ','     field separator
+ *  'C'     hex digit of the checksum, XOR of all bytes between STX and ETX
+ */
+// Gill WindSonic Polar Continuous, e.g. <STX>Q,229,002.74,M,00,<ETX>16
+static const char gill_windsonic_template[] = "\x02" "A,nnn,NNN.NN,A,XX," "\x03" "CC";
+// Gill WindMaster UVW, e.g. <STX>QA,00,+01.23,-00.45,+00.10,+20.50,<ETX>2F
+static const char gill_windmaster_template[] = "\x02" "AA,XX,SNN.NN,SNN.NN,SNN.NN,SNN.NN," "\x03" "CC";
 
-static Gill_WindSonic_ASCII_Frame_t gill_frame_windsonic[SERIAL_MAX_ANEMOMETERS];
-static Gill_WindMaster_ASCII_Frame_t gill_frame_windmaster[SERIAL_MAX_ANEMOMETERS];
+#define GILL_MAX_STATES     64
+#define GILL_MAX_FIELDS     8
 
-static void gillProcessFrame_WindMaster(char* buf, int len, int index)
-{
-    if (index < 0 or index >= SERIAL_MAX_ANEMOMETERS)
-        return;
+// classes of bytes
+#define GILL_CLASS_DIGIT    0x01
+#define GILL_CLASS_ALPHA    0x02
+#define GILL_CLASS_SIGN     0x04
+#define GILL_CLASS_DOT      0x08
+#define GILL_CLASS_COMMA    0x10
+#define GILL_CLASS_STX      0x20
+#define GILL_CLASS_ETX      0x40
 
-    if (len <= 0)
-        return;
+// actions on an accepted byte
+enum {
+    GILL_ACT_STX = 0,
+    GILL_ACT_CHAR,
+    GILL_ACT_DIGIT,
+    GILL_ACT_HEX,
+    GILL_ACT_SIGN,
+    GILL_ACT_DOT,
+    GILL_ACT_COMMA,
+    GILL_ACT_ETX,
+    GILL_ACT_SUM_HI,
+    GILL_ACT_SUM_LO
+};
 
-    for (int i = 0; i < len; i++) {
-        switch (gill_frame_windmaster[index].protocol[gill_frame_windmaster[index].pointer]) {
-            case 0x02: // start frame
-                if (buf[i] == 0x02)
-                    gill_frame_windmaster[index].frame[gill_frame_windmaster[index].pointer++] = buf[i];
-                break;
-            case 'X': // number, not ',' or '.', or '+', or '-'
-                if (buf[i] != ',' and buf[i] != '.' and buf[i] != '+' and buf[i] != '-')
-                    gill_frame_windmaster[index].frame[gill_frame_windmaster[index].pointer++] = buf[i];
-                else
-                    gill_frame_windmaster[index].pointer = 0;
-                break;
-            case 'S': // '+' or '-'
-                if (buf[i] == '+' or buf[i] == '-')
-                    gill_frame_windmaster[index].frame[gill_frame_windmaster[index].pointer++] = buf[i];
-                else
-                    gill_frame_windmaster[index].pointer = 0;
-                break;
-            case ',':
-                if (buf[i] == ',')
-                    gill_frame_windmaster[index].frame[gill_frame_windmaster[index].pointer++] = buf[i];
-                else
-                    gill_frame_windmaster[index].pointer = 0;
-                break;
-            case '.':
-                if (buf[i] == '.')
-                    gill_frame_windmaster[index].frame[gill_frame_windmaster[index].pointer++] = buf[i];
-                else
-                    gill_frame_windmaster[index].pointer = 0;
-                break;
-            case 0x03: // end frame
-                if (buf[i] == 0x03) { // received a complete frame
-                    gill_frame_windmaster[index].frame[gill_frame_windmaster[index].pointer++] = buf[i]; 
-// Debug
-    //gill_frame_windmaster[index].frame[gill_frame_windmaster[index].pointer] = 0x0;
-    //printf("gill_frame_windmaster[index] = %s\n", gill_frame_windmaster[index].frame);
+typedef struct {
+    unsigned char accept; // classes accepted in this state
+    unsigned char action;
+    unsigned char empty_next; // state after the separator if an optional field is empty, 0 if mandatory
+} Gill_State_t;
 
-                    gill_frame_windmaster[index].StaA = ((short)gill_frame_windmaster[index].frame[1] << 8) & ((short)gill_frame_windmaster[index].frame[2]);
-                    gill_frame_windmaster[index].StaD = ((short)gill_frame_windmaster[index].frame[4] << 8) & ((short)gill_frame_windmaster[index].frame[5]);
-                    char temp_f[10] = {0};
-                    memcpy(temp_f, &gill_frame_windmaster[index].frame[7], 6*sizeof(char));
-                    gill_frame_windmaster[index].u = atof(temp_f);
-                    memcpy(temp_f, &gill_frame_windmaster[index].frame[14], 6*sizeof(char));
-                    gill_frame_windmaster[index].v = atof(temp_f);
-                    memcpy(temp_f, &gill_frame_windmaster[index].frame[21], 6*sizeof(char));
-                    gill_frame_windmaster[index].w = atof(temp_f);
-                    memcpy(temp_f, &gill_frame_windmaster[index].frame[28], 6*sizeof(char));
-                    gill_frame_windmaster[index].T = atof(temp_f);
+typedef struct {
+    Gill_State_t states[GILL_MAX_STATES];
+    int n_states;
+} Gill_Protocol_t;
 
-// Debug
-    //printf("wind = [%f, %f, %f], T = %f\n", gill_frame_windmaster[index].u, gill_frame_windmaster[index].v, gill_frame_windmaster[index].w, gill_frame_windmaster[index].T);
+// per-sensor parsing state, lives in the sensor registry on a cache line of
+// its own so pollers never share lines
+typedef struct {
+    alignas(64) int state;
+    int field;
+    int sign;
+    int byte_ns; // transmission time of one byte
+    unsigned char checksum; // computed
+    unsigned char rx_checksum; // received
+    int64_t t_stx; // arrival of STX, ns
+    int value[GILL_MAX_FIELDS]; // fixed-point field values, chars for 'A' fields
+} Gill_Parser_t;
 
-                    // save data
-                    Anemometer_Data_t *wind_data = sonic_anemometer_get_wind_data();
-                    wind_data[index].speed[0] = (float)gill_frame_windmaster[index].u;
-                    wind_data[index].speed[1] = (float)gill_frame_windmaster[index].v;
-                    wind_data[index].speed[2] = (float)gill_frame_windmaster[index].w;
-                    wind_data[index].temperature = (float)gill_frame_windmaster[index].T;
+static unsigned char gill_char_class[256];
+static unsigned char gill_hex_value[256]; // 0xFF if not a hex digit
+static Gill_Protocol_t gill_windsonic_protocol;
+static Gill_Protocol_t gill_windmaster_protocol;
+static_assert(sizeof(Gill_Parser_t) <= SERIAL_ANEMOMETER_PARSER_STATE_SIZE,
+        "Gill parser state does not fit the sensor registry");
 
-                    gill_frame_windmaster[index].pointer = 0; // clear pointer
+static void gill_compile_protocol(const char* tmpl, int len, Gill_Protocol_t* proto)
+{
+    proto->n_states = len;
+    for (int i = 0; i < len; i++) {
+        Gill_State_t* st = &proto->states[i];
+        st->empty_next = 0;
+        switch (tmpl[i]) {
+            case 0x02: st->accept = GILL_CLASS_STX; st->action = GILL_ACT_STX; break;
+            case 0x03: st->accept = GILL_CLASS_ETX; st->action = GILL_ACT_ETX; break;
+            case 'A': st->accept = GILL_CLASS_ALPHA | GILL_CLASS_DIGIT; st->action = GILL_ACT_CHAR; break;
+            case 'N': st->accept = GILL_CLASS_DIGIT; st->action = GILL_ACT_DIGIT; break;
+            case 'n':
+                st->accept = GILL_CLASS_DIGIT; st->action = GILL_ACT_DIGIT;
+                if (tmpl[i-1] == ',') { // first digit, a ',' here means the field is empty
+                    int k = i;
+                    while (k < len and tmpl[k] != ',') k++;
+                    st->empty_next = k+1;
                 }
                 break;
-            default:
+            case 'X': st->accept = GILL_CLASS_DIGIT | GILL_CLASS_ALPHA; st->action = GILL_ACT_HEX; break;
+            case 'S': st->accept = GILL_CLASS_SIGN; st->action = GILL_ACT_SIGN; break;
+            case '.': st->accept = GILL_CLASS_DOT; st->action = GILL_ACT_DOT; break;
+            case ',': st->accept = GILL_CLASS_COMMA; st->action = GILL_ACT_COMMA; break;
+            case 'C':
+                st->accept = GILL_CLASS_DIGIT | GILL_CLASS_ALPHA;
+                st->action = (i+1 < len and tmpl[i+1] == 'C') ? GILL_ACT_SUM_HI : GILL_ACT_SUM_LO;
                 break;
         }
     }
 }
 
-// Gill WindSonic Polar Continuous
-void gillProcessFrame_WindSonic(char* buf, int len, int index)
+/* build tables before main() runs */
+static struct Gill_Tables_Init {
+    Gill_Tables_Init() {
+        for (int c = 0; c < 256; c++) {
+            gill_char_class[c] = 0;
+            gill_hex_value[c] = 0xFF;
+        }
+        for (int c = '0'; c <= '9'; c++) {
+            gill_char_class[c] = GILL_CLASS_DIGIT;
+            gill_hex_value[c] = c - '0';
+        }
+        for (int c = 'A'; c <= 'Z'; c++) gill_char_class[c] = GILL_CLASS_ALPHA;
+        for (int c = 'a'; c <= 'z'; c++) gill_char_class[c] = GILL_CLASS_ALPHA;
+        for (int c = 0; c < 6; c++) {
+            gill_hex_value['A'+c] = 10 + c;
+            gill_hex_value['a'+c] = 10 + c;
+        }
+        gill_char_class['+'] = GILL_CLASS_SIGN;
+        gill_char_class['-'] = GILL_CLASS_SIGN;
+        gill_char_class['.'] = GILL_CLASS_DOT;
+        gill_char_class[','] = GILL_CLASS_COMMA;
+        gill_char_class[0x02] = GILL_CLASS_STX;
+        gill_char_class[0x03] = GILL_CLASS_ETX;
+        gill_compile_protocol(gill_windsonic_template, sizeof(gill_windsonic_template)-1, &gill_windsonic_protocol);
+        gill_compile_protocol(gill_windmaster_template, sizeof(gill_windmaster_template)-1, &gill_windmaster_protocol);
+    }
+} gill_tables_init;
+
+/* WindSonic: address, direction (deg), speed (x100), units, status */
+static inline void gill_emit_windsonic(Gill_Parser_t* p, int index)
 {
-    if (index < 0 or index >= SERIAL_MAX_ANEMOMETERS)
-        return;
+    float speed = p->value[2]*0.01f;
+    switch (p->value[3]) { // units, to m/s
+        case 'N': speed *= 0.514444f; break; // knots
+        case 'P': speed *= 0.44704f; break; // miles per hour
+        case 'K': speed *= 1.f/3.6f; break; // kilometres per hour
+        case 'F': speed *= 0.00508f; break; // feet per minute
+        default: break; // 'M', metres per second
+    }
+    // direction the wind blows from, clockwise from north, to uv (EN)
+    float direction = p->value[1]*(float)(M_PI/180.);
 
-    if (len <= 0)
-        return;
+    Anemometer_Data_t wind_data;
+    wind_data.speed[0] = -speed*std::sin(direction);
+    wind_data.speed[1] = -speed*std::cos(direction);
+    wind_data.speed[2] = 0.;
+    wind_data.temperature = 0.;
+    wind_data.status = p->value[4];
+    wind_data.t = p->t_stx;
+    wind_data.latency = (int)(serial_clock_ns() - wind_data.t);
+    sonic_anemometer_publish(index, &wind_data);
+}
+
+/* WindMaster: status address, status data, u, v, w, T (x100) */
+static inline void gill_emit_windmaster(Gill_Parser_t* p, int index)
+{
+    Anemometer_Data_t wind_data;
+    wind_data.speed[0] = p->value[2]*0.01f;
+    wind_data.speed[1] = p->value[3]*0.01f;
+    wind_data.speed[2] = p->value[4]*0.01f;
+    wind_data.temperature = p->value[5]*0.01f;
+    wind_data.status = p->value[1];
+    wind_data.t = p->t_stx;
+    wind_data.latency = (int)(serial_clock_ns() - wind_data.t);
+    sonic_anemometer_publish(index, &wind_data);
+}
+
+static inline void gill_parse(Gill_Parser_t* p, const Gill_Protocol_t* proto,
+        void (*emit)(Gill_Parser_t*, int), const char* buf, int len, int index, int64_t t,
+        Anemometer_Counters_t* counters)
+{
+    unsigned int resyncs = 0, checksum_failures = 0;
 
     for (int i = 0; i < len; i++) {
-        switch (gill_frame_windsonic[index].protocol[gill_frame_windsonic[index].pointer]) {
-            case 0x02: // start frame
-                if (buf[i] == 0x02) {
-                    gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer++] = buf[i];
-                    gill_frame_windsonic[index].checksum = 0;
-                }
+        unsigned char c = (unsigned char)buf[i];
+        unsigned char cls = gill_char_class[c];
+        const Gill_State_t* st = &proto->states[p->state];
+
+        if (!(cls & st->accept)) {
+            if ((cls & GILL_CLASS_COMMA) and st->empty_next) { // optional field left empty
+                p->checksum ^= c;
+                p->field++;
+                p->state = st->empty_next;
+                continue;
+            }
+            // resync, a stray STX starts the next frame right away
+            if (p->state != 0)
+                resyncs++;
+            p->state = 0;
+            if (!(cls & GILL_CLASS_STX))
+                continue;
+            st = &proto->states[0];
+        }
+
+        switch (st->action) {
+            case GILL_ACT_STX:
+                memset(p->value, 0, sizeof(p->value));
+                p->field = 0;
+                p->sign = 1;
+                p->checksum = 0;
+                p->t_stx = t - (int64_t)(len-1-i)*p->byte_ns;
                 break;
-            case 'X': // number, not ',' or '.'
-                if (buf[i] != ',' and buf[i] != '.') { // normal
-                    gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer++] = buf[i];
-                    gill_frame_windsonic[index].checksum ^= buf[i];
-                }
-                else if (buf[i] == ',' and gill_frame_windsonic[index].pointer == 3) { // wind speed < 0.05 m/s, no direction data
-                    gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer++] = 0;
-                    gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer++] = 0;
-                    gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer++] = 0;
-                    gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer++] = buf[i];
-                    gill_frame_windsonic[index].checksum ^= buf[i];
-                }
-                else {
-                    gill_frame_windsonic[index].pointer = 0;
-                    gill_frame_windsonic[index].checksum = 0;
-                }
+            case GILL_ACT_CHAR:
+                p->checksum ^= c;
+                p->value[p->field] = (p->value[p->field] << 8) | c;
                 break;
-            case ',':
-                if (buf[i] == ',') {
-                    gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer++] = buf[i];
-                    gill_frame_windsonic[index].checksum ^= buf[i];
-                }
-                else {
-                    gill_frame_windsonic[index].pointer = 0;
-                    gill_frame_windsonic[index].checksum = 0;
-                }
+            case GILL_ACT_DIGIT:
+                p->checksum ^= c;
+                p->value[p->field] = p->value[p->field]*10 + (c - '0');
                 break;
-            case '.':
-                if (buf[i] == '.') {
-                    gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer++] = buf[i];
-                    gill_frame_windsonic[index].checksum ^= buf[i];
-                }
-                else {
-                    gill_frame_windsonic[index].pointer = 0;
-                    gill_frame_windsonic[index].checksum = 0;
+            case GILL_ACT_HEX:
+                if (gill_hex_value[c] > 15) {
+                    resyncs++;
+                    p->state = 0;
+                    continue;
                 }
+                p->checksum ^= c;
+                p->value[p->field] = p->value[p->field]*16 + gill_hex_value[c];
                 break;
-            case 0x03:
-                if (buf[i] == 0x03)
-                    gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer++] = buf[i];
-                else
-                    gill_frame_windsonic[index].pointer = 0;
+            case GILL_ACT_SIGN:
+                p->checksum ^= c;
+                p->sign = (c == '-') ? -1 : 1;
                 break;
-            case 'C': // received checksum
-                gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer] = buf[i];
-                gill_frame_windsonic[index].pointer = 0; // clear pointer
-                if (buf[i] != gill_frame_windsonic[index].checksum)
-                    break;
-                else { // received a complete frame
-// Debug
-    //gill_frame_windsonic[index].frame[gill_frame_windsonic[index].pointer] = 0x0;
-    printf("gill_frame_windsonic[index] = %s\n", gill_frame_windsonic[index].frame);
-
-                    gill_frame_windsonic[index].addr = (char)gill_frame_windsonic[index].frame[1];
-                    char temp_f[10] = {0};
-                    memcpy(temp_f, &gill_frame_windsonic[index].frame[3], 3*sizeof(char));
-                    gill_frame_windsonic[index].direction = atoi(temp_f);
-                    memcpy(temp_f, &gill_frame_windsonic[index].frame[7], 6*sizeof(char));
-                    gill_frame_windsonic[index].speed = atof(temp_f);
-                    gill_frame_windsonic[index].units = gill_frame_windsonic[index].frame[14];
-                    memset(temp_f, 0, 10*sizeof(char));
-                    memcpy(temp_f, &gill_frame_windsonic[index].frame[16], 2*sizeof(char));
-                    gill_frame_windsonic[index].status = atoi(temp_f);
-
-// Debug
-    //printf("wind = [%f, %f]\n", gill_frame_windsonic[index].direction, gill_frame_windsonic[index].speed);
- 
-                    // save data, transform from polar to uv (EU)
-                    Anemometer_Data_t *wind_data = sonic_anemometer_get_wind_data();
-                    wind_data[index].speed[0] = -std::sin((float)gill_frame_windsonic[index].direction);
-                    wind_data[index].speed[1] = -std::cos((float)gill_frame_windsonic[index].direction);
-                    wind_data[index].speed[2] = 0.;
-                    wind_data[index].temperature = 0.;
-                    wind_data[index].t = time(NULL);
-                }
+            case GILL_ACT_DOT:
+                p->checksum ^= c;
+                break;
+            case GILL_ACT_COMMA:
+                p->checksum ^= c;
+                p->value[p->field] *= p->sign;
+                p->sign = 1;
+                p->field++;
                 break;
-            default:
+            case GILL_ACT_ETX:
                 break;
+            case GILL_ACT_SUM_HI:
+                if (gill_hex_value[c] > 15) {
+                    resyncs++;
+                    p->state = 0;
+                    continue;
+                }
+                p->rx_checksum = gill_hex_value[c] << 4;
+                break;
+            case GILL_ACT_SUM_LO:
+                p->state = 0;
+                if (gill_hex_value[c] > 15) {
+                    resyncs++;
+                    continue;
+                }
+                p->rx_checksum |= gill_hex_value[c];
+                if (p->rx_checksum == p->checksum) // received a complete frame
+                    emit(p, index);
+                else
+                    checksum_failures++;
+                continue;
         }
+        p->state++;
     }
+
+    anemometer_counter_add(counters->bytes, len);
+    if (resyncs)
+        anemometer_counter_add(counters->resyncs, resyncs);
+    if (checksum_failures)
+        anemometer_counter_add(counters->checksum_failures, checksum_failures);
 }
 
-void* gill_windsonic_read_loop(void* args)
+/* frame builders, for simulators and benchmarks, return length of the frame */
+static int gill_finish_frame(char* buf, int len)
 {
-    int nbytes;
-    char frame[512];
-    
-    while (!*((bool*)(((Anemometer_Thread_Arguments_t*)args)->arg)))
-    {
-        nbytes = serial_read(((Anemometer_Thread_Arguments_t*)args)->fd, frame, 512);
-        if (nbytes > 0) {
-            gillProcessFrame_WindSonic(frame, nbytes, ((Anemometer_Thread_Arguments_t*)args)->index);
-        }
-    }
-    return 0;
+    unsigned char checksum = 0;
+    for (int i = 1; i < len; i++)
+        checksum ^= (unsigned char)buf[i];
+    return len + sprintf(&buf[len], "\x03%02X", checksum);
 }
 
-void* gill_windmaster_read_loop(void* args)
+int gill_make_frame_windsonic(char* buf, float u, float v, int status)
 {
-    int nbytes;
-    char frame[512];
-    
-    while (!*((bool*)(((Anemometer_Thread_Arguments_t*)args)->arg)))
-    {
-        nbytes = serial_read(((Anemometer_Thread_Arguments_t*)args)->fd, frame, 512);
-        if (nbytes > 0)
-            gillProcessFrame_WindMaster(frame, nbytes, ((Anemometer_Thread_Arguments_t*)args)->index);
-    }
-    return 0;
+    float speed = std::sqrt(u*u + v*v);
+    int direction = (int)std::floor(std::atan2(-u, -v)*180./M_PI + 0.5);
+    if (direction < 0) direction += 360;
+    if (direction >= 360) direction -= 360;
+    int len;
+    if (speed < 0.05) // no direction reported below 0.05 m/s
+        len = sprintf(buf, "\x02Q,,%06.2f,M,%02X,", speed, status & 0xFF);
+    else
+        len = sprintf(buf, "\x02Q,%03d,%06.2f,M,%02X,", direction, speed, status & 0xFF);
+    return gill_finish_frame(buf, len);
+}
+
+int gill_make_frame_windmaster(char* buf, float u, float v, float w, float T, int status)
+{
+    int len = sprintf(buf, "\x02QA,%02X,%+06.2f,%+06.2f,%+06.2f,%+06.2f,", status & 0xFF,
+            u, v, w, T);
+    return gill_finish_frame(buf, len);
+}
+
+/* reset parser of a sensor, bytes of a read are timestamped backwards from
+ * the end of the read, one byte transmission time apart */
+void gill_set_baud(int index, int baud)
+{
+    Gill_Parser_t* p = (Gill_Parser_t*)sonic_anemometer_get_parser_state(index);
+    if (p == NULL or baud <= 0)
+        return;
+    memset(p, 0, sizeof(Gill_Parser_t));
+    p->byte_ns = 10*1000000000LL/baud;
+}
+
+void gillProcessFrame_WindMaster(char* buf, int len, int index, int64_t t)
+{
+    Gill_Parser_t* p = (Gill_Parser_t*)sonic_anemometer_get_parser_state(index);
+    if (p == NULL)
+        return;
+
+    gill_parse(p, &gill_windmaster_protocol, &gill_emit_windmaster, buf, len, index, t,
+            sonic_anemometer_get_counters(index));
 }
+
+void gillProcessFrame_WindSonic(char* buf, int len, int index, int64_t t)
+{
+    Gill_Parser_t* p = (Gill_Parser_t*)sonic_anemometer_get_parser_state(index);
+    if (p == NULL)
+        return;
+
+    gill_parse(p, &gill_windsonic_protocol, &gill_emit_windsonic, buf, len, index, t,
+            sonic_anemometer_get_counters(index));
+}
+
+/* WindSonic reports no w and T */
+static int gill_make_frame_windsonic_driver(char* buf, float u, float v, float w, float T, int status)
+{
+    return gill_make_frame_windsonic(buf, u, v, status);
+}
+
+const Anemometer_Driver_t gill_windsonic_driver = {
+    "Gill WindSonic", 9600, &gill_set_baud, &gillProcessFrame_WindSonic, &gill_make_frame_windsonic_driver, 2
+};
+
+const Anemometer_Driver_t gill_windmaster_driver = {
+    "Gill WindMaster", 115200, &gill_set_baud, &gillProcessFrame_WindMaster, &gill_make_frame_windmaster, 3
+};
@@ -1,7 +1,18 @@
 #ifndef SERIAL_GILL_H
 #define SERIAL_GILL_H
 
-void* gill_windsonic_read_loop(void*);
-void* gill_windmaster_read_loop(void*);
+#include <stdint.h>
+#include "anemometer_driver.h"
+
+extern const Anemometer_Driver_t gill_windsonic_driver; // "Gill WindSonic", 9600 baud
+extern const Anemometer_Driver_t gill_windmaster_driver; // "Gill WindMaster", 115200 baud
+
+void gill_set_baud(int, int);
+void gillProcessFrame_WindSonic(char*, int, int, int64_t);
+void gillProcessFrame_WindMaster(char*, int, int, int64_t);
+/* buf needs GILL_MAX_FRAME_LENGTH bytes */
+#define GILL_MAX_FRAME_LENGTH   64
+int gill_make_frame_windsonic(char* buf, float u, float v, int status);
+int gill_make_frame_windmaster(char* buf, float u, float v, float w, float T, int status);
 
 #endif
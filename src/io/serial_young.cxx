@@ -0,0 +1,236 @@
+/*
+ * Serial Protocal for RM Young Anemometers
+ * Support List:
+ *      RM Young 81000 ultrasonic anemometer, ASCII UVW output
+ *
+ * The 81000 sends one line per sample, space separated fixed-point fields
+ * "U V W T" (m/s, degC), optionally followed by an error code, ended by
+ * CR (or CR LF); there is no checksum. As for the Gill sensors, bytes are
+ * classified through a 256-entry table and fields are accumulated as
+ * integers while scanning. A line is only accepted if the line before it
+ * ended, so the first, partial line after start-up is dropped.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "serial.h"
+#include "serial_anemometers.h"
+#include "serial_young.h"
+
+#define YOUNG_MIN_FIELDS    4 // U V W T
+#define YOUNG_MAX_FIELDS    5 // U V W T error
+#define YOUNG_MAX_DIGITS    9 // keeps a field within int
+
+// classes of bytes
+enum {
+    YOUNG_CLASS_OTHER = 0,
+    YOUNG_CLASS_DIGIT,
+    YOUNG_CLASS_SIGN,
+    YOUNG_CLASS_DOT,
+    YOUNG_CLASS_SPACE,
+    YOUNG_CLASS_EOL,
+};
+
+// where in a line the parser is
+enum {
+    YOUNG_STATE_SYNC = 0, // waiting for the end of a line
+    YOUNG_STATE_START, // a line ended, next byte starts a frame
+    YOUNG_STATE_SPACE, // between fields
+    YOUNG_STATE_FIELD, // in a field
+};
+
+// per-sensor parsing state, lives in the sensor registry
+typedef struct {
+    alignas(64) int state;
+    int field;
+    int sign;
+    int digits; // digits of the current field
+    int decimals; // digits after the decimal point, -1 before the point
+    int byte_ns; // transmission time of one byte
+    int64_t t_start; // arrival of the frame's first byte, ns
+    int value[YOUNG_MAX_FIELDS]; // fixed-point field values
+    signed char scale[YOUNG_MAX_FIELDS]; // decimals of each field
+} Young_Parser_t;
+
+static_assert(sizeof(Young_Parser_t) <= SERIAL_ANEMOMETER_PARSER_STATE_SIZE,
+        "Young parser state does not fit the sensor registry");
+
+static unsigned char young_char_class[256];
+static const float young_pow10_inv[YOUNG_MAX_DIGITS+1] = {
+    1.f, 1e-1f, 1e-2f, 1e-3f, 1e-4f, 1e-5f, 1e-6f, 1e-7f, 1e-8f, 1e-9f
+};
+
+/* build table before main() runs */
+static struct Young_Tables_Init {
+    Young_Tables_Init() {
+        for (int c = 0; c < 256; c++)
+            young_char_class[c] = YOUNG_CLASS_OTHER;
+        for (int c = '0'; c <= '9'; c++)
+            young_char_class[c] = YOUNG_CLASS_DIGIT;
+        young_char_class['+'] = YOUNG_CLASS_SIGN;
+        young_char_class['-'] = YOUNG_CLASS_SIGN;
+        young_char_class['.'] = YOUNG_CLASS_DOT;
+        young_char_class[' '] = YOUNG_CLASS_SPACE;
+        young_char_class['\t'] = YOUNG_CLASS_SPACE;
+        young_char_class['\r'] = YOUNG_CLASS_EOL;
+        young_char_class['\n'] = YOUNG_CLASS_EOL;
+    }
+} young_tables_init;
+
+static inline void young_emit_81000(Young_Parser_t* p, int index)
+{
+    Anemometer_Data_t wind_data;
+    for (int axis = 0; axis < 3; axis++)
+        wind_data.speed[axis] = p->value[axis]*young_pow10_inv[p->scale[axis]];
+    wind_data.temperature = p->value[3]*young_pow10_inv[p->scale[3]];
+    wind_data.status = p->field > YOUNG_MIN_FIELDS ? p->value[4] : 0;
+    wind_data.t = p->t_start;
+    wind_data.latency = (int)(serial_clock_ns() - wind_data.t);
+    sonic_anemometer_publish(index, &wind_data);
+}
+
+/* close the current field, false if the line has too many */
+static inline bool young_end_field(Young_Parser_t* p)
+{
+    if (p->digits == 0 or p->field >= YOUNG_MAX_FIELDS)
+        return false;
+    p->value[p->field] *= p->sign;
+    p->scale[p->field] = p->decimals < 0 ? 0 : p->decimals;
+    p->field++;
+    return true;
+}
+
+static inline void young_begin_field(Young_Parser_t* p)
+{
+    p->value[p->field] = 0;
+    p->sign = 1;
+    p->digits = 0;
+    p->decimals = -1;
+    p->state = YOUNG_STATE_FIELD;
+}
+
+static inline void young_parse(Young_Parser_t* p, const char* buf, int len, int index, int64_t t,
+        Anemometer_Counters_t* counters)
+{
+    unsigned int resyncs = 0;
+
+    for (int i = 0; i < len; i++) {
+        unsigned char c = (unsigned char)buf[i];
+        unsigned char cls = young_char_class[c];
+
+        if (cls == YOUNG_CLASS_EOL) {
+            if (p->state == YOUNG_STATE_FIELD and !young_end_field(p)) {
+                resyncs++;
+                p->state = YOUNG_STATE_SYNC;
+            }
+            if (p->state == YOUNG_STATE_FIELD or p->state == YOUNG_STATE_SPACE) {
+                if (p->field >= YOUNG_MIN_FIELDS)
+                    young_emit_81000(p, index);
+                else if (p->field > 0) // short line
+                    resyncs++;
+            }
+            p->state = YOUNG_STATE_START; // also swallows the LF of CR LF
+            continue;
+        }
+
+        switch (p->state) {
+            case YOUNG_STATE_SYNC:
+                continue;
+            case YOUNG_STATE_START:
+                p->t_start = t - (int64_t)(len-1-i)*p->byte_ns;
+                p->field = 0;
+                p->state = YOUNG_STATE_SPACE;
+                // fall through
+            case YOUNG_STATE_SPACE:
+                if (cls == YOUNG_CLASS_SPACE)
+                    continue;
+                if (p->field >= YOUNG_MAX_FIELDS) {
+                    resyncs++;
+                    p->state = YOUNG_STATE_SYNC;
+                    continue;
+                }
+                young_begin_field(p);
+                if (cls == YOUNG_CLASS_SIGN) {
+                    p->sign = (c == '-') ? -1 : 1;
+                    continue;
+                }
+                break; // the byte is part of the field
+        }
+
+        // in a field, the line is dropped on a byte not in the format
+        switch (cls) {
+            case YOUNG_CLASS_DIGIT:
+                if (++p->digits > YOUNG_MAX_DIGITS) {
+                    resyncs++;
+                    p->state = YOUNG_STATE_SYNC;
+                    break;
+                }
+                p->value[p->field] = p->value[p->field]*10 + (c - '0');
+                if (p->decimals >= 0)
+                    p->decimals++;
+                break;
+            case YOUNG_CLASS_DOT:
+                if (p->decimals >= 0) {
+                    resyncs++;
+                    p->state = YOUNG_STATE_SYNC;
+                }
+                else
+                    p->decimals = 0;
+                break;
+            case YOUNG_CLASS_SPACE:
+                if (young_end_field(p))
+                    p->state = YOUNG_STATE_SPACE;
+                else {
+                    resyncs++;
+                    p->state = YOUNG_STATE_SYNC;
+                }
+                break;
+            default: // a sign in a field or a stray byte
+                resyncs++;
+                p->state = YOUNG_STATE_SYNC;
+                break;
+        }
+    }
+
+    anemometer_counter_add(counters->bytes, len);
+    if (resyncs)
+        anemometer_counter_add(counters->resyncs, resyncs);
+}
+
+/* reset parser of a sensor, bytes of a read are timestamped backwards from
+ * the end of the read, one byte transmission time apart */
+void young_set_baud(int index, int baud)
+{
+    Young_Parser_t* p = (Young_Parser_t*)sonic_anemometer_get_parser_state(index);
+    if (p == NULL or baud <= 0)
+        return;
+    memset(p, 0, sizeof(Young_Parser_t));
+    p->state = YOUNG_STATE_SYNC;
+    p->byte_ns = 10*1000000000LL/baud;
+}
+
+void youngProcessFrame_81000(char* buf, int len, int index, int64_t t)
+{
+    Young_Parser_t* p = (Young_Parser_t*)sonic_anemometer_get_parser_state(index);
+    if (p == NULL)
+        return;
+
+    young_parse(p, buf, len, index, t, sonic_anemometer_get_counters(index));
+}
+
+/* frame builder, for simulators and benchmarks, returns length of the frame */
+int young_make_frame_81000(char* buf, float u, float v, float w, float T, int status)
+{
+    if (status)
+        return sprintf(buf, "%6.2f %6.2f %6.2f %6.2f %2d\r", u, v, w, T, status & 0xFF);
+    return sprintf(buf, "%6.2f %6.2f %6.2f %6.2f\r", u, v, w, T);
+}
+
+const Anemometer_Driver_t young_81000_driver = {
+    "RM Young 81000", 38400, &young_set_baud, &youngProcessFrame_81000, &young_make_frame_81000, 3
+};
+
+/* End of serial_young.cxx */
@@ -0,0 +1,14 @@
+#ifndef SERIAL_YOUNG_H
+#define SERIAL_YOUNG_H
+
+#include <stdint.h>
+#include "anemometer_driver.h"
+
+extern const Anemometer_Driver_t young_81000_driver; // "RM Young 81000", 38400 baud
+
+void young_set_baud(int, int);
+void youngProcessFrame_81000(char*, int, int, int64_t);
+/* buf needs ANEMOMETER_MAX_FRAME_LENGTH bytes */
+int young_make_frame_81000(char* buf, float u, float v, float w, float T, int status);
+
+#endif
@@ -0,0 +1,231 @@
+/*
+ * Session index
+ *
+ * A line is written with a single append, so recorders stopping at the
+ * same time in one directory do not interleave their lines.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <map>
+#include <hdf5.h>
+#include "io/session_index.h"
+#include "io/record_reader.h"
+
+static void session_add(Session_Info_t* info, const char* key, const std::string& value)
+{
+    info->push_back(std::make_pair(std::string(key), value));
+}
+
+/* scalar strings and numbers, as text */
+static bool session_read_attribute(hid_t obj, const char* name, std::string* value)
+{
+    if (H5Aexists(obj, name) <= 0)
+        return false;
+    hid_t attr = H5Aopen(obj, name, H5P_DEFAULT);
+    hid_t type = H5Aget_type(attr);
+    hid_t space = H5Aget_space(attr);
+    bool ok = H5Sget_simple_extent_type(space) == H5S_SCALAR;
+    char buf[32];
+    if (!ok)
+        ;
+    else if (H5Tget_class(type) == H5T_STRING and H5Tis_variable_str(type) <= 0) {
+        value->assign(H5Tget_size(type), '\0');
+        ok = H5Aread(attr, type, &(*value)[0]) >= 0;
+        value->resize(strnlen(value->c_str(), value->size()));
+    }
+    else if (H5Tget_class(type) == H5T_INTEGER) {
+        long long v = 0;
+        ok = H5Aread(attr, H5T_NATIVE_LLONG, &v) >= 0;
+        snprintf(buf, sizeof(buf), "%lld", v);
+        *value = buf;
+    }
+    else if (H5Tget_class(type) == H5T_FLOAT) {
+        double v = 0.;
+        ok = H5Aread(attr, H5T_NATIVE_DOUBLE, &v) >= 0;
+        snprintf(buf, sizeof(buf), "%.17g", v);
+        *value = buf;
+    }
+    else
+        ok = false;
+    H5Sclose(space);
+    H5Tclose(type);
+    H5Aclose(attr);
+    return ok;
+}
+
+static herr_t session_root_attribute(hid_t obj, const char* name, const H5A_info_t*, void* data)
+{
+    std::string value;
+    if (session_read_attribute(obj, name, &value))
+        session_add((Session_Info_t*)data, name, value);
+    return 0;
+}
+
+/* key and value fit on a line of the index */
+static bool session_indexable(const std::string& key, const std::string& value)
+{
+    return !key.empty() and key.find_first_of("=\t\n") == std::string::npos
+        and value.find_first_of("\t\n") == std::string::npos;
+}
+
+bool WR_Session_describe(const char* name, Session_Info_t* info)
+{
+    Record_Reader_t reader;
+    if (!WR_Reader_open(name, &reader))
+        return false;
+    info->clear();
+
+    // as the reader found it
+    std::string file_name = name;
+    size_t n = file_name.size();
+    if (!(n > 3 and file_name.compare(n-3, 3, ".h5") == 0)
+            and !(n > 9 and file_name.compare(n-9, 9, ".manifest") == 0))
+        file_name += access((file_name + ".manifest").c_str(), F_OK) == 0 ? ".manifest" : ".h5";
+    session_add(info, "session", file_name.substr(file_name.rfind('/')+1));
+
+    uint64_t samples = 0;
+    int64_t first_t = INT64_MAX, last_t = INT64_MIN;
+    for (int i = 0; i < reader.num_sensors; i++) {
+        int64_t a, b;
+        samples += WR_Reader_get_num_samples(&reader, i);
+        if (WR_Reader_get_time_span(&reader, i, &a, &b)) {
+            first_t = a < first_t ? a : first_t;
+            last_t = b > last_t ? b : last_t;
+        }
+    }
+    char buf[64];
+    if (first_t <= last_t) {
+        int64_t ns = first_t - reader.anchor.monotonic + reader.anchor.realtime;
+        time_t sec = ns/1000000000LL;
+        struct tm tm;
+        strftime(buf, sizeof(buf), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&sec, &tm));
+        session_add(info, "start", buf);
+        snprintf(buf, sizeof(buf), "%.3f", (last_t - first_t)/1e9);
+        session_add(info, "duration_s", buf);
+    }
+    session_add(info, "anemometers", std::to_string(reader.num_sensors));
+    session_add(info, "samples", std::to_string(samples));
+    session_add(info, "segments", std::to_string(reader.segments.size()));
+    session_add(info, "closed", reader.closed ? "1" : "0");
+
+    // the first file has it all, every segment is written with the same
+    hid_t file = -1;
+    int n_sensors = reader.num_sensors;
+    std::string first_file = reader.segments[0].file_name;
+    WR_Reader_close(&reader);
+    if (access(first_file.c_str(), R_OK) == 0)
+        file = H5Fopen(first_file.c_str(), H5F_ACC_RDONLY, H5P_DEFAULT);
+    if (file < 0)
+        return true; // the counts are still worth indexing
+    std::string types, ports, bauds, value;
+    for (int i = 0; i < n_sensors; i++) {
+        snprintf(buf, sizeof(buf), "anemometer_%d", i+1);
+        hid_t group = H5Gopen2(file, buf, H5P_DEFAULT);
+        if (group < 0)
+            continue;
+        const char* sep = i ? "," : "";
+        types += sep + (session_read_attribute(group, "type", &value) ? value : "");
+        ports += sep + (session_read_attribute(group, "port", &value) ? value : "");
+        bauds += sep + (session_read_attribute(group, "baud", &value) ? value : "");
+        H5Gclose(group);
+    }
+    session_add(info, "types", types);
+    session_add(info, "ports", ports);
+    session_add(info, "bauds", bauds);
+    H5Aiterate2(file, H5_INDEX_NAME, H5_ITER_INC, NULL, &session_root_attribute, info);
+    H5Fclose(file);
+
+    return true;
+}
+
+std::string WR_Session_index_name(const char* name)
+{
+    const char* slash = strrchr(name, '/');
+    return slash ? std::string(name, slash+1 - name) + SESSION_INDEX_FILE : SESSION_INDEX_FILE;
+}
+
+bool WR_Session_index_add(const char* index_name, const Session_Info_t* info)
+{
+    std::string line;
+    for (size_t k = 0; k < info->size(); k++) {
+        const std::string& key = (*info)[k].first;
+        const std::string& value = (*info)[k].second;
+        if (!session_indexable(key, value))
+            continue;
+        line += line.empty() ? "" : "\t";
+        line += key + "=" + value;
+    }
+    line += "\n";
+
+    int fd = open(index_name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+        perror(index_name);
+        return false;
+    }
+    bool ok = write(fd, line.data(), line.size()) == (ssize_t)line.size();
+    if (!ok)
+        perror(index_name);
+    close(fd);
+    return ok;
+}
+
+bool WR_Session_index_load(const char* index_name, std::vector<Session_Info_t>* sessions)
+{
+    sessions->clear();
+    FILE* fp = fopen(index_name, "r");
+    if (fp == NULL) {
+        perror(index_name);
+        return false;
+    }
+    std::map<std::string, size_t> found; // session, entry
+    char* line = NULL;
+    size_t size = 0;
+    ssize_t len;
+    while ((len = getline(&line, &size, fp)) > 0) {
+        if (line[len-1] == '\n')
+            line[--len] = '\0';
+        if (len == 0 or line[0] == '#')
+            continue;
+        Session_Info_t info;
+        for (char* field = line; field; ) {
+            char* tab = strchr(field, '\t');
+            if (tab)
+                *tab = '\0';
+            char* eq = strchr(field, '=');
+            if (eq)
+                info.push_back(std::make_pair(std::string(field, eq - field), std::string(eq+1)));
+            field = tab ? tab+1 : NULL;
+        }
+        const char* session = WR_Session_get(&info, "session");
+        if (session == NULL)
+            continue;
+        std::map<std::string, size_t>::iterator it = found.find(session);
+        if (it != found.end())
+            (*sessions)[it->second] = info;
+        else {
+            found[session] = sessions->size();
+            sessions->push_back(info);
+        }
+    }
+    free(line);
+    fclose(fp);
+    return true;
+}
+
+const char* WR_Session_get(const Session_Info_t* info, const char* key)
+{
+    for (size_t k = 0; k < info->size(); k++)
+        if ((*info)[k].first == key)
+            return (*info)[k].second.c_str();
+    return NULL;
+}
+
+/* End of session_index.cxx */
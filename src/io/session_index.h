@@ -0,0 +1,50 @@
+/*
+ * Session index
+ *
+ * A small text file next to the records, WR_sessions.index, with a line
+ * per recorded session: tab separated key=value pairs describing it, so
+ * batch tools filter thousands of sessions without opening a record.
+ *
+ *   session      the manifest or record, relative to the index
+ *   start        UTC of the first sample, ISO 8601
+ *   duration_s   first to last sample
+ *   anemometers, samples, segments, closed
+ *   types, ports, bauds      of the sensors, comma separated in order
+ *   and the attributes of the records' root (see record.h), but for the
+ *   ones spanning lines, like "config"
+ *
+ * The recorder appends a line when it stops a session; a session found
+ * again (converted from its journal, say) gets a new line, the last line
+ * of a session counts. WR_Session_describe() makes a line from the
+ * records themselves, reading the attributes and the manifest's counts,
+ * to rebuild an index.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef SESSION_INDEX_H
+#define SESSION_INDEX_H
+
+#include <string>
+#include <vector>
+#include <utility>
+
+#define SESSION_INDEX_FILE  "WR_sessions.index"
+
+/* key=value pairs, in order */
+typedef std::vector< std::pair<std::string, std::string> > Session_Info_t;
+
+/* name is a record (.h5), a manifest (.manifest) or the session name without extension */
+bool WR_Session_describe(const char* name, Session_Info_t* info);
+/* index of the directory of a session or record */
+std::string WR_Session_index_name(const char* name);
+bool WR_Session_index_add(const char* index_name, const Session_Info_t* info);
+/* one entry per session, in the order they were first added */
+bool WR_Session_index_load(const char* index_name, std::vector<Session_Info_t>* sessions);
+/* NULL if info has no such key */
+const char* WR_Session_get(const Session_Info_t* info, const char* key);
+
+#endif
+
+/* End of session_index.h */
@@ -0,0 +1,85 @@
+/*
+ * Single-producer/single-consumer ring buffer
+ *
+ * Wait-free hand-off between exactly one writer thread and one reader
+ * thread. Head and tail indices live on their own cache lines, together
+ * with the opposite index cached by each side, so producer and consumer
+ * only touch the shared line when the cached view runs out.
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#ifndef SPSC_RING_H
+#define SPSC_RING_H
+
+#include <atomic>
+
+#ifndef CACHE_LINE_SIZE
+#define CACHE_LINE_SIZE 64
+#endif
+
+template <typename T, unsigned int N>
+class SPSC_Ring
+{
+public:
+    SPSC_Ring() : head(0), tail_cache(0), dropped(0), tail(0), head_cache(0) {}
+
+    /* producer side, returns false (and counts a drop) if full */
+    bool push(const T& item) {
+        unsigned int h = head.load(std::memory_order_relaxed);
+        if (h - tail_cache >= N) {
+            tail_cache = tail.load(std::memory_order_acquire);
+            if (h - tail_cache >= N) {
+                dropped.store(dropped.load(std::memory_order_relaxed)+1, std::memory_order_relaxed);
+                return false;
+            }
+        }
+        buf[h & (N-1)] = item;
+        head.store(h+1, std::memory_order_release);
+        return true;
+    }
+
+    /* consumer side, copies up to max items out, returns number copied */
+    int pop(T* items, int max) {
+        unsigned int t = tail.load(std::memory_order_relaxed);
+        if (head_cache == t)
+            head_cache = head.load(std::memory_order_acquire);
+        unsigned int n = head_cache - t;
+        if (n > (unsigned int)max) n = max;
+        for (unsigned int i = 0; i < n; i++)
+            items[i] = buf[(t+i) & (N-1)];
+        tail.store(t+n, std::memory_order_release);
+        return n;
+    }
+
+    /* only when neither side is running */
+    void reset(void) {
+        head.store(0); tail.store(0);
+        head_cache = tail_cache = 0;
+        dropped.store(0);
+    }
+
+    /* items waiting, any thread, only a hint while both sides run */
+    unsigned int size(void) const {
+        unsigned int t = tail.load(std::memory_order_acquire);
+        return head.load(std::memory_order_acquire) - t;
+    }
+
+    /* items lost because the consumer fell behind */
+    unsigned int num_dropped(void) const { return dropped.load(std::memory_order_relaxed); }
+
+private:
+    static_assert((N & (N-1)) == 0, "SPSC_Ring size must be a power of two");
+    // producer line
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> head;
+    unsigned int tail_cache;
+    std::atomic<unsigned int> dropped;
+    // consumer line
+    alignas(CACHE_LINE_SIZE) std::atomic<unsigned int> tail;
+    unsigned int head_cache;
+    // storage
+    alignas(CACHE_LINE_SIZE) T buf[N];
+};
+
+#endif
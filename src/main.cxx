@@ -20,8 +20,9 @@ int main(int argc, char **argv)
 {
     printf("start\n");
 
-    /* initialize GS settings */
-    //WR_Config_restore();
+    /* initialize GS settings, defaults first */
+    WR_Config_init();
+    WR_Config_restore();
    
     /* initialize communication among threads */
     //WR_init_thread_comm();
@@ -32,9 +33,10 @@ int main(int argc, char **argv)
     // Run
     Fl::run();
 
-    /*
     // save configs before closing
     WR_Config_save();
+
+    /*
     std::string port[20]; 
     port[0] = "/dev/ttyUSB0";
     std::string type[20]; 
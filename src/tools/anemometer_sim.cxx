@@ -0,0 +1,180 @@
+/*
+ * Anemometer Simulator
+ *
+ * Creates pseudo-terminals which behave like anemometers on serial ports,
+ * streaming Gill WindSonic polar, Gill WindMaster UVW or RM Young 81000
+ * ASCII frames at a fixed rate, for load testing WindRecorder without
+ * hardware. The slave side of
+ * every pty is an ordinary tty, so sonic_anemometer_init() opens it as it
+ * would open /dev/ttyUSBx.
+ *
+ * Usage: anemometer_sim [-n ports] [-t windsonic|windmaster|young|mixed] [-r rate_hz]
+ *                       [-s noise_m/s] [-c corrupt_ratio] [-l link_dir]
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <signal.h>
+#include <math.h>
+#include <time.h>
+#include <termios.h>
+#include <pty.h>
+#include <vector>
+#include <string>
+#include "io/anemometer_driver.h"
+
+typedef struct {
+    int master;
+    int slave; // kept open so the pty survives the recorder closing it
+    const Anemometer_Driver_t* driver;
+    double phase; // gust phase, differs between sensors
+    std::string path;
+    unsigned long frames;
+    unsigned long overruns; // frames not written, nobody reading
+} Sim_Port_t;
+
+static volatile bool exit_sim = false;
+
+static void sim_signal_handler(int sig)
+{
+    exit_sim = true;
+}
+
+static double sim_gauss(void)
+{
+    // Box-Muller
+    double u1 = (rand() + 1.) / (RAND_MAX + 2.);
+    double u2 = (rand() + 1.) / (RAND_MAX + 2.);
+    return sqrt(-2.*log(u1))*cos(2.*M_PI*u2);
+}
+
+static void sim_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-n ports] [-t windsonic|windmaster|young|mixed] [-r rate_hz]\n"
+            "          [-s noise_m/s] [-c corrupt_ratio] [-l link_dir]\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    int n_ports = 4;
+    const char* type = "windmaster";
+    double rate = 32.;
+    double noise = 0.1;
+    double corrupt = 0.;
+    const char* link_dir = NULL;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:r:s:c:l:h")) != -1) {
+        switch (opt) {
+            case 'n': n_ports = atoi(optarg); break;
+            case 't': type = optarg; break;
+            case 'r': rate = atof(optarg); break;
+            case 's': noise = atof(optarg); break;
+            case 'c': corrupt = atof(optarg); break;
+            case 'l': link_dir = optarg; break;
+            default: sim_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (n_ports < 1 or rate <= 0.) {
+        sim_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    // mixed cycles through all drivers able to build frames
+    std::vector<const Anemometer_Driver_t*> drivers;
+    for (int d = 0; d < anemometer_driver_count(); d++) {
+        const Anemometer_Driver_t* driver = anemometer_driver_get(d);
+        if (driver->make_frame == NULL)
+            continue;
+        if (strcmp(type, "mixed") == 0
+                or (strcmp(type, "windsonic") == 0 and strcmp(driver->name, "Gill WindSonic") == 0)
+                or (strcmp(type, "windmaster") == 0 and strcmp(driver->name, "Gill WindMaster") == 0)
+                or (strcmp(type, "young") == 0 and strcmp(driver->name, "RM Young 81000") == 0))
+            drivers.push_back(driver);
+    }
+    if (drivers.empty()) {
+        sim_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    // create ptys
+    std::vector<Sim_Port_t> ports(n_ports);
+    char name[256];
+    for (int i = 0; i < n_ports; i++) {
+        if (openpty(&ports[i].master, &ports[i].slave, name, NULL, NULL) < 0) {
+            perror("openpty");
+            return EXIT_FAILURE;
+        }
+        struct termios options;
+        tcgetattr(ports[i].slave, &options);
+        cfmakeraw(&options);
+        tcsetattr(ports[i].slave, TCSANOW, &options);
+        fcntl(ports[i].master, F_SETFL, fcntl(ports[i].master, F_GETFL) | O_NONBLOCK);
+        ports[i].path = name;
+        ports[i].driver = drivers[i % drivers.size()];
+        ports[i].phase = 2.*M_PI*i/n_ports;
+        ports[i].frames = 0;
+        ports[i].overruns = 0;
+        if (link_dir) {
+            snprintf(name, sizeof(name), "%s/ttyWR_SIM_%d", link_dir, i+1);
+            unlink(name);
+            if (symlink(ports[i].path.c_str(), name) == 0)
+                ports[i].path = name;
+            else
+                perror(name);
+        }
+        printf("%s\t%s\n", ports[i].path.c_str(), ports[i].driver->name);
+    }
+    fflush(stdout);
+
+    signal(SIGINT, sim_signal_handler);
+    signal(SIGTERM, sim_signal_handler);
+
+    // stream frames
+    char frame[ANEMOMETER_MAX_FRAME_LENGTH];
+    long period_ns = (long)(1e9/rate);
+    struct timespec next;
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    double t = 0.;
+    while (!exit_sim) {
+        for (int i = 0; i < n_ports; i++) {
+            // mean wind from the south-west with a slow gust and turbulence
+            double gust = 1. + 0.5*sin(0.2*t + ports[i].phase);
+            float u = 2.*gust + noise*sim_gauss();
+            float v = 1.5*gust + noise*sim_gauss();
+            float w = 0.1*sin(1.3*t + ports[i].phase) + noise*sim_gauss();
+            float T = 20. + 0.5*sin(0.05*t) + 0.1*noise*sim_gauss();
+            int len = ports[i].driver->make_frame(frame, u, v, w, T, 0);
+            if (corrupt > 0. and rand() < corrupt*RAND_MAX) // flip a bit of a random byte
+                frame[rand() % len] ^= 1 << (rand() % 8);
+            if (write(ports[i].master, frame, len) == len)
+                ports[i].frames++;
+            else
+                ports[i].overruns++;
+        }
+        t += 1./rate;
+        next.tv_nsec += period_ns;
+        while (next.tv_nsec >= 1000000000L) {
+            next.tv_nsec -= 1000000000L;
+            next.tv_sec++;
+        }
+        clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL);
+    }
+
+    for (int i = 0; i < n_ports; i++) {
+        fprintf(stderr, "%s: %lu frames sent, %lu not written\n", ports[i].path.c_str(),
+                ports[i].frames, ports[i].overruns);
+        if (link_dir)
+            unlink(ports[i].path.c_str());
+        close(ports[i].master);
+        close(ports[i].slave);
+    }
+
+    return 0;
+}
@@ -0,0 +1,411 @@
+/*
+ * Export of recorded sessions to CSV/TSV
+ *
+ * Streams the samples of a recorded session (see io/record_reader.h) to
+ * a text table, one row per sample: anemometer, then the chosen columns.
+ * Rows come sensor after sensor, each sensor's in time order.
+ *
+ * Each sensor's samples are cut into blocks, which worker threads take in
+ * turn: read (one thread at a time, HDF5 serializes reads anyway), format
+ * into the worker's own buffer, then write in block order. Numbers are
+ * formatted by hand, no printf and no allocation per value: floats are
+ * rounded to a fixed number of decimals, which loses nothing as the
+ * anemometers send two.
+ *
+ * Usage: wr_export [-a anemometers] [-c columns] [-b begin_s] [-e end_s]
+ *                  [-t] [-u] [-d decimals] [-j threads] [-o file] session
+ *          anemometers as 1,3,5-8 (default all), columns as time,u,v,w,T,
+ *          status,latency (default all); begin_s and end_s are seconds
+ *          from the start of the session; -t writes TSV instead of CSV;
+ *          times are UTC ISO 8601 with microseconds, or with -u Unix
+ *          seconds; decimals of u, v, w & T default to 2; output goes
+ *          to stdout without -o
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <pthread.h>
+#include <atomic>
+#include <string>
+#include <vector>
+#include "io/serial.h" // serial_clock_ns()
+#include "io/record_reader.h"
+
+#define EXPORT_BLOCK            65536 // samples formatted at once by a worker
+#define EXPORT_MAX_THREADS      64
+#define EXPORT_MAX_DECIMALS     9
+
+typedef struct {
+    int index; // anemometer
+    uint64_t first;
+    size_t count;
+} Export_Block_t;
+
+typedef struct {
+    Reader_Columns_t columns;
+    std::vector<char> buf;
+    int64_t cached_second; // ISO prefix of this second in prefix
+    char prefix[32];
+    int prefix_len;
+} Export_Worker_t;
+
+/* options */
+static unsigned columns = READER_COLUMNS_ALL;
+static char separator = ',';
+static bool unix_time = false;
+static int decimals = 2;
+static int64_t scale = 1; // 10^decimals
+static int out_fd = 1;
+
+static Record_Reader_t reader;
+static std::vector<Export_Block_t> blocks;
+static size_t next_block = 0; // to be read
+static size_t written_block = 0; // next to be written
+static std::atomic<bool> failed(false);
+static uint64_t bytes_written = 0;
+static pthread_mutex_t read_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t write_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
+
+static const char export_digit_pairs[201] =
+    "00010203040506070809101112131415161718192021222324252627282930313233343536373839"
+    "40414243444546474849505152535455565758596061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+static inline char* export_uint(char* p, uint64_t v)
+{
+    char tmp[20];
+    char* q = tmp + sizeof(tmp);
+    while (v >= 100) {
+        q -= 2;
+        memcpy(q, export_digit_pairs + 2*(v % 100), 2);
+        v /= 100;
+    }
+    if (v >= 10) {
+        q -= 2;
+        memcpy(q, export_digit_pairs + 2*v, 2);
+    }
+    else
+        *--q = '0' + v;
+    size_t n = tmp + sizeof(tmp) - q;
+    memcpy(p, q, n);
+    return p + n;
+}
+
+static inline char* export_int(char* p, int64_t v)
+{
+    if (v < 0) {
+        *p++ = '-';
+        return export_uint(p, -(uint64_t)v);
+    }
+    return export_uint(p, v);
+}
+
+/* exactly n digits, zero padded */
+static inline char* export_digits(char* p, uint64_t v, int n)
+{
+    for (int i = n-1; i >= 0; i--) {
+        p[i] = '0' + v % 10;
+        v /= 10;
+    }
+    return p + n;
+}
+
+static inline char* export_fixed(char* p, float value, int n_decimals, int64_t n_scale)
+{
+    double x = (double)value*n_scale;
+    if (!(fabs(x) < 9e18)) { // nan, inf, or out of range of the integer part
+        return p + sprintf(p, "%g", value);
+    }
+    int64_t n = llround(x);
+    if (n < 0) {
+        *p++ = '-';
+        n = -n;
+    }
+    p = export_uint(p, n/n_scale);
+    if (n_decimals) {
+        *p++ = '.';
+        p = export_digits(p, n % n_scale, n_decimals);
+    }
+    return p;
+}
+
+/* UTC, ISO 8601 with microseconds, the date & time of the second cached */
+static inline char* export_time(Export_Worker_t* worker, char* p, int64_t t)
+{
+    int64_t ns = t - reader.anchor.monotonic + reader.anchor.realtime;
+    int64_t second = ns >= 0 ? ns/1000000000LL : (ns - 999999999LL)/1000000000LL;
+    int64_t us = (ns - second*1000000000LL)/1000;
+    if (unix_time) {
+        p = export_int(p, second);
+        *p++ = '.';
+        return export_digits(p, us, 6);
+    }
+    if (second != worker->cached_second) {
+        time_t sec = second;
+        struct tm tm;
+        gmtime_r(&sec, &tm);
+        worker->prefix_len = strftime(worker->prefix, sizeof(worker->prefix), "%Y-%m-%dT%H:%M:%S.", &tm);
+        worker->cached_second = second;
+    }
+    memcpy(p, worker->prefix, worker->prefix_len);
+    p = export_digits(p + worker->prefix_len, us, 6);
+    *p++ = 'Z';
+    return p;
+}
+
+static char* export_format(Export_Worker_t* worker, int index, char* p)
+{
+    const Reader_Columns_t* c = &worker->columns;
+    for (size_t k = 0; k < c->count; k++) {
+        p = export_uint(p, index+1);
+        if (columns & READER_COLUMN(RECORD_FIELD_TIME)) {
+            *p++ = separator;
+            p = export_time(worker, p, c->time[k]);
+        }
+        const std::vector<float>* floats[4] = {&c->u, &c->v, &c->w, &c->T};
+        for (int f = 0; f < 4; f++)
+            if (columns & READER_COLUMN(RECORD_FIELD_U+f)) {
+                *p++ = separator;
+                p = export_fixed(p, (*floats[f])[k], decimals, scale);
+            }
+        if (columns & READER_COLUMN(RECORD_FIELD_STATUS)) {
+            *p++ = separator;
+            p = export_int(p, c->status[k]);
+        }
+        if (columns & READER_COLUMN(RECORD_FIELD_LATENCY)) {
+            *p++ = separator;
+            p = export_int(p, c->latency[k]);
+        }
+        *p++ = '\n';
+    }
+    return p;
+}
+
+static bool export_write(const char* buf, size_t n)
+{
+    while (n > 0) {
+        ssize_t w = write(out_fd, buf, n);
+        if (w < 0) {
+            perror("write");
+            return false;
+        }
+        buf += w;
+        n -= w;
+    }
+    return true;
+}
+
+static void* export_worker(void* arg)
+{
+    Export_Worker_t* worker = (Export_Worker_t*)arg;
+    for (;;) {
+        // read the next block, blocks are taken in order
+        pthread_mutex_lock(&read_mutex);
+        size_t b = next_block++;
+        bool ok = b < blocks.size() and !failed;
+        if (ok)
+            ok = WR_Reader_read(&reader, blocks[b].index, blocks[b].first, blocks[b].count,
+                    columns, &worker->columns) == blocks[b].count;
+        pthread_mutex_unlock(&read_mutex);
+        if (b >= blocks.size())
+            break;
+
+        char* end = ok ? export_format(worker, blocks[b].index, worker->buf.data()) : worker->buf.data();
+
+        // and write it in turn
+        pthread_mutex_lock(&write_mutex);
+        while (written_block != b)
+            pthread_cond_wait(&write_cond, &write_mutex);
+        if (!ok and !failed) {
+            fprintf(stderr, "ERROR: could not read anemometer %d\n", blocks[b].index+1);
+            failed = true;
+        }
+        if (!failed) {
+            failed = !export_write(worker->buf.data(), end - worker->buf.data());
+            bytes_written += end - worker->buf.data();
+        }
+        written_block++;
+        pthread_cond_broadcast(&write_cond);
+        pthread_mutex_unlock(&write_mutex);
+    }
+    return 0;
+}
+
+/* "1,3,5-8" */
+static bool export_parse_anemometers(const char* list, int n_sensors, std::vector<int>* indices)
+{
+    const char* p = list;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        long last = first;
+        if (end == p)
+            return false;
+        if (*end == '-') {
+            p = end+1;
+            last = strtol(p, &end, 10);
+            if (end == p)
+                return false;
+        }
+        if (first < 1 or last > n_sensors or first > last)
+            return false;
+        for (long i = first; i <= last; i++)
+            indices->push_back(i-1);
+        p = *end == ',' ? end+1 : end;
+        if (*end and *end != ',')
+            return false;
+    }
+    return !indices->empty();
+}
+
+/* "time,u,T" */
+static bool export_parse_columns(const char* list, unsigned* mask)
+{
+    *mask = 0;
+    std::string s = list;
+    size_t p = 0;
+    while (p <= s.size()) {
+        size_t comma = s.find(',', p);
+        std::string name = s.substr(p, comma == std::string::npos ? std::string::npos : comma - p);
+        int f = 0;
+        while (f < RECORD_NUM_FIELDS and name != WR_Record_get_field_name(f))
+            f++;
+        if (f == RECORD_NUM_FIELDS)
+            return false;
+        *mask |= READER_COLUMN(f);
+        if (comma == std::string::npos)
+            break;
+        p = comma+1;
+    }
+    return *mask != 0;
+}
+
+static void export_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-a anemometers] [-c columns] [-b begin_s] [-e end_s]\n"
+            "          [-t] [-u] [-d decimals] [-j threads] [-o file] session\n"
+            "          anemometers as 1,3,5-8, columns as time,u,v,w,T,status,latency\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    const char* anemometer_list = NULL;
+    const char* column_list = NULL;
+    const char* out_name = NULL;
+    double begin_s = 0., end_s = -1.;
+    long n_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int n_threads = n_cpus > 0 ? n_cpus : 1;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:c:b:e:tud:j:o:h")) != -1) {
+        switch (opt) {
+            case 'a': anemometer_list = optarg; break;
+            case 'c': column_list = optarg; break;
+            case 'b': begin_s = atof(optarg); break;
+            case 'e': end_s = atof(optarg); break;
+            case 't': separator = '\t'; break;
+            case 'u': unix_time = true; break;
+            case 'd': decimals = atoi(optarg); break;
+            case 'j': n_threads = atoi(optarg); break;
+            case 'o': out_name = optarg; break;
+            default: export_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc or decimals < 0 or decimals > EXPORT_MAX_DECIMALS
+            or n_threads < 1 or n_threads > EXPORT_MAX_THREADS) {
+        export_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    for (int i = 0; i < decimals; i++)
+        scale *= 10;
+    if (column_list and !export_parse_columns(column_list, &columns)) {
+        fprintf(stderr, "ERROR: columns are time, u, v, w, T, status and latency\n");
+        return EXIT_FAILURE;
+    }
+
+    int64_t start = serial_clock_ns();
+    if (!WR_Reader_open(argv[optind], &reader))
+        return EXIT_FAILURE;
+    std::vector<int> indices;
+    if (anemometer_list == NULL)
+        for (int i = 0; i < reader.num_sensors; i++)
+            indices.push_back(i);
+    else if (!export_parse_anemometers(anemometer_list, reader.num_sensors, &indices)) {
+        fprintf(stderr, "ERROR: the session has anemometers 1 to %d\n", reader.num_sensors);
+        WR_Reader_close(&reader);
+        return EXIT_FAILURE;
+    }
+
+    // blocks of each sensor's samples in the time range
+    int64_t session_start = WR_Reader_get_start_time(&reader);
+    int64_t t0 = session_start + (int64_t)(begin_s*1e9);
+    int64_t t1 = end_s < 0. ? INT64_MAX : session_start + (int64_t)(end_s*1e9);
+    uint64_t total = 0;
+    for (size_t k = 0; k < indices.size(); k++) {
+        uint64_t first = WR_Reader_find(&reader, indices[k], t0);
+        uint64_t last = t1 > t0 ? WR_Reader_find(&reader, indices[k], t1) : first;
+        for (uint64_t p = first; p < last; p += EXPORT_BLOCK) {
+            Export_Block_t block = {indices[k], p, (size_t)(last - p < EXPORT_BLOCK ? last - p : EXPORT_BLOCK)};
+            blocks.push_back(block);
+        }
+        total += last - first;
+    }
+
+    if (out_name) {
+        out_fd = open(out_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (out_fd < 0) {
+            perror(out_name);
+            WR_Reader_close(&reader);
+            return EXIT_FAILURE;
+        }
+    }
+    std::string header = "anemometer";
+    for (int f = 0; f < RECORD_NUM_FIELDS; f++)
+        if (columns & READER_COLUMN(f))
+            header += std::string(1, separator) + WR_Record_get_field_name(f);
+    header += "\n";
+    if (!export_write(header.c_str(), header.size()))
+        failed = true; // the workers skip everything
+    bytes_written = header.size();
+
+    // room for the longest rows
+    size_t row_size = 8 + 32 + 4*(24 + decimals) + 2*12;
+    int n_workers = (size_t)n_threads < blocks.size() ? n_threads : (blocks.empty() ? 1 : blocks.size());
+    std::vector<Export_Worker_t> workers(n_workers);
+    std::vector<pthread_t> handles(n_workers);
+    int n_started = 0;
+    for (; n_started < n_workers; n_started++) {
+        workers[n_started].buf.resize(EXPORT_BLOCK*row_size);
+        workers[n_started].cached_second = INT64_MIN;
+        if (pthread_create(&handles[n_started], NULL, &export_worker, &workers[n_started]) != 0) {
+            // those started take all the blocks
+            fprintf(stderr, "ERROR: could not start export thread %d\n", n_started+1);
+            if (n_started == 0)
+                failed = true;
+            break;
+        }
+    }
+    for (int i = 0; i < n_started; i++)
+        pthread_join(handles[i], NULL);
+    WR_Reader_close(&reader);
+    if (out_name and close(out_fd) < 0) {
+        perror(out_name);
+        failed = true;
+    }
+
+    double seconds = (serial_clock_ns() - start)/1e9;
+    fprintf(stderr, "%llu samples of %d anemometers, %.1f MB in %.2f s, %.0f MB/s\n",
+            (unsigned long long)total, (int)indices.size(), bytes_written/1e6, seconds,
+            bytes_written/1e6/seconds);
+
+    return failed ? EXIT_FAILURE : 0;
+}
@@ -0,0 +1,149 @@
+/*
+ * Eddy-covariance fluxes of recorded sessions
+ *
+ * Runs the recorded samples of a session (see io/record_reader.h) through
+ * the same block accumulator as the acquisition's flux stage (see
+ * io/eddy_flux.h) and prints the fluxes of every block, in one pass.
+ *
+ * Usage: wr_flux [-a anemometer] [-l block_s] [-p pressure_hPa] session
+ *          of every 3-D anemometer of the session (by the types it was
+ *          recorded with) or only of anemometer (1, 2, ...); blocks of
+ *          block_s seconds (default 1800) aligned to wall clock; air
+ *          pressure for the density defaults to 1013.25 hPa
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "io/serial.h" // serial_clock_ns()
+#include "io/record_reader.h"
+#include "io/session_index.h"
+#include "io/anemometer_driver.h"
+#include "io/eddy_flux.h"
+
+#define FLUX_READ_BLOCK 65536 // samples read at once
+
+static void flux_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-a anemometer] [-l block_s] [-p pressure_hPa] session\n", name);
+}
+
+static void flux_print(const Record_Reader_t* reader, int index, const Eddy_Flux_t* flux)
+{
+    char when[32];
+    time_t sec = (flux->t - reader->anchor.monotonic + reader->anchor.realtime)/1000000000LL;
+    struct tm tm;
+    strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime_r(&sec, &tm));
+    printf("%d %s %llu %llu %.3f %.1f %.2f %.2f %.2f %.4f %.4f %.4f %.4f %.5f %.5f %.5f %.4f %.4f %.2f\n",
+            index+1, when, (unsigned long long)flux->count, (unsigned long long)flux->flagged,
+            flux->speed, flux->direction, flux->yaw, flux->pitch, flux->T,
+            flux->sigma[0], flux->sigma[1], flux->sigma[2], flux->sigma[3],
+            flux->uw, flux->vw, flux->wT, flux->u_star, flux->tau, flux->H);
+}
+
+/* types recorded with the session, empty if unknown */
+static std::vector<std::string> flux_types(const char* name, int n_sensors)
+{
+    std::vector<std::string> types;
+    Session_Info_t info;
+    const char* list = WR_Session_describe(name, &info) ? WR_Session_get(&info, "types") : NULL;
+    for (const char* p = list; p and *p; ) {
+        size_t n = strcspn(p, ",");
+        types.push_back(std::string(p, n));
+        p += p[n] ? n+1 : n;
+    }
+    if ((int)types.size() != n_sensors)
+        types.clear();
+    return types;
+}
+
+int main(int argc, char **argv)
+{
+    int anemometer = 0; // the 3-D ones
+    double block_s = EDDY_FLUX_DEFAULT_BLOCK_S;
+    double pressure = EDDY_FLUX_DEFAULT_PRESSURE;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:l:p:h")) != -1) {
+        switch (opt) {
+            case 'a': anemometer = atoi(optarg); break;
+            case 'l': block_s = atof(optarg); break;
+            case 'p': pressure = atof(optarg)*100.; break;
+            default: flux_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc or block_s < 1. or pressure <= 0.) {
+        flux_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int64_t start = serial_clock_ns();
+    Record_Reader_t reader;
+    if (!WR_Reader_open(argv[optind], &reader))
+        return EXIT_FAILURE;
+    if (anemometer < 0 or anemometer > reader.num_sensors) {
+        fprintf(stderr, "ERROR: the session has anemometers 1 to %d\n", reader.num_sensors);
+        WR_Reader_close(&reader);
+        return EXIT_FAILURE;
+    }
+    std::vector<std::string> types = flux_types(argv[optind], reader.num_sensors);
+
+    int64_t width = (int64_t)(block_s*1e9);
+    int64_t offset = reader.anchor.realtime - reader.anchor.monotonic;
+    printf("# anemometer, block start, samples, flagged, speed, direction, yaw, pitch, T, "
+            "sigma u, v, w, T, u'w', v'w', w'T', u*, tau, H\n");
+    Reader_Columns_t columns;
+    Anemometer_Data_t sample;
+    uint64_t total = 0;
+    for (int i = 0; i < reader.num_sensors; i++) {
+        if (anemometer and i != anemometer-1)
+            continue;
+        if (!anemometer and !types.empty()) {
+            const Anemometer_Driver_t* driver = anemometer_driver_find(types[i].c_str());
+            if (driver == NULL or driver->axes != 3)
+                continue;
+        }
+        Eddy_Flux_Accum_t acc;
+        Eddy_Flux_t flux;
+        bool open = false;
+        uint64_t n = WR_Reader_get_num_samples(&reader, i);
+        for (uint64_t first = 0; first < n; first += FLUX_READ_BLOCK) {
+            size_t count = WR_Reader_read(&reader, i, first, FLUX_READ_BLOCK,
+                    READER_COLUMNS_WIND | READER_COLUMN(RECORD_FIELD_TIME) | READER_COLUMN(RECORD_FIELD_STATUS),
+                    &columns);
+            for (size_t k = 0; k < count; k++) {
+                sample.t = columns.time[k];
+                sample.speed[0] = columns.u[k];
+                sample.speed[1] = columns.v[k];
+                sample.speed[2] = columns.w[k];
+                sample.temperature = columns.T[k];
+                sample.status = columns.status[k];
+                if (!open or sample.t >= acc.t0 + width) {
+                    if (open and eddy_flux_compute(&acc, pressure, &flux))
+                        flux_print(&reader, i, &flux);
+                    int64_t r = (sample.t + offset) % width;
+                    eddy_flux_clear(&acc, sample.t - (r < 0 ? r + width : r));
+                    open = true;
+                }
+                eddy_flux_add(&acc, &sample);
+            }
+            total += count;
+        }
+        // the last block, likely partial
+        if (open and eddy_flux_compute(&acc, pressure, &flux))
+            flux_print(&reader, i, &flux);
+    }
+    printf("# %llu samples in %.3f s\n", (unsigned long long)total, (serial_clock_ns() - start)/1e9);
+    WR_Reader_close(&reader);
+
+    return 0;
+}
+
+/* End of wr_flux.cxx */
@@ -0,0 +1,136 @@
+/*
+ * Sample journal to HDF5
+ *
+ * Rebuilds an HDF5 record, laid out as WindRecorder writes it, from a
+ * sample journal (see io/journal.h). Works on journals of sessions which
+ * ended in a crash or a power cut: all committed records are converted,
+ * and so are the intact ones written after the last commit.
+ *
+ * Usage: wr_journal2h5 [-f] [-z deflate_level] [-d decimals] [-o record.h5] journal_file
+ *          -f overwrites an existing record, the default output is the
+ *          journal name with .wrj replaced by .h5; -z and -d compress as
+ *          WR_Record_set_compression() does
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "io/journal.h"
+#include "io/record.h"
+
+#define JOURNAL2H5_BLOCK    65536 // records sorted by sensor at once
+
+static void journal2h5_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-f] [-z deflate_level] [-d decimals] [-o record.h5] journal_file\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    bool force = false;
+    int deflate_level = 0;
+    int decimals = -1;
+    std::string record_name;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "fz:d:o:h")) != -1) {
+        switch (opt) {
+            case 'f': force = true; break;
+            case 'z': deflate_level = atoi(optarg); break;
+            case 'd': decimals = atoi(optarg); break;
+            case 'o': record_name = optarg; break;
+            default: journal2h5_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        journal2h5_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char* journal_name = argv[optind];
+    if (record_name.empty()) {
+        record_name = journal_name;
+        size_t ext = record_name.rfind(".wrj");
+        if (ext != std::string::npos)
+            record_name.erase(ext);
+        record_name += ".h5";
+    }
+    if (!force and access(record_name.c_str(), F_OK) == 0) {
+        fprintf(stderr, "ERROR: %s exists, use -f to overwrite it\n", record_name.c_str());
+        return EXIT_FAILURE;
+    }
+
+    if (!WR_Record_set_compression(deflate_level, decimals)) {
+        fprintf(stderr, "ERROR: deflate level 1 to 9 (if HDF5 has zlib), decimals 0 or more\n");
+        return EXIT_FAILURE;
+    }
+
+    Journal_Reader_t journal;
+    if (!WR_Journal_open(journal_name, &journal))
+        return EXIT_FAILURE;
+    int n_sensors = journal.header->n_sensors;
+    if (journal.num_records > journal.header->committed)
+        printf("%llu records written after the last commit recovered\n",
+                (unsigned long long)(journal.num_records - journal.header->committed));
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!WR_Record_start(n_sensors, record_name.c_str(), false)) {
+        fprintf(stderr, "ERROR: could not create %s\n", record_name.c_str());
+        WR_Journal_close(&journal);
+        return EXIT_FAILURE;
+    }
+    Anemometer_Time_Anchor_t anchor;
+    anchor.realtime = journal.header->time_anchor_realtime;
+    anchor.monotonic = journal.header->time_anchor_monotonic;
+    WR_Record_set_time_anchor(&anchor);
+    for (int i = 0; i < n_sensors; i++) {
+        const Capture_Sensor_Info_t* info = &journal.sensors[i];
+        std::string type(info->type, strnlen(info->type, sizeof(info->type)));
+        std::string port(info->port, strnlen(info->port, sizeof(info->port)));
+        WR_Record_set_sensor_info(i, type.c_str(), port.c_str());
+    }
+
+    // records of the sensors are interleaved, hand them over per sensor
+    std::vector< std::vector<Anemometer_Data_t> > samples(n_sensors);
+    std::vector<uint64_t> counts(n_sensors, 0);
+    for (uint64_t first = 0; first < journal.num_records; first += JOURNAL2H5_BLOCK) {
+        uint64_t last = first + JOURNAL2H5_BLOCK < journal.num_records ? first + JOURNAL2H5_BLOCK
+            : journal.num_records;
+        for (uint64_t r = first; r < last; r++) {
+            const Journal_Record_t* rec = &journal.records[r];
+            Anemometer_Data_t sample;
+            sample.t = rec->t;
+            sample.speed[0] = rec->speed[0];
+            sample.speed[1] = rec->speed[1];
+            sample.speed[2] = rec->speed[2];
+            sample.temperature = rec->temperature;
+            sample.status = rec->status;
+            sample.latency = rec->latency;
+            samples[rec->index].push_back(sample);
+        }
+        for (int i = 0; i < n_sensors; i++) {
+            WR_Record_append(i, samples[i].data(), samples[i].size());
+            counts[i] += samples[i].size();
+            samples[i].clear();
+        }
+    }
+    WR_Record_stop();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int i = 0; i < n_sensors; i++)
+        printf("%4d  %-16s %-24s %10llu samples\n", i+1, journal.sensors[i].type,
+                journal.sensors[i].port, (unsigned long long)counts[i]);
+    double seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)/1e9;
+    printf("%llu samples in %.3f s, %.0f samples/s\n", (unsigned long long)journal.num_records,
+            seconds, journal.num_records/seconds);
+    WR_Journal_close(&journal);
+
+    return 0;
+}
@@ -0,0 +1,160 @@
+/*
+ * Reading of recorded sessions
+ *
+ * Prints what a recorded session holds, or reads a time range of it
+ * through the record reader (see io/record_reader.h), samples or their
+ * statistics, and reports how long opening and reading took.
+ *
+ * Usage: wr_read [-a anemometer] [-b begin_s] [-e end_s] [-p | -m | -w width_s] session
+ *          session is a record (.h5), a manifest or the session name;
+ *          with -b and/or -e, the samples from begin_s to end_s seconds
+ *          after the start of the session are read, of every anemometer
+ *          or only of anemometer (1, 2, ...); -p prints them, -m prints
+ *          their mean, standard deviation, min and max instead, -w the
+ *          same in bins of width_s seconds
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include "io/serial.h" // serial_clock_ns()
+#include "io/record_reader.h"
+
+static void read_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-a anemometer] [-b begin_s] [-e end_s] [-p | -m | -w width_s] session\n", name);
+}
+
+/* local wall clock of a sample time */
+static void read_format_time(const Record_Reader_t* reader, int64_t t, char* buf, size_t size)
+{
+    int64_t ns = t - reader->anchor.monotonic + reader->anchor.realtime;
+    time_t sec = ns/1000000000LL;
+    size_t n = strftime(buf, size, "%Y-%m-%d %H:%M:%S", localtime(&sec));
+    snprintf(buf + n, size - n, ".%03d", (int)(ns/1000000 % 1000));
+}
+
+static void read_print_summary(const Record_Reader_t* reader, int index, const Record_Summary_t* summary)
+{
+    char when[64];
+    read_format_time(reader, summary->t, when, sizeof(when));
+    printf("%d %s %u %u", index+1, when, summary->count, summary->flagged);
+    for (int f = 0; f < 4; f++)
+        printf("  %.3f %.3f %.2f %.2f", summary->mean[f], sqrt(summary->var[f]), summary->min[f], summary->max[f]);
+    printf("\n");
+}
+
+static void read_print_info(Record_Reader_t* reader)
+{
+    printf("%d anemometers, %d segment%s%s\n", reader->num_sensors, (int)reader->segments.size(),
+            reader->segments.size() > 1 ? "s" : "", reader->closed ? "" : ", not closed properly");
+    char first[64], last[64];
+    for (int i = 0; i < reader->num_sensors; i++) {
+        int64_t first_t, last_t;
+        uint64_t n = WR_Reader_get_num_samples(reader, i);
+        if (!WR_Reader_get_time_span(reader, i, &first_t, &last_t)) {
+            printf("%4d  no samples\n", i+1);
+            continue;
+        }
+        read_format_time(reader, first_t, first, sizeof(first));
+        read_format_time(reader, last_t, last, sizeof(last));
+        printf("%4d  %10llu samples  %s to %s\n", i+1, (unsigned long long)n, first, last);
+    }
+}
+
+int main(int argc, char **argv)
+{
+    int anemometer = 0; // all
+    double begin_s = 0., end_s = -1.;
+    bool ranged = false, print = false, aggregate = false;
+    double width_s = 0.;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "a:b:e:pmw:h")) != -1) {
+        switch (opt) {
+            case 'a': anemometer = atoi(optarg); break;
+            case 'b': begin_s = atof(optarg); ranged = true; break;
+            case 'e': end_s = atof(optarg); ranged = true; break;
+            case 'p': print = true; break;
+            case 'm': aggregate = true; ranged = true; break;
+            case 'w': width_s = atof(optarg); ranged = true; break;
+            default: read_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc) {
+        read_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    int64_t start = serial_clock_ns();
+    Record_Reader_t reader;
+    if (!WR_Reader_open(argv[optind], &reader))
+        return EXIT_FAILURE;
+    int64_t opened = serial_clock_ns();
+    if (anemometer < 0 or anemometer > reader.num_sensors) {
+        fprintf(stderr, "ERROR: the session has anemometers 1 to %d\n", reader.num_sensors);
+        WR_Reader_close(&reader);
+        return EXIT_FAILURE;
+    }
+    if (!ranged) {
+        read_print_info(&reader);
+        printf("opened in %.3f ms, read in %.3f ms\n", (opened - start)/1e6,
+                (serial_clock_ns() - opened)/1e6);
+        WR_Reader_close(&reader);
+        return 0;
+    }
+
+    int64_t t0 = WR_Reader_get_start_time(&reader) + (int64_t)(begin_s*1e9);
+    int64_t t1 = end_s < 0. ? INT64_MAX : WR_Reader_get_start_time(&reader) + (int64_t)(end_s*1e9);
+    int first = anemometer ? anemometer-1 : 0;
+    int last = anemometer ? anemometer : reader.num_sensors;
+    Reader_Columns_t columns;
+    uint64_t total = 0;
+    char when[64];
+    if (aggregate or width_s > 0.) {
+        printf("# anemometer, start, samples, flagged, mean, std, min & max of u, v, w, T\n");
+        std::vector<Record_Summary_t> series(1);
+        for (int i = first; i < last; i++) {
+            if (aggregate) {
+                int level = WR_Reader_aggregate(&reader, i, t0, t1, &series[0]);
+                if (level >= 0)
+                    printf("# from %s and finer\n", WR_Record_get_summary_name(level));
+            }
+            else
+                WR_Reader_read_series(&reader, i, t0, t1, (int64_t)(width_s*1e9), &series);
+            for (size_t k = 0; k < series.size(); k++) {
+                read_print_summary(&reader, i, &series[k]);
+                total += series[k].count + series[k].flagged;
+            }
+        }
+        printf("# %llu samples, opened in %.3f ms, read in %.3f ms\n", (unsigned long long)total,
+                (opened - start)/1e6, (serial_clock_ns() - opened)/1e6);
+        WR_Reader_close(&reader);
+        return 0;
+    }
+    for (int i = first; i < last; i++) {
+        size_t n = WR_Reader_read_range(&reader, i, t0, t1, READER_COLUMNS_ALL, &columns);
+        total += n;
+        if (!print) {
+            printf("%4d  %10llu samples from #%llu\n", i+1, (unsigned long long)n,
+                    (unsigned long long)columns.first);
+            continue;
+        }
+        for (size_t k = 0; k < n; k++) {
+            read_format_time(&reader, columns.time[k], when, sizeof(when));
+            printf("%d %s %.2f %.2f %.2f %.2f %d %d\n", i+1, when, columns.u[k], columns.v[k],
+                    columns.w[k], columns.T[k], columns.status[k], columns.latency[k]);
+        }
+    }
+    int64_t done = serial_clock_ns();
+    fprintf(print ? stderr : stdout, "%llu samples, opened in %.3f ms, read in %.3f ms\n",
+            (unsigned long long)total, (opened - start)/1e6, (done - opened)/1e6);
+    WR_Reader_close(&reader);
+
+    return 0;
+}
@@ -0,0 +1,101 @@
+/*
+ * Replay of a raw serial capture
+ *
+ * Feeds a capture file (see io/capture.h) through the anemometer parsers
+ * and the sample pipeline, optionally recording the samples to HDF5 as
+ * WindRecorder would have, and reports parsing and recording throughput.
+ * Useful to benchmark the parsers and the recorder offline on field data
+ * and to reproduce field problems.
+ *
+ * Usage: wr_replay [-s speed] [-j threads] [-o record.h5] [-d segment_s] [-m segment_MiB] capture_file
+ *          speed 1 replays in real time (default), N N times faster,
+ *          0 as fast as possible; -d and -m split the record in segments
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+#include "io/serial.h"
+#include "io/serial_anemometers.h"
+#include "io/replay.h"
+#include "io/record.h"
+
+static void replay_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-s speed] [-j threads] [-o record.h5] [-d segment_s] [-m segment_MiB] capture_file\n"
+            "          speed 1 is real time, 0 as fast as possible\n", name);
+}
+
+int main(int argc, char **argv)
+{
+    double speed = 1.;
+    int n_threads = 1;
+    const char* record_name = NULL;
+    double segment_s = 0.;
+    double segment_mib = 0.;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:j:o:d:m:h")) != -1) {
+        switch (opt) {
+            case 's': speed = atof(optarg); break;
+            case 'j': n_threads = atoi(optarg); break;
+            case 'o': record_name = optarg; break;
+            case 'd': segment_s = atof(optarg); break;
+            case 'm': segment_mib = atof(optarg); break;
+            default: replay_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    if (optind >= argc or speed < 0.) {
+        replay_usage(argv[0]);
+        return EXIT_FAILURE;
+    }
+    const char* capture_name = argv[optind];
+
+    // the recorder has to be in the pipeline before the first sample
+    int n_sensors = WR_Replay_get_num_sensors(capture_name);
+    if (n_sensors < 1) {
+        fprintf(stderr, "ERROR: %s is not a capture file\n", capture_name);
+        return EXIT_FAILURE;
+    }
+    WR_Record_set_segments(segment_s, (uint64_t)(segment_mib*1024*1024));
+    if (record_name and !WR_Record_start(n_sensors, record_name)) {
+        fprintf(stderr, "ERROR: could not create %s\n", record_name);
+        return EXIT_FAILURE;
+    }
+
+    int64_t start = serial_clock_ns();
+    if (!sonic_anemometer_init_replay(capture_name, speed, n_threads)) {
+        WR_Record_stop();
+        return EXIT_FAILURE;
+    }
+    struct timespec poll = {0, 10000000};
+    while (!sonic_anemometer_replay_done())
+        nanosleep(&poll, NULL);
+    int64_t parsed = serial_clock_ns();
+    sonic_anemometer_close(); // drains the pipeline
+    WR_Record_stop();
+    int64_t end = serial_clock_ns();
+
+    uint64_t bytes = 0, frames = 0;
+    for (int i = 0; i < sonic_anemometer_get_num(); i++) {
+        Anemometer_Health_t health;
+        sonic_anemometer_get_health(i, &health);
+        printf("%4d  %-16s %10llu frames %6llu checksum failures %6llu resyncs %6llu gaps\n", i+1,
+                sonic_anemometer_get_type(i), (unsigned long long)health.frames,
+                (unsigned long long)health.checksum_failures, (unsigned long long)health.resyncs,
+                (unsigned long long)health.gaps);
+        bytes += health.bytes;
+        frames += health.frames;
+    }
+    double seconds = (end - start)/1e9;
+    printf("%llu bytes, %llu frames in %.3f s (parsing done after %.3f s), %.0f frames/s, %.1f MB/s\n",
+            (unsigned long long)bytes, (unsigned long long)frames, seconds, (parsed - start)/1e9,
+            frames/seconds, bytes/seconds/1e6);
+
+    return 0;
+}
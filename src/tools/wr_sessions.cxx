@@ -0,0 +1,195 @@
+/*
+ * Finding recorded sessions by their metadata
+ *
+ * Lists the sessions of a session index (see io/session_index.h) whose
+ * metadata match all the filters given, reading the index only, or
+ * rebuilds the index of a directory from the records in it.
+ *
+ * Usage: wr_sessions [-r] [-d dir] [-k key,key,...] [filter ...]
+ *          the index is dir/WR_sessions.index, dir . by default; -r
+ *          rebuilds it from the manifests and records in dir first;
+ *          prints the sessions found, one per line, followed by the
+ *          values of the keys given with -k, tab separated
+ *          filters: key=value, key!=value, key~text (value contains
+ *          text), key<value, key>value (as numbers if both are, else
+ *          as text, so start>2026-10-01 works too)
+ *
+ * Author:
+ *      Roice Luo (Bing Luo)
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "io/session_index.h"
+
+typedef struct {
+    std::string key;
+    char op; // '=', '!', '~', '<', '>'
+    std::string value;
+} Sessions_Filter_t;
+
+static void sessions_usage(const char* name)
+{
+    fprintf(stderr, "Usage: %s [-r] [-d dir] [-k key,key,...] [filter ...]\n"
+            "          filter: key=value, key!=value, key~text, key<value, key>value\n", name);
+}
+
+static bool sessions_parse_filter(const char* arg, Sessions_Filter_t* filter)
+{
+    const char* p = strpbrk(arg, "=!~<>");
+    if (p == NULL or p == arg)
+        return false;
+    filter->key.assign(arg, p - arg);
+    filter->op = *p;
+    if (*p == '!') {
+        if (p[1] != '=')
+            return false;
+        p++;
+    }
+    filter->value = p+1;
+    return true;
+}
+
+static bool sessions_match(const Session_Info_t* info, const Sessions_Filter_t* filter)
+{
+    const char* value = WR_Session_get(info, filter->key.c_str());
+    if (value == NULL)
+        return filter->op == '!';
+    switch (filter->op) {
+        case '=': return filter->value == value;
+        case '!': return filter->value != value;
+        case '~': return strstr(value, filter->value.c_str()) != NULL;
+    }
+    char* end_a;
+    char* end_b;
+    double a = strtod(value, &end_a), b = strtod(filter->value.c_str(), &end_b);
+    int cmp;
+    if (*value and *end_a == '\0' and !filter->value.empty() and *end_b == '\0')
+        cmp = a < b ? -1 : a > b ? 1 : 0;
+    else
+        cmp = strcmp(value, filter->value.c_str());
+    return filter->op == '<' ? cmp < 0 : cmp > 0;
+}
+
+static bool sessions_ends_with(const std::string& s, const char* suffix)
+{
+    size_t n = strlen(suffix);
+    return s.size() >= n and s.compare(s.size()-n, n, suffix) == 0;
+}
+
+/* manifests, and records not part of one (name_NNNN.h5 next to name.manifest) */
+static bool sessions_rebuild(const std::string& dir, const std::string& index_name)
+{
+    DIR* d = opendir(dir.c_str());
+    if (d == NULL) {
+        perror(dir.c_str());
+        return false;
+    }
+    std::vector<std::string> names;
+    struct dirent* entry;
+    while ((entry = readdir(d)) != NULL) {
+        std::string name = entry->d_name;
+        if (sessions_ends_with(name, ".manifest"))
+            names.push_back(name);
+        else if (sessions_ends_with(name, ".h5")) {
+            size_t n = name.size();
+            if (n > 8 and name[n-8] == '_' and strspn(name.c_str() + n-7, "0123456789") == 4
+                    and access((dir + "/" + name.substr(0, n-8) + ".manifest").c_str(), F_OK) == 0)
+                continue;
+            names.push_back(name);
+        }
+    }
+    closedir(d);
+    std::sort(names.begin(), names.end()); // session names hold their start time
+
+    std::string tmp_name = index_name + ".tmp";
+    ::remove(tmp_name.c_str());
+    int n_indexed = 0;
+    Session_Info_t info;
+    for (size_t k = 0; k < names.size(); k++) {
+        std::string name = dir + "/" + names[k];
+        if (!WR_Session_describe(name.c_str(), &info)) {
+            fprintf(stderr, "%s skipped\n", name.c_str());
+            continue;
+        }
+        if (!WR_Session_index_add(tmp_name.c_str(), &info))
+            return false;
+        n_indexed++;
+    }
+    if (n_indexed == 0) {
+        fprintf(stderr, "no sessions in %s\n", dir.c_str());
+        return false;
+    }
+    if (rename(tmp_name.c_str(), index_name.c_str()) < 0) {
+        perror(index_name.c_str());
+        return false;
+    }
+    fprintf(stderr, "%d sessions indexed in %s\n", n_indexed, index_name.c_str());
+    return true;
+}
+
+int main(int argc, char **argv)
+{
+    bool rebuild = false;
+    std::string dir = ".";
+    std::vector<std::string> keys;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "rd:k:h")) != -1) {
+        switch (opt) {
+            case 'r': rebuild = true; break;
+            case 'd': dir = optarg; break;
+            case 'k':
+                for (const char* p = optarg; *p; ) {
+                    size_t n = strcspn(p, ",");
+                    if (n)
+                        keys.push_back(std::string(p, n));
+                    p += p[n] ? n+1 : n;
+                }
+                break;
+            default: sessions_usage(argv[0]); return EXIT_FAILURE;
+        }
+    }
+    std::vector<Sessions_Filter_t> filters(argc - optind);
+    for (int k = optind; k < argc; k++)
+        if (!sessions_parse_filter(argv[k], &filters[k - optind])) {
+            fprintf(stderr, "ERROR: not a filter: %s\n", argv[k]);
+            sessions_usage(argv[0]);
+            return EXIT_FAILURE;
+        }
+
+    while (dir.size() > 1 and dir[dir.size()-1] == '/')
+        dir.erase(dir.size()-1);
+    std::string index_name = dir + "/" + SESSION_INDEX_FILE;
+    if (rebuild and !sessions_rebuild(dir, index_name))
+        return EXIT_FAILURE;
+    std::vector<Session_Info_t> sessions;
+    if (!WR_Session_index_load(index_name.c_str(), &sessions))
+        return EXIT_FAILURE;
+
+    // names usable as they are, by wr_read and wr_export
+    std::string prefix = dir == "." ? "" : dir + "/";
+    for (size_t s = 0; s < sessions.size(); s++) {
+        bool match = true;
+        for (size_t k = 0; k < filters.size() and match; k++)
+            match = sessions_match(&sessions[s], &filters[k]);
+        if (!match)
+            continue;
+        printf("%s%s", prefix.c_str(), WR_Session_get(&sessions[s], "session"));
+        for (size_t k = 0; k < keys.size(); k++) {
+            const char* value = WR_Session_get(&sessions[s], keys[k].c_str());
+            printf("\t%s", value ? value : "");
+        }
+        printf("\n");
+    }
+
+    return 0;
+}
+
+/* End of wr_sessions.cxx */
@@ -6,6 +6,12 @@
  * Date: 2017-04-16 create this file
  */
 
+/* C */
+#include <stdio.h>
+#include <math.h> // NAN
+/* C++ */
+#include <string>
+#include <vector>
 /* FLTK */
 #include <FL/Fl.H>
 #include <FL/Fl_Double_Window.H>
@@ -22,12 +28,21 @@
 #include <FL/Fl_Choice.H>
 #include <FL/Fl_Input.H>
 #include <FL/Fl_Scroll.H>
+#include <FL/Fl_Check_Button.H>
 /* OpenGL */
 #include <FL/Fl_Gl_Window.H>
 #include <FL/gl.h>
 #include <FL/glut.H>
 /* WindRecorder */
 #include "WR_config.h"
+#include "io/serial_anemometers.h"
+#include "io/anemometer_driver.h"
+#include "io/replay.h"
+#include "io/record.h"
+#include "io/cross_corr.h"
+#include "io/sample_despike.h"
+#include "io/sample_stats.h"
+#include "io/sample_psd.h"
 #include "ui/UI.h"
 #include "ui/View.h"
 #include "ui/icons/icons.h" // pixmap icons used in Tool bar
@@ -35,9 +50,22 @@
 /*------- Configuration Dialog -------*/
 struct ConfigDlg_Widgets { // for parameter saving
     // serial port receiving anemometer data
-    Fl_Choice* num_of_anemometers;
-    Fl_Input* anemo_serial_port[SERIAL_MAX_ANEMOMETERS];
-    Fl_Choice* anemo_type[SERIAL_MAX_ANEMOMETERS];
+    Fl_Value_Input* num_of_anemometers;
+    Fl_Scroll* anemo_rows; // one row of port & type per anemometer
+    std::vector<Fl_Input*> anemo_serial_port;
+    std::vector<Fl_Choice*> anemo_type;
+    Fl_Check_Button* raw_capture;
+    // replay of a raw capture instead of the serial ports
+    Fl_Input* replay_file;
+    Fl_Value_Input* replay_speed;
+    // recording segments
+    Fl_Value_Input* segment_minutes;
+    Fl_Value_Input* segment_size_mb;
+    // compression
+    Fl_Value_Input* compression_level;
+    Fl_Check_Button* round_to_sensor_precision;
+    // in-memory history
+    Fl_Check_Button* compress_history;
 };
 class ConfigDlg : public Fl_Window
 {
@@ -49,8 +77,13 @@ private:
     // callback funcs
     static void cb_close(Fl_Widget*, void*);
     static void cb_switch_tabs(Fl_Widget*, void*);
+    static void cb_change_num_of_anemometers(Fl_Widget*, void*);
+    // (re)create the anemometer rows from runtime configs
+    static void build_anemometer_rows(ConfigDlg_Widgets*);
     // function to save current value of widgets to runtime configs
     static void save_value_to_configs(ConfigDlg_Widgets*);
+    // function to set widget values according to runtime configs
+    static void get_value_from_configs(ConfigDlg_Widgets*);
 };
 void ConfigDlg::cb_close(Fl_Widget* w, void* data) {
     if (Fl::event() == FL_CLOSE) {
@@ -67,8 +100,73 @@ void ConfigDlg::cb_switch_tabs(Fl_Widget *w, void *data)
     // When tab changed, make sure it has same color as its group
     tabs->selection_color( (tabs->value())->color() );
 }
+void ConfigDlg::cb_change_num_of_anemometers(Fl_Widget *w, void *data)
+{
+    struct ConfigDlg_Widgets *ws = (struct ConfigDlg_Widgets*)data;
+    // keep what was typed in the rows which stay
+    save_value_to_configs(ws);
+    WR_Config_set_num_of_anemometers((int)ws->num_of_anemometers->value());
+    build_anemometer_rows(ws);
+}
+void ConfigDlg::build_anemometer_rows(ConfigDlg_Widgets* ws)
+{
+    WR_Config_t* configs = WR_Config_get_configs(); // get runtime configs
+    Fl_Scroll* rows = ws->anemo_rows;
+    char label[32];
+
+    rows->scroll_to(0, 0);
+    rows->clear(); // keeps the scrollbars
+    ws->anemo_serial_port.clear();
+    ws->anemo_type.clear();
+    rows->begin();
+    for (int i = 0; i < configs->anemo.num_of_anemometers; i++) {
+        snprintf(label, sizeof(label), "Port %d ", i+1);
+        Fl_Input* port = new Fl_Input(rows->x()+60, rows->y()+30*i, 140, 25);
+        port->copy_label(label);
+        port->value(configs->anemo.anemometer_serial_port_path[i].c_str());
+        Fl_Choice* type = new Fl_Choice(rows->x()+245, rows->y()+30*i, 100, 25, "Type");
+        for (int d = 0; d < anemometer_driver_count(); d++)
+            type->add(anemometer_driver_get(d)->name);
+        int idx = type->find_index(configs->anemo.anemometer_type[i].c_str());
+        type->value(idx < 0 ? 0 : idx);
+        ws->anemo_serial_port.push_back(port);
+        ws->anemo_type.push_back(type);
+    }
+    rows->end();
+    rows->redraw();
+}
 void ConfigDlg::save_value_to_configs(ConfigDlg_Widgets* ws) {
     WR_Config_t* configs = WR_Config_get_configs(); // get runtime configs
+    // anemometers
+    configs->anemo.raw_capture = ws->raw_capture->value();
+    configs->anemo.replay_file = ws->replay_file->value();
+    configs->anemo.replay_speed = ws->replay_speed->value();
+    // recording
+    configs->record.segment_minutes = ws->segment_minutes->value();
+    configs->record.segment_size_mb = ws->segment_size_mb->value();
+    configs->record.compression_level = ws->compression_level->value();
+    configs->record.round_to_sensor_precision = ws->round_to_sensor_precision->value();
+    configs->anemo.compress_history = ws->compress_history->value();
+    for (size_t i = 0; i < ws->anemo_serial_port.size() and i < configs->anemo.anemometer_type.size(); i++) {
+        configs->anemo.anemometer_serial_port_path[i] = ws->anemo_serial_port[i]->value();
+        if (ws->anemo_type[i]->text())
+            configs->anemo.anemometer_type[i] = ws->anemo_type[i]->text();
+    }
+}
+void ConfigDlg::get_value_from_configs(ConfigDlg_Widgets* ws) {
+    WR_Config_t* configs = WR_Config_get_configs(); // get runtime configs
+    // anemometers
+    ws->num_of_anemometers->value(configs->anemo.num_of_anemometers);
+    ws->raw_capture->value(configs->anemo.raw_capture);
+    ws->replay_file->value(configs->anemo.replay_file.c_str());
+    ws->replay_speed->value(configs->anemo.replay_speed);
+    // recording
+    ws->segment_minutes->value(configs->record.segment_minutes);
+    ws->segment_size_mb->value(configs->record.segment_size_mb);
+    ws->compression_level->value(configs->record.compression_level);
+    ws->round_to_sensor_precision->value(configs->record.round_to_sensor_precision);
+    ws->compress_history->value(configs->anemo.compress_history);
+    build_anemometer_rows(ws);
 }
 ConfigDlg::ConfigDlg(int xpos, int ypos, int width, int height, 
         const char* title=0):Fl_Window(xpos,ypos,width,height,title)
@@ -90,6 +188,41 @@ ConfigDlg::ConfigDlg(int xpos, int ypos, int width, int height,
             // color of this tab
             scenario->color(0xebf4fa00); // water
             scenario->selection_color(0xebf4fa00); // water
+
+            // replay a raw capture instead of reading the serial ports
+            Fl_Box *replay_box = new Fl_Box(t_x+10, t_y+25+10, 370, 100,"Replay");
+            replay_box->box(FL_PLASTIC_UP_FRAME);
+            replay_box->labelsize(16);
+            replay_box->labelfont(FL_COURIER_BOLD_ITALIC);
+            replay_box->align(Fl_Align(FL_ALIGN_TOP|FL_ALIGN_INSIDE));
+            ws.replay_file = new Fl_Input(t_x+10+100, t_y+25+10+30, 250, 25, "Capture file");
+            ws.replay_file->tooltip("Leave empty to read the serial ports");
+            ws.replay_speed = new Fl_Value_Input(t_x+10+100, t_y+25+10+60, 100, 25, "Speed");
+            ws.replay_speed->range(0, 1000);
+            ws.replay_speed->tooltip("1 is real time, 0 as fast as possible");
+
+            // split long recordings into segments
+            Fl_Box *record_box = new Fl_Box(t_x+10, t_y+25+10+110, 370, 190,"Recording");
+            record_box->box(FL_PLASTIC_UP_FRAME);
+            record_box->labelsize(16);
+            record_box->labelfont(FL_COURIER_BOLD_ITALIC);
+            record_box->align(Fl_Align(FL_ALIGN_TOP|FL_ALIGN_INSIDE));
+            ws.segment_minutes = new Fl_Value_Input(t_x+10+200, t_y+25+10+110+30, 100, 25, "New file every (min)");
+            ws.segment_minutes->range(0, 100000);
+            ws.segment_minutes->step(1);
+            ws.segment_minutes->tooltip("0 for no limit");
+            ws.segment_size_mb = new Fl_Value_Input(t_x+10+200, t_y+25+10+110+60, 100, 25, "or every (MiB)");
+            ws.segment_size_mb->range(0, 1000000);
+            ws.segment_size_mb->step(1);
+            ws.segment_size_mb->tooltip("0 for no limit");
+            // HDF5 filters, run by the recorder's writer thread
+            ws.compression_level = new Fl_Value_Input(t_x+10+200, t_y+25+10+110+90, 100, 25, "Compression level");
+            ws.compression_level->range(0, 9);
+            ws.compression_level->step(1);
+            ws.compression_level->tooltip("Shuffle & deflate, 0 uncompressed, 1 fastest, 9 smallest");
+            ws.round_to_sensor_precision = new Fl_Check_Button(t_x+15, t_y+25+10+110+120, 300, 25, "Round wind && temperature to 0.01");
+            // days of history on a laptop
+            ws.compress_history = new Fl_Check_Button(t_x+15, t_y+25+10+110+150, 300, 25, "Compress history kept in memory");
         }
         scenario->end();
 
@@ -107,25 +240,17 @@ ConfigDlg::ConfigDlg(int xpos, int ypos, int width, int height,
             anemometer_box->labelfont(FL_COURIER_BOLD_ITALIC);
             anemometer_box->align(Fl_Align(FL_ALIGN_TOP|FL_ALIGN_INSIDE));
             // number of anemometers
-            ws.num_of_anemometers = new Fl_Choice(t_x+10+200, t_y+25+10+20, 100, 25,"Number of anemometers ");
-            ws.num_of_anemometers->add("0");
-            ws.num_of_anemometers->add("1");
-            ws.num_of_anemometers->add("2");
-            ws.num_of_anemometers->add("3");
-            ws.num_of_anemometers->add("4");
-            ws.num_of_anemometers->add("5");
-            ws.num_of_anemometers->add("6");
-            ws.num_of_anemometers->add("7");
-            ws.num_of_anemometers->add("8");
-            ws.num_of_anemometers->add("9");
-            ws.num_of_anemometers->add("10");
-            //ws.num_of_anemometers->callback(cb_change_num_of_anemometers, (void*)&ws);
-            for (int i = 0; i < SERIAL_MAX_ANEMOMETERS; i++) {
-                ws.anemo_serial_port[i] = new Fl_Input(t_x+10+50, t_y+25+10+50+30*i, 160, 25, "Port ");
-                ws.anemo_type[i] = new Fl_Choice(t_x+10+100+160, t_y+25+10+50+30*i, 100, 25, "Type");
-                ws.anemo_type[i]->add("RM Young 3D");
-                ws.anemo_type[i]->add("Gill 3D");
-            }
+            ws.num_of_anemometers = new Fl_Value_Input(t_x+10+200, t_y+25+10+20, 100, 25,"Number of anemometers ");
+            ws.num_of_anemometers->range(0, 4096);
+            ws.num_of_anemometers->step(1);
+            ws.num_of_anemometers->when(FL_WHEN_RELEASE|FL_WHEN_ENTER_KEY);
+            ws.num_of_anemometers->callback(cb_change_num_of_anemometers, (void*)&ws);
+            // port & type of each, scrolled as there may be hundreds
+            ws.anemo_rows = new Fl_Scroll(t_x+15, t_y+25+10+50, 360, 265);
+            ws.anemo_rows->type(Fl_Scroll::VERTICAL);
+            ws.anemo_rows->end();
+            // raw bytes, for debugging the sensors afterwards
+            ws.raw_capture = new Fl_Check_Button(t_x+15, t_y+25+10+320, 250, 25, "Capture raw serial bytes");
         }
         flow->end();
     }
@@ -135,7 +260,7 @@ ConfigDlg::ConfigDlg(int xpos, int ypos, int width, int height,
     
     end();
     // set widget value according to runtime configs
-    //get_value_from_configs(&ws);
+    get_value_from_configs(&ws);
     show();
 }
 
@@ -180,8 +305,102 @@ void ToolBar::cb_button_start(Fl_Widget *w, void *data)
         // lock config button
         widgets->config->deactivate();
         widgets->msg_zone->label(""); // clear message zone
-        // clear anemometer record
-        //
+        // anemometer records start empty, the sensor registry is rebuilt by init
+        int n = configs->anemo.num_of_anemometers;
+        bool replay = !configs->anemo.replay_file.empty();
+        if (replay) { // as many sensors as were captured
+            n = WR_Replay_get_num_sensors(configs->anemo.replay_file.c_str());
+            if (n < 1) {
+                widgets->msg_zone->label("Not a capture file");
+                ((Fl_Button*)w)->value(0);
+                widgets->config->activate();
+                return;
+            }
+        }
+        // stream samples to disk while running, in segments if configured
+        WR_Record_set_segments(configs->record.segment_minutes*60.,
+                (uint64_t)configs->record.segment_size_mb << 20);
+        WR_Record_set_compression(configs->record.compression_level,
+                configs->record.round_to_sensor_precision ? 2 : -1);
+        // spectra shown in the view and recorded; both checked before either
+        // is set, a segment as sample_psd_set_segment() takes it
+        int psd_segment = configs->anemo.spectrum_segment;
+        double psd_period = configs->anemo.spectrum_minutes*60.;
+        if ((psd_segment != 0 and (psd_segment < 64 or (psd_segment & (psd_segment-1)) != 0))
+                or !(psd_period >= 1.))
+            widgets->msg_zone->label("Spectrum settings not valid, previous ones kept");
+        else {
+            sample_psd_set_segment(psd_segment);
+            sample_psd_set_period(psd_period);
+        }
+        // the record keeps the settings it was taken with, the arena also
+        // on its own so sessions can be found by it
+        char value[32];
+        WR_Record_clear_metadata();
+        WR_Record_set_metadata("config", WR_Config_to_string().c_str());
+        snprintf(value, sizeof(value), "%g", configs->arena.w);
+        WR_Record_set_metadata("arena_width", value);
+        snprintf(value, sizeof(value), "%g", configs->arena.l);
+        WR_Record_set_metadata("arena_length", value);
+        snprintf(value, sizeof(value), "%g", configs->arena.h);
+        WR_Record_set_metadata("arena_height", value);
+        if (replay)
+            WR_Record_set_metadata("replay_of", configs->anemo.replay_file.c_str());
+        if (!WR_Record_start(n)) {
+            widgets->msg_zone->label("Failed to create record file");
+            ((Fl_Button*)w)->value(0);
+            widgets->config->activate();
+            return;
+        }
+        // raw capture next to the record, WR_record_<time>.cap
+        if (configs->anemo.raw_capture and !replay) {
+            std::string capture_name = WR_Record_get_session_name();
+            capture_name += ".cap";
+            sonic_anemometer_set_capture(capture_name.c_str());
+        }
+        else
+            sonic_anemometer_set_capture(NULL);
+        sonic_anemometer_set_history_compression(configs->anemo.compress_history);
+        if (!sample_despike_set(configs->anemo.despike, configs->anemo.despike_window,
+                    configs->anemo.despike_threshold))
+            widgets->msg_zone->label("Despiking settings not valid, previous ones kept");
+        // windows of the statistics shown in the view, the stage's own (1 min
+        // and 10 min) unless the settings list some
+        std::vector<double> windows(configs->anemo.stats_windows.begin(), configs->anemo.stats_windows.end());
+        if (!windows.empty() and !sample_stats_set_windows(windows.data(), windows.size()))
+            widgets->msg_zone->label("Statistics windows not valid, previous ones kept");
+        // pairs correlated while running, by as many workers as set
+        if (!cross_corr_set_period(configs->anemo.correlation_period_s))
+            widgets->msg_zone->label("Correlation period not valid, previous one kept");
+        cross_corr_set_threads(configs->anemo.correlation_threads);
+        // separations for the advection velocities between sensors; a capture
+        // keeps no positions and its sensors need not be those configured,
+        // so a replay leaves them unknown and its velocities NAN
+        for (int i = 0; i < n; i++) {
+            if (replay or i >= (int)configs->anemo.anemometer_position.size())
+                cross_corr_set_position(i, NAN, NAN, NAN);
+            else {
+                const WR_Config_Position_t* p = &configs->anemo.anemometer_position[i];
+                cross_corr_set_position(i, p->x, p->y, p->z);
+            }
+        }
+        // start receiving anemometer data
+        if (replay ? !sonic_anemometer_init_replay(configs->anemo.replay_file.c_str(),
+                    configs->anemo.replay_speed, 1)
+                : !sonic_anemometer_init(n, configs->anemo.anemometer_serial_port_path.data(),
+                    configs->anemo.anemometer_type.data())) {
+            sonic_anemometer_close();
+            WR_Record_stop();
+            ::remove(WR_Record_get_file_name());
+            if (WR_Record_get_journal_name()[0])
+                ::remove(WR_Record_get_journal_name());
+            if (WR_Record_get_manifest_name()[0])
+                ::remove(WR_Record_get_manifest_name());
+            widgets->msg_zone->label("Failed to open anemometer serial ports");
+            ((Fl_Button*)w)->value(0);
+            widgets->config->activate();
+            return;
+        }
         // start counting experiment time
         View_start_count_time();
     }
@@ -205,8 +424,9 @@ void ToolBar::cb_button_stop(Fl_Widget *w, void *data)
     // unlock config button
     widgets->config->activate();
 
-    // save robot record
-    //WR_Save_Data();
+    // stop receiving, then record what is left in the pipeline
+    sonic_anemometer_close();
+    WR_Record_stop();
 }
 void ToolBar::cb_button_config(Fl_Widget *w, void *data)
 {
@@ -250,8 +470,8 @@ Fl_Group(Xpos, Ypos, Width, Height)
     ws.stop->image(icon_stop);
     ws.config->image(icon_config);
     // tips for buttons
-    ws.start->tooltip("Start Searching");
-    ws.stop->tooltip("Stop Searching");
+    ws.start->tooltip("Start Recording");
+    ws.stop->tooltip("Stop Recording");
     ws.config->tooltip("Settings");
     // types of buttons
     ws.start->type(FL_TOGGLE_BUTTON);
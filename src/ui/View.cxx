@@ -16,11 +16,17 @@
 #include <FL/glut.H>
 #include <FL/glu.h>
 #include <string.h>
+#include <math.h> // fmod, isnan
 #include <time.h> // for srand seeding and FPS calculation
 #include <sys/time.h>
+#include <vector>
 #include "ui/agv.h" // eye movement
 #include "ui/draw/DrawScene.h" // draw experiment scene
 #include "WR_config.h"
+#include "io/serial_anemometers.h"
+#include "io/sample_stats.h"
+#include "io/sample_psd.h"
+#include "io/cross_corr.h"
 
 // experiment start time
 struct timeval  time_count_start;
@@ -30,6 +36,8 @@ bool count_experiment_time = false;
 static int win_width = 1;
 static int win_height = 1;
 
+#define VIEW_NOTE_LINE_HEIGHT   15 // px
+
 static void View_reshape(int w, int h)
 {
     // update width/height of window
@@ -169,9 +177,142 @@ static void draw_time_passed_note(void)
     }
 }
 
+/* a line per sensor from the top, as many as fit above the notes at the
+ * bottom: mean wind, direction and turbulence intensity since the start
+ * and over every window; returns the lines drawn */
+static int draw_stats_note(void)
+{
+    char buf[512];
+    int lines = 0;
+
+    glDisable(GL_LIGHTING);
+    {
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        gluOrtho2D(0.0, win_width, 0.0, win_height);
+        glColor3f(1.0f, 1.0f, 1.0f);
+        gl_font(FL_HELVETICA, 12);
+        int n_windows = sample_stats_get_num_windows();
+        for (int i = 0; i < sonic_anemometer_get_num(); i++) {
+            int y = win_height - VIEW_NOTE_LINE_HEIGHT*(lines+1);
+            if (y < 10 + 2*VIEW_NOTE_LINE_HEIGHT)
+                break;
+            int len = snprintf(buf, sizeof(buf), "Anemometer %d", i+1);
+            Sample_Stats_t stats;
+            for (int w = 0; w <= n_windows and len < (int)sizeof(buf); w++) {
+                if (!sample_stats_get(i, w, &stats))
+                    break; // no sample yet
+                double seconds = sample_stats_get_window(w);
+                char window[16];
+                if (w == SAMPLE_STATS_CUMULATIVE)
+                    snprintf(window, sizeof(window), "all");
+                else if (fmod(seconds, 60.) == 0.)
+                    snprintf(window, sizeof(window), "%g min", seconds/60.);
+                else
+                    snprintf(window, sizeof(window), "%g s", seconds);
+                if (isnan(stats.direction))
+                    len += snprintf(buf+len, sizeof(buf)-len, "   %s: %.2f m/s, calm", window, stats.speed);
+                else
+                    len += snprintf(buf+len, sizeof(buf)-len, "   %s: %.2f m/s from %.0f deg, TI %.2f",
+                            window, stats.speed, stats.direction, stats.ti);
+            }
+            gl_draw(buf, 10, y);
+            lines++;
+        }
+    }glEnable(GL_LIGHTING);
+    return lines;
+}
+
+/* a line per sensor with a spectrum, below the statistics: the frequency of
+ * the peak of u, v, w & T in the newest spectrum; returns the lines drawn
+ * in all */
+static int draw_psd_note(int lines)
+{
+    static std::vector<float> psd; // of SAMPLE_PSD_CHANNELS spectra
+    char buf[256];
+    const char* channels[SAMPLE_PSD_CHANNELS] = {"u", "v", "w", "T"};
+
+    int n_bins = sample_psd_get_num_bins();
+    if (n_bins == 0)
+        return lines; // disabled
+    psd.resize(SAMPLE_PSD_CHANNELS*n_bins);
+    glDisable(GL_LIGHTING);
+    {
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        gluOrtho2D(0.0, win_width, 0.0, win_height);
+        glColor3f(1.0f, 1.0f, 1.0f);
+        gl_font(FL_HELVETICA, 12);
+        for (int i = 0; i < sonic_anemometer_get_num(); i++) {
+            int y = win_height - VIEW_NOTE_LINE_HEIGHT*(lines+1);
+            if (y < 10 + 2*VIEW_NOTE_LINE_HEIGHT)
+                break;
+            Sample_Psd_Info_t info;
+            if (!sample_psd_get(i, &info, psd.data()) or info.n_bins != n_bins)
+                continue; // none yet, or of a segment length since changed
+            int len = snprintf(buf, sizeof(buf), "Anemometer %d spectrum of %d segments, peaks at",
+                    i+1, info.segments);
+            for (int c = 0; c < SAMPLE_PSD_CHANNELS; c++) {
+                const float* p = &psd[c*n_bins];
+                int peak = 1; // the mean was removed, bin 0 is left out
+                for (int k = 2; k < n_bins; k++)
+                    if (p[k] > p[peak])
+                        peak = k;
+                len += snprintf(buf+len, sizeof(buf)-len, " %s %.3f Hz", channels[c], peak*info.df);
+            }
+            gl_draw(buf, 10, y);
+            lines++;
+        }
+    }glEnable(GL_LIGHTING);
+    return lines;
+}
+
+/* a line per sensor below the spectra: the sensor it correlates best with
+ * in the newest matrix, the lag, peak and advection velocity of the pair */
+static void draw_corr_note(int lines)
+{
+    static std::vector<Cross_Corr_Pair_t> pairs; // n*n
+    char buf[256];
+
+    int n = sonic_anemometer_get_num();
+    pairs.resize(n*n);
+    Cross_Corr_Info_t info;
+    if (n < 2 or !cross_corr_get(&info, pairs.data()) or info.n_sensors != n)
+        return; // none yet, or disabled
+    glDisable(GL_LIGHTING);
+    {
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        gluOrtho2D(0.0, win_width, 0.0, win_height);
+        glColor3f(1.0f, 1.0f, 1.0f);
+        gl_font(FL_HELVETICA, 12);
+        for (int i = 0; i < n; i++) {
+            int y = win_height - VIEW_NOTE_LINE_HEIGHT*(lines+1);
+            if (y < 10 + 2*VIEW_NOTE_LINE_HEIGHT)
+                break;
+            int best = -1;
+            for (int j = 0; j < n; j++)
+                if (j != i and !isnan(pairs[i*n+j].peak) and (best < 0 or pairs[i*n+j].peak > pairs[i*n+best].peak))
+                    best = j;
+            if (best < 0)
+                continue; // no window
+            const Cross_Corr_Pair_t* pair = &pairs[i*n+best];
+            int len = snprintf(buf, sizeof(buf), "Anemometer %d most like %d: lag %.2f s, r %.2f",
+                    i+1, best+1, pair->lag, pair->peak);
+            if (!isnan(pair->velocity))
+                snprintf(buf+len, sizeof(buf)-len, ", advection %.2f m/s", pair->velocity);
+            gl_draw(buf, 10, y);
+            lines++;
+        }
+    }glEnable(GL_LIGHTING);
+}
+
 static void draw_notes(void) {
     draw_ui_fps_note();     // frames per second of UI
     draw_time_passed_note();// time passed since start
+    int lines = draw_stats_note(); // statistics of every sensor
+    lines = draw_psd_note(lines); // spectra of every sensor
+    draw_corr_note(lines);  // correlation between sensors
 }
 
 static void View_idle(void) {